@@ -0,0 +1,96 @@
+import QtQuick 2.10
+import QtQuick.Window 2.10
+import QtQuick.Controls 2.12
+import QtQuick.Layouts 1.12
+
+Window {
+    id: mosaicWindow
+    width: 1280
+    height: 900
+    title: "Mosaic"
+    color: "#161616"
+
+    // Level 0 is full resolution, each next one halves it
+    property int level: Math.max(mosaicBuilder.levels - 1, 0)
+    property int tileSize: mosaicBuilder.tileSize
+    property int span: tileSize * Math.pow(2, level)
+    property int columns: Math.ceil(mosaicBuilder.canvasSize.width / span)
+    property int rows: Math.ceil(mosaicBuilder.canvasSize.height / span)
+
+    Flickable {
+        id: flickable
+        anchors.fill: parent
+        anchors.bottomMargin: controls.height
+        contentWidth: columns * tileSize
+        contentHeight: rows * tileSize
+        clip: true
+
+        // Only tiles in the viewport exist, delegates are reused for new tiles while scrolling
+        property int firstColumn: Math.max(0, Math.floor(contentX / tileSize))
+        property int firstRow: Math.max(0, Math.floor(contentY / tileSize))
+        property int visibleColumns: Math.ceil(width / tileSize) + 1
+        property int visibleRows: Math.ceil(height / tileSize) + 1
+
+        Repeater {
+            model: flickable.visibleColumns * flickable.visibleRows
+            Image {
+                property int tileX: flickable.firstColumn + index % flickable.visibleColumns
+                property int tileY: flickable.firstRow + Math.floor(index / flickable.visibleColumns)
+                visible: tileX < columns && tileY < rows
+                x: tileX * tileSize
+                y: tileY * tileSize
+                width: tileSize
+                height: tileSize
+                asynchronous: true
+                cache: false
+                // Reevaluated on every revision, but the URL only changes, and the tile reloads, if the tile did
+                source: visible ? "image://mosaic/" + level + "/" + tileX + "/" + tileY + "?"
+                                  + (mosaicBuilder.revision, mosaicBuilder.tileRevision(level, tileX, tileY))
+                                : ""
+            }
+        }
+    }
+
+    RowLayout {
+        id: controls
+        anchors.left: parent.left
+        anchors.right: parent.right
+        anchors.bottom: parent.bottom
+
+        Button {
+            text: mosaicBuilder.running ? "Stop" : "Start"
+            onClicked: mosaicBuilder.running ? mosaicBuilder.stop() : mosaicBuilder.start("./mosaic", mosaicParams)
+        }
+
+        Button {
+            text: "Zoom in"
+            enabled: level > 0
+            onClicked: zoom(level - 1)
+        }
+
+        Button {
+            text: "Zoom out"
+            enabled: level < mosaicBuilder.levels - 1
+            onClicked: zoom(level + 1)
+        }
+
+        Text {
+            color: "gray"
+            text: "Level " + level + ", " + mosaicBuilder.framesPlaced + " frames"
+        }
+
+        Item {
+            Layout.fillWidth: true
+        }
+    }
+
+    function zoom(newLevel) {
+        // Keep the center of the view where it is
+        var scale = Math.pow(2, level - newLevel)
+        var cx = (flickable.contentX + flickable.width / 2) * scale
+        var cy = (flickable.contentY + flickable.height / 2) * scale
+        level = newLevel
+        flickable.contentX = Math.max(0, cx - flickable.width / 2)
+        flickable.contentY = Math.max(0, cy - flickable.height / 2)
+    }
+}
@@ -1,4 +1,5 @@
 #include "automator.h"
+#include "monotonicclock.h"
 #include <math.h>
 
 Automator::Automator(QObject *parent) : QObject(parent)
@@ -7,6 +8,10 @@ Automator::Automator(QObject *parent) : QObject(parent)
     m_enabled = false;
     m_mcConnected = false;
     m_lastdzValid = false;
+    m_lastdzQuality = 1;
+    m_minQuality = 0.5;
+    m_pausePending = false;
+    m_laserPlaneActive = false;
     m_lastCoordsValid = false;
     m_message = "Waiting for pause";
     m_autosendB = false;
@@ -14,8 +19,9 @@ Automator::Automator(QObject *parent) : QObject(parent)
     m_minPower = 1.0;
     m_maxPower = 0.8;
     m_lastSentPower = 0.0;
-    m_powerTimer.setInterval(1000); // maximum power update rate [ms]
-    m_powerTimer.setSingleShot(true);
+    // Rate limit follows session time, so replayed sessions make the same decisions at any speed
+    m_powerChangedAt = 0;
+    m_powerInterval = 1000000000LL; // maximum power update rate
 
     m_mcs_b_initial = 0;
 }
@@ -36,6 +42,16 @@ void Automator::ondzValidChanged(bool valid)
     checkWorkingState();
 }
 
+void Automator::ondzQualityChanged(float quality)
+{
+    m_lastdzQuality = quality;
+    // Pause that came during a weak lock is served as soon as the lock recovers
+    if (m_pausePending && m_working && m_lastdzQuality >= m_minQuality) {
+        m_pausePending = false;
+        applyCorrection();
+    }
+}
+
 void Automator::onMcConnectionStateChanged(bool connected)
 {
     m_mcConnected = connected;
@@ -60,7 +76,8 @@ void Automator::onCoordsChanged(float x, float y, float z, float b)
     if (m_maxPower < m_minPower)
         return;
 
-    if (m_powerTimer.isActive())
+    qint64 now = sessionNs();
+    if (m_powerChangedAt != 0 && now - m_powerChangedAt < m_powerInterval)
         return;
 
     const float maxX = 2200;
@@ -80,32 +97,48 @@ void Automator::onCoordsChanged(float x, float y, float z, float b)
     m_lastSentPower = targetPower;
     emit changePower(m_lastSentPower / 5.0);
 
-    m_powerTimer.start();
+    m_powerChangedAt = now;
 }
 
 void Automator::onMcStateChanged(RayReceiver::State s)
 {
+    m_pausePending = false;
     if (!m_working)
         return;
     if (s == RayReceiver::Paused) {
-        float compensated = compensate(m_lastdz);
-        if (compensated > 10) {
-            m_message = "No entry in comp table";
+        if (m_lastdzQuality < m_minQuality) {
+            m_pausePending = true;
+            m_message = QString("Weak lock (%1), waiting").arg(m_lastdzQuality, 0, 'f', 2);
             emit messageChanged();
-        } else {
-            float targetB = m_mcs_b_initial + compensated;
-            QString correction = QString("G90 G0 B%1\n").arg(targetB);
-            m_message = correction;
-            if (m_autosendB) {
-                emit sendToMC(correction);
-                emit sendToMC("M24\n");
-            }
+            return;
+        }
+        applyCorrection();
+    }
+}
+
+void Automator::applyCorrection()
+{
+    float compensated = compensate(m_lastdz);
+    if (compensated > 10) {
+        m_message = "No entry in comp table";
+        emit messageChanged();
+    } else {
+        float targetB = m_mcs_b_initial + compensated;
+        QString correction = QString("G90 G0 B%1\n").arg(targetB);
+        m_message = correction;
+        emit messageChanged();
+        if (m_autosendB) {
+            emit sendToMC(correction);
+            emit sendToMC("M24\n");
         }
     }
 }
 
 float Automator::compensate(float dz) const
 {
+    // Calibrated dz is the axis travel that reproduces the beam position, the table would correct it twice
+    if (m_laserPlaneActive)
+        return dz;
     //                   CAM     ERROR
     const float map[] = {108,	2.11497190323067,
                          107.9,	2.11568618514411,
@@ -1297,9 +1330,16 @@ float Automator::compensate(float dz) const
     return map[range + 3] + valueSpan * dist;
 }
 
+void Automator::setLaserPlaneActive(bool active)
+{
+    m_laserPlaneActive = active;
+}
+
 void Automator::checkWorkingState()
 {
     bool working = m_lastdzValid && m_mcConnected && m_lastCoordsValid && m_enabled;
+    if (!working)
+        m_pausePending = false;
     if (working != m_working) {
         m_working = working;
         emit workingChanged();
@@ -1321,6 +1361,16 @@ float Automator::lastSentPower() const
     return m_lastSentPower;
 }
 
+float Automator::minQuality() const
+{
+    return m_minQuality;
+}
+
+void Automator::setMinQuality(float minQuality)
+{
+    m_minQuality = minQuality;
+}
+
 float Automator::maxPower() const
 {
     return m_maxPower;
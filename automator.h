@@ -3,7 +3,6 @@
 
 #include <QObject>
 #include "rayreceiver.h"
-#include <QTimer>
 
 class Automator : public QObject
 {
@@ -16,6 +15,7 @@ class Automator : public QObject
     Q_PROPERTY(float minPower READ minPower WRITE setMinPower)
     Q_PROPERTY(float maxPower READ maxPower WRITE setMaxPower)
     Q_PROPERTY(float lastSentPower READ lastSentPower NOTIFY changePower)
+    Q_PROPERTY(float minQuality READ minQuality WRITE setMinQuality)
 public:
     explicit Automator(QObject *parent = nullptr);
 
@@ -25,8 +25,20 @@ public:
     void setEnabled(bool enabled);
 
     QString message() const;
+    /**
+     * @brief compensate B offset from where the pause started that brings the surface back to the zero distance.
+     * Both paths take dz > 0 as the surface being further from the camera than at zero (LaserGeometry and LaserPlane
+     * agree on it) and return an offset of the same sign. Without a laser plane the empirical comp table maps
+     * nominal geometry dz to B, with one dz is already calibrated axis mm and is returned as is.
+     * A value above 10 means no correction, dz is outside the table or implausibly large.
+     */
     Q_INVOKABLE float compensate(float dz) const;
 
+    /**
+     * @brief setLaserPlaneActive Set when LineDetector uses a valid LaserPlane, bypasses the comp table
+     */
+    void setLaserPlaneActive(bool active);
+
     bool autosendB() const;
     void setAutosendB(bool autosendB);
 
@@ -41,6 +53,12 @@ public:
 
     float lastSentPower() const;
 
+    /**
+     * @brief minQuality Lowest DzFilter lock quality a correction is sent at, a pause during a weaker lock waits for it
+     */
+    float minQuality() const;
+    void setMinQuality(float minQuality);
+
 signals:
     void workingChanged();
     void enabledChanged();
@@ -51,6 +69,7 @@ signals:
 public slots:
     void ondzChanged(float dz);
     void ondzValidChanged(bool valid);
+    void ondzQualityChanged(float quality);
     void onMcConnectionStateChanged(bool connected);
     void onRayConnectionStateChanged(bool connected);
     void onCoordsChanged(float x, float y, float z, float b);
@@ -58,9 +77,14 @@ public slots:
 
 private:
     void checkWorkingState();
+    void applyCorrection();
     bool m_working;
     float m_lastdz;
     bool m_lastdzValid;
+    float m_lastdzQuality;
+    float m_minQuality;
+    bool m_pausePending;     ///< Paused while lock quality was below m_minQuality
+    bool m_laserPlaneActive;
     bool m_lastCoordsValid;
     bool m_enabled;
     bool m_mcConnected;
@@ -74,7 +98,8 @@ private:
     float m_maxPower;
     float m_minPower;
     float m_lastSentPower;
-    QTimer m_powerTimer;
+    qint64 m_powerChangedAt;  ///< sessionNs() of last power change
+    qint64 m_powerInterval;   ///< Minimum time between power changes [ns]
 };
 
 #endif // AUTOMATOR_H
@@ -0,0 +1,81 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+
+/**
+ * @brief The BoundedQueue class passes items between pipeline stages running on different threads.
+ * push() blocks while the queue is full, pushDropOldest() never blocks, pop() blocks until an item arrives or close().
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity) : m_capacity(capacity), m_closed(false) {}
+
+    /**
+     * @brief push Waits for free space, returns false if queue was closed
+     */
+    bool push(const T &item)
+    {
+        QMutexLocker lock(&m_mutex);
+        while (m_items.size() >= m_capacity && !m_closed)
+            m_notFull.wait(&m_mutex);
+        if (m_closed)
+            return false;
+        m_items.enqueue(item);
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    /**
+     * @brief pushDropOldest Makes room by dropping the oldest item, returns true if one was dropped
+     */
+    bool pushDropOldest(const T &item)
+    {
+        QMutexLocker lock(&m_mutex);
+        bool dropped = false;
+        if (m_items.size() >= m_capacity) {
+            m_items.dequeue();
+            dropped = true;
+        }
+        m_items.enqueue(item);
+        m_notEmpty.wakeOne();
+        return dropped;
+    }
+
+    /**
+     * @brief pop Waits for an item, returns false when queue is closed and drained
+     */
+    bool pop(T &item)
+    {
+        QMutexLocker lock(&m_mutex);
+        while (m_items.isEmpty() && !m_closed)
+            m_notEmpty.wait(&m_mutex);
+        if (m_items.isEmpty())
+            return false;
+        item = m_items.dequeue();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    void close()
+    {
+        QMutexLocker lock(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    int m_capacity;
+    bool m_closed;
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<T> m_items;
+};
+
+#endif // BOUNDEDQUEUE_H
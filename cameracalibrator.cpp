@@ -1,19 +1,42 @@
 #include <opencv2/opencv.hpp>
 
 #include <QDir>
+#include <QFile>
+#include <QCryptographicHash>
+#include <algorithm>
+#include <QtConcurrent>
 
 #include "cameracalibrator.h"
-#include "capturecontroller.hpp"
+#include "capturestream.hpp"
 #include "cvmatsurfacesource.hpp"
 
 
 
 Q_LOGGING_CATEGORY(cameraCalibrator, "vhrd.vision.camera_calibrator");
 
-CameraCalibrator::CameraCalibrator(CaptureController *captureController, QObject *parent) : QObject(parent),
-    m_takePicture(false), m_captureController(captureController),
+const char *CameraCalibrator::CornerCacheFile = "corners.yml";
+
+CameraCalibrator::CameraCalibrator(CaptureStream *captureStream, QObject *parent) : QObject(parent),
+    m_calibrationProgress(0), m_excludeOutliers(true),
+    m_takePicture(false), m_captureStream(captureStream),
     m_horizontalCornersCount(9), m_verticalCornersCount(6)
 {
+    m_calibration.ok = false;
+    m_calibration.rms = 0;
+    connect(&m_loadWatcher, &QFutureWatcher<picture_t>::progressValueChanged,
+            this,           &CameraCalibrator::progressChanged);
+    connect(&m_loadWatcher, &QFutureWatcher<picture_t>::finished,
+            this,           &CameraCalibrator::onPicturesLoaded);
+    connect(&m_pictureWatcher, &QFutureWatcher<picture_t>::finished,
+            this,              &CameraCalibrator::onPictureProcessed);
+    connect(&m_calibrationWatcher, &QFutureWatcher<calibration_t>::finished,
+            this,                  &CameraCalibrator::onCalibrationFinished);
+}
+
+CameraCalibrator::~CameraCalibrator()
+{
+    // Calibration job posts progress to this object
+    m_calibrationWatcher.waitForFinished();
 }
 
 quint32 CameraCalibrator::horizontalCornersCount() const
@@ -25,6 +48,7 @@ void CameraCalibrator::setHorizontalCornersCount(quint32 count)
 {
     m_horizontalCornersCount = count;
     m_pictures.clear();
+    emit picturesCountChanged();
 }
 
 quint32 CameraCalibrator::verticalCornersCount() const
@@ -36,6 +60,25 @@ void CameraCalibrator::setVerticalCornersCount(quint32 count)
 {
     m_verticalCornersCount = count;
     m_pictures.clear();
+    emit picturesCountChanged();
+}
+
+bool CameraCalibrator::busy() const
+{
+    return m_loadWatcher.isRunning() || m_pictureWatcher.isRunning();
+}
+
+int CameraCalibrator::progress() const
+{
+    int total = m_loadWatcher.progressMaximum() - m_loadWatcher.progressMinimum();
+    if (total <= 0)
+        return m_loadWatcher.isRunning() ? 0 : 100;
+    return (m_loadWatcher.progressValue() - m_loadWatcher.progressMinimum()) * 100 / total;
+}
+
+int CameraCalibrator::picturesCount() const
+{
+    return m_pictures.size();
 }
 
 void CameraCalibrator::takePicture()
@@ -47,49 +90,177 @@ void CameraCalibrator::onFrameReady()
 {
     if (!m_takePicture)
         return;
+    if (m_pictureWatcher.isRunning())
+        return; // previous picture is still searched, take this one on a later frame
     m_takePicture = false;
 
     qCDebug(cameraCalibrator) << "Processing frame";
-    cv::Mat frame = m_captureController->frameCopy();
-    findChessboard(frame);
+    cv::Mat frame = m_captureStream->frameCopy();
+    m_pictureBoardSize = boardSize();
+    m_pictureWatcher.setFuture(QtConcurrent::run(&CameraCalibrator::processTakenPicture, frame, m_pictureBoardSize));
+    emit busyChanged();
+}
+
+void CameraCalibrator::onPictureProcessed()
+{
+    emit busyChanged();
+    picture_t picture = m_pictureWatcher.result();
+    if (m_pictureBoardSize != boardSize())
+        return;
+    if (picture.corners.empty()) {
+        qCDebug(cameraCalibrator) << "Pattern not found";
+        return;
+    }
+    qCDebug(cameraCalibrator) << "Pattern found!";
+    addPicture(picture);
 }
 
 void CameraCalibrator::calibrate()
 {
+    if (m_calibrationWatcher.isRunning()) {
+        qCWarning(cameraCalibrator) << "Calibration is already running";
+        return;
+    }
     if (m_pictures.length() <= 1) {
         qCWarning(cameraCalibrator) << "Not enough pictures for calibration";
         return;
     }
+    std::vector<std::vector<cv::Point2f>> views;
+    foreach (const picture_t &p, m_pictures)
+        views.push_back(p.corners);
+    m_calibrationProgress = 0;
+    emit calibrationProgressChanged();
+    m_calibrationWatcher.setFuture(QtConcurrent::run(&CameraCalibrator::runCalibration, views, m_pictures[0].picture.size(),
+                                                     boardSize(), m_excludeOutliers, this));
+    emit calibratingChanged();
+}
+
+CameraCalibrator::calibration_t CameraCalibrator::runCalibration(const std::vector<std::vector<cv::Point2f>> &views,
+                                                                 const cv::Size &imageSize, const cv::Size &boardSize,
+                                                                 bool excludeOutliers, CameraCalibrator *receiver)
+{
     std::vector<cv::Point3f> points;
-    for (quint32 i = 0; i < m_horizontalCornersCount; ++i) {
-        for (quint32 j = 0; j < m_verticalCornersCount; ++j) {
+    for (int i = 0; i < boardSize.height; ++i) {
+        for (int j = 0; j < boardSize.width; ++j) {
             points.push_back(cv::Point3f(i, j, 0));
         }
     }
-    std::vector<std::vector<cv::Point3f>> object_points;
-    std::vector<std::vector<cv::Point2f>> image_points;
 
-    foreach (const picture_t &p, m_pictures) {
-        object_points.push_back(points);
-        image_points.push_back(p.corners);
+    calibration_t result;
+    result.ok = false;
+    result.rms = 0;
+    std::vector<int> used; // indices of views in the current pass
+    for (size_t i = 0; i < views.size(); ++i)
+        used.push_back(static_cast<int>(i));
+    result.viewErrors.assign(views.size(), 0);
+
+    // Second pass only runs if the first one found outliers
+    for (int pass = 0; pass < 2; ++pass) {
+        std::vector<std::vector<cv::Point3f>> objectPoints(used.size(), points);
+        std::vector<std::vector<cv::Point2f>> imagePoints;
+        for (int i : used)
+            imagePoints.push_back(views[i]);
+        std::vector<cv::Mat> rvecs;
+        std::vector<cv::Mat> tvecs;
+        cv::Mat stdDeviationsIntrinsics, stdDeviationsExtrinsics;
+        std::vector<double> perViewErrors;
+        try {
+            result.rms = cv::calibrateCamera(objectPoints, imagePoints, imageSize, result.intrinsic, result.distCoeffs,
+                                             rvecs, tvecs, stdDeviationsIntrinsics, stdDeviationsExtrinsics, perViewErrors);
+        } catch (const cv::Exception &e) {
+            qCWarning(cameraCalibrator) << "Calibration failed:" << e.what();
+            return result;
+        }
+        result.ok = true;
+        for (size_t i = 0; i < used.size(); ++i)
+            result.viewErrors[used[i]] = perViewErrors[i];
+        QMetaObject::invokeMethod(receiver, "setCalibrationProgress", Qt::QueuedConnection, Q_ARG(int, 50 * (pass + 1)));
+
+        if (pass > 0 || !excludeOutliers || used.size() < 4)
+            break;
+        // Robust spread: a view is an outlier if it is far above the median in units of median absolute deviation
+        std::vector<double> sorted = perViewErrors;
+        std::sort(sorted.begin(), sorted.end());
+        double median = sorted[sorted.size() / 2];
+        std::vector<double> deviations;
+        for (double e : perViewErrors)
+            deviations.push_back(qAbs(e - median));
+        std::sort(deviations.begin(), deviations.end());
+        double limit = qMax(median + 3 * 1.4826 * deviations[deviations.size() / 2], 1.5 * median);
+        std::vector<int> kept;
+        for (size_t i = 0; i < used.size(); ++i) {
+            if (perViewErrors[i] > limit)
+                result.excluded.push_back(used[i]);
+            else
+                kept.push_back(used[i]);
+        }
+        if (result.excluded.empty() || kept.size() < 3) {
+            result.excluded.clear();
+            break;
+        }
+        used = kept;
     }
+    QMetaObject::invokeMethod(receiver, "setCalibrationProgress", Qt::QueuedConnection, Q_ARG(int, 100));
+    return result;
+}
 
-    m_intrinsic = cv::Mat(3, 3, CV_32FC1);
-    m_intrinsic.ptr<float>(0)[0] = 1; // fx
-    m_intrinsic.ptr<float>(1)[1] = 1; // fy
+void CameraCalibrator::onCalibrationFinished()
+{
+    emit calibratingChanged();
+    calibration_t result = m_calibrationWatcher.result();
+    if (!result.ok)
+        return;
+    m_calibration = result;
+    m_intrinsic = result.intrinsic;
+    m_distCoeffs = result.distCoeffs;
+    qCDebug(cameraCalibrator) << "rms:" << result.rms << "px over" << result.viewErrors.size() - result.excluded.size()
+                              << "views, excluded outliers:" << QVector<int>::fromStdVector(result.excluded);
+    emit calibrated();
+    // Live stream switches to new intrinsics and distortion together, under the stream's undistort lock
+    if (m_captureStream->status() == CaptureStream::Status::Started)
+        applyCalibrationData();
+}
 
-    cv::Mat distCoeffs;
-    std::vector<cv::Mat> rvecs;
-    std::vector<cv::Mat> tvecs;
+void CameraCalibrator::setCalibrationProgress(int percent)
+{
+    m_calibrationProgress = percent;
+    emit calibrationProgressChanged();
+}
 
-    float rms = cv::calibrateCamera(object_points,
-                                    image_points,
-                                    m_pictures[0].picture.size(),
-                                    m_intrinsic,
-                                    m_distCoeffs,
-                                    rvecs,
-                                    tvecs );
-    qCDebug(cameraCalibrator) << "rms: " << rms;
+bool CameraCalibrator::calibrating() const
+{
+    return m_calibrationWatcher.isRunning();
+}
+
+int CameraCalibrator::calibrationProgress() const
+{
+    return m_calibrationProgress;
+}
+
+bool CameraCalibrator::excludeOutliers() const
+{
+    return m_excludeOutliers;
+}
+
+void CameraCalibrator::setExcludeOutliers(bool exclude)
+{
+    m_excludeOutliers = exclude;
+}
+
+float CameraCalibrator::rms() const
+{
+    return static_cast<float>(m_calibration.rms);
+}
+
+QVariantList CameraCalibrator::viewErrors() const
+{
+    QVariantList errors;
+    for (size_t i = 0; i < m_calibration.viewErrors.size(); ++i) {
+        bool excluded = std::find(m_calibration.excluded.begin(), m_calibration.excluded.end(), static_cast<int>(i))
+                != m_calibration.excluded.end();
+        errors.append(excluded ? -m_calibration.viewErrors[i] : m_calibration.viewErrors[i]);
+    }
+    return errors;
 }
 
 void CameraCalibrator::applyCalibrationData()
@@ -99,7 +270,7 @@ void CameraCalibrator::applyCalibrationData()
         return;
     }
     qCDebug(cameraCalibrator) << "Enabling undistort";
-    m_captureController->enableUndistort(m_intrinsic, m_distCoeffs);
+    m_captureStream->enableUndistort(m_intrinsic, m_distCoeffs);
 }
 
 void CameraCalibrator::savePictures(const QString &toFolder)
@@ -112,33 +283,148 @@ void CameraCalibrator::savePictures(const QString &toFolder)
     } else {
         qCDebug(cameraCalibrator) << "Saving images to" << absPath;
     }
-    quint32 i = 0;
-    foreach (const picture_t &p, m_pictures) {
-        QString filename = QString("%1/%2.jpg").arg(absPath).arg(i);
-        bool ok = false;
-        try {
-            ok = cv::imwrite(filename.toStdString(), p.picture);
-        } catch(...) {
-
-        }
+    // Pictures keep the JPEG they were loaded from or encoded to when taken, nothing is re-encoded
+    for (int i = 0; i < m_pictures.size(); ++i) {
+        const picture_t &p = m_pictures[i];
+        QFile file(QString("%1/%2.jpg").arg(absPath).arg(i));
+        bool ok = file.open(QIODevice::WriteOnly) && file.write(p.encoded) == p.encoded.size();
         qCDebug(cameraCalibrator) << "Saving" << i+1 << "of" << m_pictures.size() << ":" << ok;
-        i += 1;
     }
+    writeCornerCache(dir.absoluteFilePath(CornerCacheFile), boardSize(), m_pictures);
 }
 
 void CameraCalibrator::loadPictures(const QString &fromFolder)
 {
+    if (m_loadWatcher.isRunning()) {
+        qCWarning(cameraCalibrator) << "Pictures are already being loaded";
+        return;
+    }
     qCDebug(cameraCalibrator) << "Loading frames from" << fromFolder;
     QDir dir(fromFolder);
-    QString absPath = dir.absolutePath();
     QStringList images = dir.entryList(QStringList() << "*.jpg" << "*.JPG", QDir::Files);
-    quint32 i = 0;
-    foreach (const QString &image, images) {
-        cv::Mat frame = cv::imread((absPath + "/" + image).toStdString());
-        qCDebug(cameraCalibrator) << "Loading" << i+1 << "of" << images.size() << ":" << !frame.empty();
-        findChessboard(frame);
-        i += 1;
+    QStringList files;
+    foreach (const QString &image, images)
+        files.append(dir.absoluteFilePath(image));
+    // Decode and board search run on the global thread pool, mapped() keeps results in file order
+    LoadPicture load;
+    load.boardSize = boardSize();
+    load.cache = readCornerCache(dir.absoluteFilePath(CornerCacheFile), load.boardSize);
+    m_loadFolder = dir.absolutePath();
+    m_loadBoardSize = load.boardSize;
+    m_loadWatcher.setFuture(QtConcurrent::mapped(files, load));
+    emit busyChanged();
+    emit progressChanged();
+}
+
+CameraCalibrator::picture_t CameraCalibrator::LoadPicture::operator()(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(cameraCalibrator) << "Can't read" << fileName;
+        return picture_t();
+    }
+    QByteArray encoded = file.readAll();
+    cv::Mat frame = cv::imdecode(cv::Mat(1, encoded.size(), CV_8UC1, encoded.data()), cv::IMREAD_COLOR);
+    if (frame.empty()) {
+        qCWarning(cameraCalibrator) << "Can't decode" << fileName;
+        return picture_t();
+    }
+    QByteArray hash = QCryptographicHash::hash(encoded, QCryptographicHash::Sha1);
+    picture_t picture;
+    corner_cache_t::const_iterator cached = cache.constFind(hash);
+    if (cached != cache.constEnd()) {
+        picture.corners = cached.value();
+        picture.cached = true;
+    } else {
+        picture = findChessboard(frame, boardSize);
+    }
+    picture.picture = frame;
+    picture.encoded = encoded;
+    picture.hash = hash;
+    return picture;
+}
+
+CameraCalibrator::picture_t CameraCalibrator::processTakenPicture(const cv::Mat &frame, const cv::Size &boardSize)
+{
+    picture_t picture = findChessboard(frame, boardSize);
+    if (picture.corners.empty())
+        return picture;
+    std::vector<uchar> buffer;
+    cv::imencode(".jpg", frame, buffer, std::vector<int>{cv::IMWRITE_JPEG_QUALITY, 95});
+    picture.encoded = QByteArray(reinterpret_cast<const char *>(buffer.data()), static_cast<int>(buffer.size()));
+    picture.hash = QCryptographicHash::hash(picture.encoded, QCryptographicHash::Sha1);
+    return picture;
+}
+
+CameraCalibrator::corner_cache_t CameraCalibrator::readCornerCache(const QString &fileName, const cv::Size &boardSize)
+{
+    corner_cache_t cache;
+    if (!QFile::exists(fileName))
+        return cache;
+    cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::READ);
+    int width = 0;
+    int height = 0;
+    fs["boardWidth"] >> width;
+    fs["boardHeight"] >> height;
+    if (cv::Size(width, height) != boardSize)
+        return cache; // corners of another board
+    cv::FileNode pictures = fs["pictures"];
+    for (cv::FileNodeIterator it = pictures.begin(); it != pictures.end(); ++it) {
+        std::string hash;
+        cv::Mat corners;
+        (*it)["hash"] >> hash;
+        (*it)["corners"] >> corners;
+        std::vector<cv::Point2f> points;
+        if (!corners.empty())
+            points.assign(corners.begin<cv::Point2f>(), corners.end<cv::Point2f>());
+        cache.insert(QByteArray::fromHex(QByteArray::fromStdString(hash)), points);
+    }
+    return cache;
+}
+
+void CameraCalibrator::writeCornerCache(const QString &fileName, const cv::Size &boardSize, const QList<picture_t> &pictures)
+{
+    cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        qCWarning(cameraCalibrator) << "Can't write corner cache" << fileName;
+        return;
+    }
+    fs << "boardWidth" << boardSize.width;
+    fs << "boardHeight" << boardSize.height;
+    fs << "pictures" << "[";
+    foreach (const picture_t &p, pictures) {
+        if (p.hash.isEmpty())
+            continue;
+        fs << "{" << "hash" << p.hash.toHex().toStdString() << "corners" << cv::Mat(p.corners) << "}";
     }
+    fs << "]";
+}
+
+void CameraCalibrator::onPicturesLoaded()
+{
+    emit busyChanged();
+    emit progressChanged();
+    if (m_loadWatcher.isCanceled() || m_loadBoardSize != boardSize())
+        return;
+    QFuture<picture_t> future = m_loadWatcher.future();
+    int found = 0;
+    int searched = 0;
+    QList<picture_t> results;
+    for (int i = 0; i < future.resultCount(); ++i) {
+        const picture_t picture = future.resultAt(i);
+        results.append(picture);
+        if (!picture.cached && !picture.hash.isEmpty())
+            searched++;
+        if (picture.corners.empty())
+            continue;
+        addPicture(picture);
+        found++;
+    }
+    qCDebug(cameraCalibrator) << "Pattern found in" << found << "of" << future.resultCount() << "pictures,"
+                              << searched << "searched, the rest cached";
+    // Pictures without a board are cached too, so they are not searched again either
+    if (searched > 0)
+        writeCornerCache(QDir(m_loadFolder).absoluteFilePath(CornerCacheFile), m_loadBoardSize, results);
 }
 
 void CameraCalibrator::saveCalibrationData(const QString &filename)
@@ -157,26 +443,59 @@ void CameraCalibrator::loadCalibrationData(const QString &filename)
     fs.release();
 }
 
-void CameraCalibrator::findChessboard(const cv::Mat &frame)
+cv::Size CameraCalibrator::boardSize() const
+{
+    return cv::Size(m_verticalCornersCount, m_horizontalCornersCount);
+}
+
+void CameraCalibrator::addPicture(const picture_t &picture)
 {
+    m_pictures.append(picture);
+    emit picturesCountChanged();
+    cv::Mat preview = picture.picture.clone();
+    drawChessboardCorners(preview, boardSize(), picture.corners, true);
+    CVMatSurfaceSource::imshow("second", preview);
+}
+
+CameraCalibrator::picture_t CameraCalibrator::findChessboard(const cv::Mat &frame, const cv::Size &boardSize)
+{
+    picture_t picture;
     if (frame.empty()) {
         qCWarning(cameraCalibrator) << "empty frame";
+        return picture;
     }
-    cv::Mat gray = cv::Mat(frame.rows, frame.cols, CV_8UC1);
-    cv::cvtColor(frame, gray, cv::COLOR_RGB2GRAY);
-    //CVMatSurfaceSource::imshow("second", gray);
+    cv::Mat gray;
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
 
-    auto board_size = cv::Size(m_verticalCornersCount, m_horizontalCornersCount);
+    // Board is searched on a pyramid level of at most CoarseSize px, FAST_CHECK rejects frames without a board
+    // before the expensive quad search
+    cv::Mat coarse = gray;
+    int scale = 1;
+    while (qMax(coarse.cols, coarse.rows) > CoarseSize) {
+        cv::pyrDown(coarse, coarse);
+        scale *= 2;
+    }
     std::vector<cv::Point2f> corners;
-    bool found = cv::findChessboardCorners(frame, board_size, corners, cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_FILTER_QUADS);
-
-    if (found) {
-        qCDebug(cameraCalibrator) << "Pattern found!";
-        m_pictures.append(picture_t { frame.clone(), corners });
-
-        cornerSubPix(gray, corners, cv::Size(11, 11), cv::Size(-1, -1), cv::TermCriteria(cv::TermCriteria::EPS | cv::TermCriteria::COUNT, 30, 0.1));
-        drawChessboardCorners(frame, board_size, corners, found);
-        CVMatSurfaceSource::imshow("second", frame);
+    bool found = cv::findChessboardCorners(coarse, boardSize, corners,
+                                           cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE |
+                                           cv::CALIB_CB_FILTER_QUADS | cv::CALIB_CB_FAST_CHECK);
+    if (!found)
+        return picture;
 
+    // Refined at full resolution, window is kept below half of the smallest square so it can't reach a neighbour corner
+    float spacing = 0;
+    for (size_t i = 1; i < corners.size(); ++i) {
+        if (static_cast<int>(i) % boardSize.width == 0)
+            continue; // first corner of a row
+        float d = static_cast<float>(cv::norm(corners[i] - corners[i - 1]));
+        spacing = spacing == 0 ? d : qMin(spacing, d);
     }
+    for (cv::Point2f &corner : corners)
+        corner = (corner + cv::Point2f(0.5f, 0.5f)) * scale - cv::Point2f(0.5f, 0.5f);
+    int window = qBound(2, static_cast<int>(spacing * scale * 0.4f), 11);
+    cornerSubPix(gray, corners, cv::Size(window, window), cv::Size(-1, -1),
+                 cv::TermCriteria(cv::TermCriteria::EPS | cv::TermCriteria::COUNT, 30, 0.01));
+    picture.picture = frame;
+    picture.corners = corners;
+    return picture;
 }
@@ -5,23 +5,72 @@
 
 #include <QObject>
 #include <QLoggingCategory>
+#include <QFutureWatcher>
+#include <QVariantList>
+#include <QHash>
 
-class CaptureController;
+class CaptureStream;
 
 class CameraCalibrator : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(quint32 horizontalCornersCount READ horizontalCornersCount WRITE setHorizontalCornersCount)
     Q_PROPERTY(quint32 verticalCornersCount READ verticalCornersCount WRITE setVerticalCornersCount)
+    Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
+    Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(int picturesCount READ picturesCount NOTIFY picturesCountChanged)
+    Q_PROPERTY(bool calibrating READ calibrating NOTIFY calibratingChanged)
+    Q_PROPERTY(int calibrationProgress READ calibrationProgress NOTIFY calibrationProgressChanged)
+    Q_PROPERTY(bool excludeOutliers READ excludeOutliers WRITE setExcludeOutliers)
+    Q_PROPERTY(float rms READ rms NOTIFY calibrated)
 public:
-    explicit CameraCalibrator(CaptureController *captureController, QObject *parent = nullptr);
+    explicit CameraCalibrator(CaptureStream *captureStream, QObject *parent = nullptr);
+    ~CameraCalibrator();
 
     quint32 horizontalCornersCount() const;
     void setHorizontalCornersCount(quint32 count);
     quint32 verticalCornersCount() const;
     void setVerticalCornersCount(quint32 count);
 
+    /**
+     * @brief busy Pictures are being loaded or a taken picture is being searched for the board
+     */
+    bool busy() const;
+    /**
+     * @brief progress Percent of pictures processed by loadPictures()
+     */
+    int progress() const;
+    int picturesCount() const;
+
+    bool calibrating() const;
+    /**
+     * @brief calibrationProgress Percent of calibrate() passes done
+     */
+    int calibrationProgress() const;
+    /**
+     * @brief excludeOutliers Recalibrate without views whose reprojection error stands out, on by default
+     */
+    bool excludeOutliers() const;
+    void setExcludeOutliers(bool exclude);
+    /**
+     * @brief rms Reprojection error of the last calibration over the views it used, px
+     */
+    float rms() const;
+    /**
+     * @brief viewErrors Reprojection error of each picture in the last calibration, px, negative for excluded outliers
+     */
+    Q_INVOKABLE QVariantList viewErrors() const;
+
 signals:
+    void busyChanged();
+    void progressChanged();
+    void picturesCountChanged();
+    void calibratingChanged();
+    void calibrationProgressChanged();
+    /**
+     * @brief calibrated Calibration finished, intrinsics are ready for applyCalibrationData()
+     */
+    void calibrated();
 
 public slots:
     void takePicture();
@@ -33,16 +82,73 @@ public slots:
     void saveCalibrationData(const QString &filename);
     void loadCalibrationData(const QString &filename);
 
+private slots:
+    void onPicturesLoaded();
+    void onPictureProcessed();
+    void onCalibrationFinished();
+    void setCalibrationProgress(int percent);
+
 private:
-    void findChessboard(const cv::Mat &frame);
+    static const char *CornerCacheFile; ///< Next to the pictures, corners by picture hash for the board it was written for
+    enum { CoarseSize = 800 }; ///< Longest side of the pyramid level the board is searched on, px
 
     struct picture_t {
+        picture_t() : cached(false) {}
         cv::Mat picture;
-        std::vector<cv::Point2f> corners;
+        std::vector<cv::Point2f> corners; ///< Empty if board was not found
+        QByteArray encoded;               ///< JPEG as stored on disk, saved as is
+        QByteArray hash;                  ///< SHA-1 of encoded, key of the corner cache
+        bool cached;                      ///< Corners came from the cache
+    };
+    typedef QHash<QByteArray, std::vector<cv::Point2f>> corner_cache_t;
+    static corner_cache_t readCornerCache(const QString &fileName, const cv::Size &boardSize);
+    static void writeCornerCache(const QString &fileName, const cv::Size &boardSize, const QList<picture_t> &pictures);
+    /**
+     * @brief processTakenPicture Searches a captured frame and encodes it once if the board was found
+     */
+    static picture_t processTakenPicture(const cv::Mat &frame, const cv::Size &boardSize);
+    /**
+     * @brief findChessboard Thread safe, runs on QThreadPool workers
+     */
+    static picture_t findChessboard(const cv::Mat &frame, const cv::Size &boardSize);
+    /**
+     * @brief The LoadPicture struct reads and searches one picture file, functor for QtConcurrent::mapped()
+     */
+    struct LoadPicture {
+        typedef picture_t result_type;
+        cv::Size boardSize;
+        corner_cache_t cache; ///< Search is skipped for pictures found here
+        picture_t operator()(const QString &fileName) const;
     };
+    cv::Size boardSize() const;
+    void addPicture(const picture_t &picture);
+
+    struct calibration_t {
+        bool ok;
+        cv::Mat intrinsic;
+        cv::Mat distCoeffs;
+        double rms;
+        std::vector<double> viewErrors; ///< Per view, from the pass that included the view
+        std::vector<int> excluded;      ///< Outlier view indices
+    };
+    /**
+     * @brief runCalibration Thread safe, reports progress to receiver with queued calls
+     */
+    static calibration_t runCalibration(const std::vector<std::vector<cv::Point2f>> &views, const cv::Size &imageSize,
+                                        const cv::Size &boardSize, bool excludeOutliers, CameraCalibrator *receiver);
+
     QList<picture_t> m_pictures;
+    QFutureWatcher<picture_t> m_loadWatcher;
+    QFutureWatcher<picture_t> m_pictureWatcher;
+    QString m_loadFolder;
+    cv::Size m_loadBoardSize;    ///< Board searched by running jobs, their results are dropped if it was changed meanwhile
+    cv::Size m_pictureBoardSize;
+    QFutureWatcher<calibration_t> m_calibrationWatcher;
+    int m_calibrationProgress;
+    bool m_excludeOutliers;
+    calibration_t m_calibration;
     bool m_takePicture;
-    CaptureController *m_captureController;
+    CaptureStream *m_captureStream;
 
     quint32 m_horizontalCornersCount;
     quint32 m_verticalCornersCount;
@@ -1,171 +1,104 @@
 #include "capturecontroller.hpp"
 
-#include <QReadWriteLock>
 #include <QDebug>
 
-#include <opencv2/opencv.hpp>
+const QString CaptureController::mainStream = QStringLiteral("main");
 
-//remove
-#include "cvmatsurfacesource.hpp"
-#include <QTime>
-
-CaptureWorker::CaptureWorker(const QString &device, CaptureController *captureController, QObject *parent) :
-    QObject(parent), m_device(device), m_captureController(captureController), m_loopRunning(true), m_useUndistort(false)
+CaptureController::CaptureController(QObject *parent) :
+    QObject(parent), m_syncTolerance(0), m_lastSyncedTimestamp(0)
 {
+    addStream(mainStream);
 }
 
-void CaptureWorker::stop()
+CaptureController::~CaptureController()
 {
-    m_loopRunning = false;
+    stopAll();
 }
 
-void CaptureWorker::doWork()
+CaptureStream *CaptureController::addStream(const QString &name)
 {
-    bool ok = false;
-    int deviceId = m_device.toInt(&ok);
-    if (ok) {
-        m_capture = new cv::VideoCapture(deviceId);
-    } else {
-        m_capture = new cv::VideoCapture("http://192.168.88.235:8080/?action=stream");
-    }
-    if (!m_capture->isOpened()) {
-        qWarning() << "Can't capture" << m_device;
-        m_captureController->setStatus(CaptureController::Status::Failed);
-        emit workDone();
-        return;
-    }
-    bool isVideoFile = static_cast<int>(m_capture->get(cv::CAP_PROP_FRAME_COUNT)) > 0;
-    unsigned long sleepBetweenFrames = 0;
-    if (isVideoFile)
-        sleepBetweenFrames = static_cast<unsigned long>((1.0 / m_capture->get(cv::CAP_PROP_FPS)) * 1000000);
-    m_captureController->setStatus(CaptureController::Status::Started);
-    while(m_loopRunning) {
-        if (!m_capture->grab()) {
-            m_captureController->setStatus(CaptureController::Status::EofOrDisconnected);
-            break;
-        }
-        m_captureController->m_lock->lockForWrite();
-        m_capture->retrieve(m_frame);
-        if (m_frame.empty()) { // last frame of video
-            m_captureController->setStatus(CaptureController::Status::EofOrDisconnected);
-            break;
-        }
-
-        QReadLocker lock(m_captureController->m_undistortLock);
-        if (m_useUndistort) {
-            cv::Mat undistorted(m_frame.rows, m_frame.cols, m_frame.type());
-            cv::undistort(m_frame, undistorted, m_intrinsic, m_distCoeffs);
-            m_frame = undistorted;
-        }
-        lock.unlock();
-
-        m_captureController->m_lock->unlock();
-
-        emit frameReady();
-        CVMatSurfaceSource::imshow("main", m_frame);
-
-
-        //qDebug() << "imshow" << m_frame.cols << m_frame.rows << m_frame.size;
-
-        //qDebug() << QTime::currentTime();
-
-        if(isVideoFile)
-            QThread::usleep(sleepBetweenFrames);
-    }
-    delete m_capture;
-    emit workDone();
+    CaptureStream *stream = m_streams.value(name, nullptr);
+    if (stream)
+        return stream;
+    stream = new CaptureStream(name, this);
+    m_streams.insert(name, stream);
+    connect(stream, &CaptureStream::frameReady, this, [this, stream]() { onStreamFrameReady(stream); });
+    emit streamsChanged();
+    return stream;
 }
 
-CaptureController::CaptureController(QObject *parent) :
-    QObject(parent), m_worker(nullptr), m_lock(nullptr), m_status(Status::Stopped)
+CaptureStream *CaptureController::stream(const QString &name) const
 {
-    m_undistortLock = new QReadWriteLock;
+    return m_streams.value(name, nullptr);
 }
 
-CaptureController::~CaptureController()
+QStringList CaptureController::streamNames() const
 {
-    stop();
+    return m_streams.keys();
 }
 
-const cv::Mat CaptureController::frameRef() const
+void CaptureController::setSync(const QStringList &names, qint64 toleranceNs)
 {
-    if (!m_worker)
-        return cv::Mat();
-    QReadLocker lock(m_lock);
-    return m_worker->m_frame;
+    m_syncStreams = names;
+    m_syncTolerance = toleranceNs;
+    m_lastSyncedTimestamp = 0;
+    for (CaptureStream *stream : m_streams)
+        stream->setHistoryDepth(0);
+    // A few frames are enough to pair cameras whose frames arrive out of order by up to that many periods
+    for (const QString &name : names)
+        addStream(name)->setHistoryDepth(4);
 }
 
-cv::Mat CaptureController::frameCopy() const
+cv::Mat CaptureController::syncedFrame(const QString &name, qint64 timestamp) const
 {
-    if (!m_worker)
+    CaptureStream *stream = m_streams.value(name, nullptr);
+    if (!stream)
         return cv::Mat();
-    QReadLocker lock(m_lock);
-    cv::Mat frame;
-    m_worker->m_frame.copyTo(frame);
-    return frame;
+    return stream->frameNear(timestamp);
 }
 
-CaptureController::Status CaptureController::status() const
+void CaptureController::start(const QString &name, const QString &source)
 {
-    return m_status;
+    addStream(name)->start(source);
 }
 
-void CaptureController::enableUndistort(const cv::Mat &intrinsic, const cv::Mat &distCoeffs)
+void CaptureController::start(const QString &source)
 {
-    if (m_status != Status::Started) {
-        qWarning() << "Can't enable undistort before capture is started";
-        return;
-    }
-    QWriteLocker lock(m_undistortLock);
-    m_worker->m_intrinsic = intrinsic;
-    m_worker->m_distCoeffs = distCoeffs;
-    m_worker->m_useUndistort = true;
+    start(mainStream, source);
 }
 
-void CaptureController::start(const QString &device)
+void CaptureController::stop(const QString &name)
 {
-    if (m_status == Status::Started)
-        stop();
-    else if (m_status == Status::Starting) {
-        qWarning() << "start() called while capture was in Starting mode, ignoring";
-        return;
-    }
-    setStatus(Status::Starting);
-    m_lock = new QReadWriteLock;
-    m_worker = new CaptureWorker(device, this, nullptr);
-    m_worker->moveToThread(&m_workerThread);
-    connect(&m_workerThread, &QThread::started, m_worker, &CaptureWorker::doWork);
-//    connect(&m_workerThread, &QThread::finished, this, &CaptureController::stop);
-    connect(m_worker, &CaptureWorker::frameReady, this, &CaptureController::frameReady);
-    connect(m_worker, &CaptureWorker::workDone, this, &CaptureController::stop);
-    m_workerThread.start();
+    CaptureStream *stream = m_streams.value(name, nullptr);
+    if (stream)
+        stream->stop();
 }
 
-void CaptureController::stop()
+void CaptureController::stopAll()
 {
-    if (m_status == Status::Stopped)
-        return;
-    qDebug() << "Capture is stopping from" << m_status << "state ...";
-
-    disconnect(m_worker, &CaptureWorker::frameReady, this, &CaptureController::frameReady);
-    m_worker->stop();
-    m_workerThread.quit();
-    if(!m_workerThread.wait(1000)) {
-        qWarning() << "Capture thread did not terminate until timeout, trying terminate()";
-        m_workerThread.terminate();
-    }
-    delete m_worker;
-    m_worker = nullptr;
-    delete m_lock;
-    m_lock = nullptr;
-    setStatus(Status::Stopped);
+    for (CaptureStream *stream : m_streams)
+        stream->stop();
 }
 
-void CaptureController::setStatus(CaptureController::Status status)
+void CaptureController::onStreamFrameReady(CaptureStream *stream)
 {
-    if (status == m_status)
+    emit frameReady(stream->name());
+    if (m_syncStreams.size() < 2 || !m_syncStreams.contains(stream->name()))
         return;
-    m_status = status;
-    emit statusChanged();
+    // Frame that just arrived is the newest one of a set, the others are matched to it
+    qint64 newest = stream->frameTimestamp();
+    qint64 oldest = newest;
+    for (const QString &name : m_syncStreams) {
+        CaptureStream *other = m_streams.value(name, nullptr);
+        if (other == stream)
+            continue;
+        qint64 timestamp = 0;
+        if (!other || other->frameNear(newest, &timestamp).empty() || qAbs(timestamp - newest) > m_syncTolerance)
+            return;
+        oldest = qMin(oldest, timestamp);
+    }
+    if (oldest <= m_lastSyncedTimestamp)
+        return;
+    m_lastSyncedTimestamp = newest;
+    emit framesSynchronized(newest);
 }
-
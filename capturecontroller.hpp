@@ -2,87 +2,85 @@
 #define CAPTURECONTROLLER_HPP
 
 #include <QObject>
-#include <QThread>
-#include <opencv2/core.hpp>
+#include <QMap>
+#include <QStringList>
 
-namespace cv {
-class VideoCapture;
-}
-
-class QReadWriteLock;
-class CaptureController;
-class CaptureWorker : public QObject
-{
-    Q_OBJECT
-public:
-    explicit CaptureWorker(const QString &device, CaptureController *captureController, QObject *parent = nullptr);
-
-    /**
-     * @brief stop Stops capture and exits doWork() loop
-     */
-    void stop();
-signals:
-    void frameReady();
-    void workDone();
-
-public slots:
-    void doWork();
-
-private:
-    friend class CaptureController;
-    QString m_device;
-    cv::VideoCapture *m_capture;
-    CaptureController *m_captureController;
-    cv::Mat m_frame;
-    bool m_loopRunning;
-    bool m_useUndistort;
-    cv::Mat m_intrinsic;
-    cv::Mat m_distCoeffs;
-};
+#include "capturestream.hpp"
 
+/**
+ * @brief The CaptureController class owns named capture streams, e.g. the laser line camera and a wide field one.
+ * Each stream runs its own worker thread and keeps its own calibration and frame buffer.
+ */
 class CaptureController : public QObject
 {
     Q_OBJECT
-    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_PROPERTY(QStringList streams READ streamNames NOTIFY streamsChanged)
 public:
     explicit CaptureController(QObject *parent = nullptr);
     ~CaptureController();
 
-    const cv::Mat frameRef() const;
-    cv::Mat frameCopy() const;
+    /**
+     * @brief mainStream Name of the laser line camera, used when no stream is specified
+     */
+    static const QString mainStream;
 
     /**
-     * @brief The Status enum
+     * @brief addStream Creates stream name or returns the existing one
      */
-    enum class Status {
-        Starting,          ///< Capture is in startup
-        Started,           ///< Capture successfully started and frameReady() signals is emitting
-        Stopped,           ///< Initial state or after @see stop() was called
-        EofOrDisconnected, ///< Video file ended or camera was disconnected
-        Failed             ///< After Starting if it wasn't successful
-    };
-    Q_ENUM(Status)
-    Status status() const;
+    CaptureStream *addStream(const QString &name);
+    /**
+     * @brief stream Returns stream name or nullptr
+     */
+    Q_INVOKABLE CaptureStream *stream(const QString &name) const;
+    QStringList streamNames() const;
+
+    /**
+     * @brief subscribe Connects frameReady() of stream name to receiver's slot, the stream is created if needed
+     */
+    template<typename Func>
+    QMetaObject::Connection subscribe(const QString &name,
+                                      const typename QtPrivate::FunctionPointer<Func>::Object *receiver, Func slot)
+    {
+        return connect(addStream(name), &CaptureStream::frameReady, receiver, slot);
+    }
 
-    void enableUndistort(const cv::Mat &intrinsic, const cv::Mat &distCoeffs);
+    /**
+     * @brief setSync Soft-synchronizes streams by timestamp, framesSynchronized() is emitted once every one of them
+     * has a frame within tolerance of the others, empty list disables it
+     */
+    void setSync(const QStringList &names, qint64 toleranceNs);
+    /**
+     * @brief syncedFrame Frame of stream name closest to timestamp of framesSynchronized()
+     */
+    cv::Mat syncedFrame(const QString &name, qint64 timestamp) const;
 
 public slots:
-    void start(const QString &device);
-    void stop();
+    /**
+     * @brief start Starts stream name from a source description, see CaptureSource for the syntax
+     */
+    void start(const QString &name, const QString &source);
+    /**
+     * @brief start Starts main stream
+     */
+    void start(const QString &source);
+    void stop(const QString &name);
+    void stopAll();
+
 signals:
-    void statusChanged();
-    void frameReady();
-    //void statisticsReady(QVariant ?
+    void streamsChanged();
+    void frameReady(const QString &name);
+    /**
+     * @brief framesSynchronized Synchronized streams have frames around timestamp, fetch them with syncedFrame()
+     */
+    void framesSynchronized(qint64 timestamp);
 
 private:
-    friend class CaptureWorker;
-    CaptureWorker* m_worker;
-    QThread m_workerThread;
-    mutable QReadWriteLock* m_lock;
-    mutable QReadWriteLock* m_undistortLock;
+    void onStreamFrameReady(CaptureStream *stream);
 
-    void setStatus(Status status);
-    Status m_status;
+    QMap<QString, CaptureStream *> m_streams;
+    QStringList m_syncStreams;
+    qint64 m_syncTolerance;
+    qint64 m_lastSyncedTimestamp; ///< Newest frame of the last synchronized set, so no frame is reported twice
 };
 
 #endif // CAPTURECONTROLLER_HPP
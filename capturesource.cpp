@@ -0,0 +1,140 @@
+#include "capturesource.h"
+
+#include <QFileInfo>
+#include <QUrl>
+#include <QUrlQuery>
+
+namespace {
+
+/**
+ * @brief takeOptions Moves capture options from query to source, other query items are left in place
+ */
+void takeOptions(QUrlQuery &query, CaptureSource &source)
+{
+    if (query.hasQueryItem("width")) {
+        source.width = query.queryItemValue("width").toInt();
+        query.removeAllQueryItems("width");
+    }
+    if (query.hasQueryItem("height")) {
+        source.height = query.queryItemValue("height").toInt();
+        query.removeAllQueryItems("height");
+    }
+    if (query.hasQueryItem("fps")) {
+        source.fps = query.queryItemValue("fps").toDouble();
+        query.removeAllQueryItems("fps");
+    }
+    if (query.hasQueryItem("buffer")) {
+        source.bufferSize = query.queryItemValue("buffer").toInt();
+        query.removeAllQueryItems("buffer");
+    }
+    if (query.hasQueryItem("format")) {
+        source.format = query.queryItemValue("format").toLower();
+        query.removeAllQueryItems("format");
+    }
+}
+
+} // namespace
+
+CaptureSource::CaptureSource() :
+    kind(Invalid), index(-1), width(0), height(0), fps(0), bufferSize(-1)
+{
+}
+
+CaptureSource CaptureSource::parse(const QString &description)
+{
+    CaptureSource source;
+    QString d = description.trimmed();
+    if (d.isEmpty())
+        return source;
+
+    if (d.startsWith("gst:")) {
+        source.kind = GStreamer;
+        source.location = d.mid(4).trimmed();
+        source.bufferSize = 1;
+        return source;
+    }
+
+    if (d.contains("://")) {
+        QUrl url(d);
+        if (!url.isValid())
+            return source;
+        QUrlQuery query(url);
+        takeOptions(query, source);
+        url.setQuery(query.isEmpty() ? QString() : query.query(QUrl::FullyEncoded), QUrl::StrictMode);
+        source.kind = Url;
+        source.location = url.toString(QUrl::FullyEncoded);
+        // Stale frames in network buffers add latency to every measurement
+        if (source.bufferSize < 0)
+            source.bufferSize = 1;
+        return source;
+    }
+
+    if (d.startsWith("synth:")) {
+        // Rendering parameters share the query with capture options, the ? is optional
+        QString parameters = d.mid(6);
+        if (parameters.startsWith('?'))
+            parameters.remove(0, 1);
+        QUrlQuery query(parameters);
+        takeOptions(query, source);
+        source.kind = Synthetic;
+        source.location = query.query(QUrl::FullyDecoded);
+        return source;
+    }
+
+    int q = d.indexOf('?');
+    QString location = d.left(q);
+    QUrlQuery query(q < 0 ? QString() : d.mid(q + 1));
+    takeOptions(query, source);
+
+    if (location.startsWith("v4l2:")) {
+        source.kind = V4l2;
+        source.location = location.mid(5);
+    } else if (location.startsWith("dir:")) {
+        source.kind = ImageDirectory;
+        source.location = location.mid(4);
+    } else if (location.startsWith("framelog:")) {
+        source.kind = FrameLog;
+        source.location = location.mid(9);
+    } else if (location.startsWith("file:")) {
+        source.kind = File;
+        source.location = location.mid(5);
+    } else {
+        bool ok = false;
+        int index = location.toInt(&ok);
+        if (ok) {
+            source.kind = Device;
+            source.index = index;
+            source.location = location;
+            if (source.bufferSize < 0)
+                source.bufferSize = 1;
+        } else {
+            QFileInfo info(location);
+            if (info.isDir())
+                source.kind = ImageDirectory;
+            else
+                source.kind = info.suffix() == "cvframes" ? FrameLog : File;
+            source.location = location;
+        }
+    }
+    return source;
+}
+
+bool CaptureSource::isLive() const
+{
+    return kind == Device || kind == Url || kind == GStreamer || kind == V4l2;
+}
+
+QString CaptureSource::toString() const
+{
+    static const char *names[] = {"invalid", "device", "file", "dir", "url", "gst", "v4l2", "synth", "framelog"};
+    QString s = QString("%1 %2").arg(names[kind]).arg(location);
+    if (width > 0 && height > 0)
+        s += QString(" %1x%2").arg(width).arg(height);
+    if (fps > 0)
+        s += QString(" %1 fps").arg(fps);
+    if (bufferSize >= 0)
+        s += QString(" buffer %1").arg(bufferSize);
+    if (!format.isEmpty())
+        s += " " + format;
+    return s;
+}
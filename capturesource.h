@@ -0,0 +1,47 @@
+#ifndef CAPTURESOURCE_H
+#define CAPTURESOURCE_H
+
+#include <QString>
+
+/**
+ * @brief The CaptureSource struct describes where frames come from and what is requested from the source.
+ * Description syntax is location followed by optional ?width=..&height=..&fps=..&buffer=..&format=.. :
+ *   0                                  camera index
+ *   /path/video.avi, file:/path        video file
+ *   /path/dir, dir:/path               directory of images, played in name order
+ *   http://host/?action=stream         network stream, own query items are kept in the URL
+ *   gst:v4l2src ! ... ! appsink        GStreamer pipeline, taken as is without options
+ *   v4l2:/dev/video0                   V4L2 mmap backend, see V4l2Capture
+ *   synth:rotation=2&dz=0.5            rendered laser line, see SyntheticLineCapture::Parameters
+ *   /path/run.cvframes, framelog:/path frame log written by FrameRecorder, see FrameLogCapture
+ */
+struct CaptureSource
+{
+    enum Kind {
+        Invalid,
+        Device,
+        File,
+        ImageDirectory,
+        Url,
+        GStreamer,
+        V4l2,
+        Synthetic,
+        FrameLog
+    };
+
+    CaptureSource();
+    static CaptureSource parse(const QString &description);
+    bool isLive() const;
+    QString toString() const;
+
+    Kind kind;
+    QString location;  ///< Path, URL or pipeline, without capture options, for Synthetic the rendering parameters
+    int index;         ///< Camera index for Device
+    int width;         ///< Requested frame size, 0 keeps source default
+    int height;
+    double fps;        ///< Requested frame rate, for files and image directories it is the playback rate
+    int bufferSize;    ///< Frames buffered by the backend, -1 keeps backend default
+    QString format;    ///< Requested pixel format, e.g. yuyv or mjpeg
+};
+
+#endif // CAPTURESOURCE_H
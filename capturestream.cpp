@@ -0,0 +1,674 @@
+#include "capturestream.hpp"
+
+#include <QReadWriteLock>
+#include <QDebug>
+
+#include "monotonicclock.h"
+#include "sessionrecorder.h"
+#include "framerecorder.h"
+#include "v4l2capture.h"
+#include "imagedirectorycapture.h"
+#include "syntheticlinecapture.h"
+#include "framelogcapture.h"
+#include "framepool.h"
+
+#include <opencv2/opencv.hpp>
+
+//remove
+#include "cvmatsurfacesource.hpp"
+#include <QTime>
+
+CaptureWorker::CaptureWorker(const CaptureSource &source, CaptureStream *captureStream, QObject *parent) :
+    QObject(parent), m_source(source), m_captureStream(captureStream), m_previewSurface(captureStream->m_previewSurface),
+    m_frameTimestamp(0), m_loopRunning(true), m_useUndistort(false),
+    m_undistortGeneration(0), m_mapsGeneration(-1), m_pacing(static_cast<int>(captureStream->m_pacing)),
+    m_frameIndex(0), m_publishedIndex(0), m_frameConverted(true),
+    m_retrieved(2), m_processor(nullptr)
+{
+}
+
+CaptureWorker::~CaptureWorker()
+{
+    stopProcessor();
+}
+
+void CaptureWorker::stop()
+{
+    m_requestMutex.lock();
+    m_loopRunning = false;
+    m_requestAdded.wakeAll();
+    m_requestMutex.unlock();
+}
+
+void CaptureWorker::stopProcessor()
+{
+    m_retrieved.close();
+    m_processThread.quit();
+    m_processThread.wait();
+}
+
+bool CaptureWorker::waitForRequest(frame_request_t &request)
+{
+    QMutexLocker lock(&m_requestMutex);
+    while (m_requests.isEmpty() && m_loopRunning)
+        m_requestAdded.wait(&m_requestMutex);
+    if (!m_loopRunning)
+        return false;
+    request = m_requests.dequeue();
+    return true;
+}
+
+void CaptureWorker::doWork()
+{
+    if (m_source.kind == CaptureSource::V4l2)
+        runV4l2();
+    else
+        runVideoCapture();
+    emit workDone();
+}
+
+void CaptureWorker::runVideoCapture()
+{
+    switch (m_source.kind) {
+    case CaptureSource::Device:
+        m_capture = new cv::VideoCapture(m_source.index);
+        break;
+    case CaptureSource::ImageDirectory:
+        m_capture = new ImageDirectoryCapture(m_source.location, m_source.fps);
+        break;
+    case CaptureSource::GStreamer:
+        m_capture = new cv::VideoCapture(m_source.location.toStdString(), cv::CAP_GSTREAMER);
+        break;
+    case CaptureSource::Synthetic:
+        m_capture = new SyntheticLineCapture(SyntheticLineCapture::Parameters::parse(m_source.location),
+                                             m_source.width, m_source.height, m_source.fps);
+        break;
+    case CaptureSource::FrameLog:
+        m_capture = new FrameLogCapture(m_source.location);
+        break;
+    case CaptureSource::Url:
+        // FFmpeg buffers network streams by default, which delays every frame
+        if (m_source.bufferSize >= 0 && m_source.bufferSize <= 1 && qEnvironmentVariableIsEmpty("OPENCV_FFMPEG_CAPTURE_OPTIONS"))
+            qputenv("OPENCV_FFMPEG_CAPTURE_OPTIONS", "fflags;nobuffer|flags;low_delay");
+        m_capture = new cv::VideoCapture(m_source.location.toStdString());
+        break;
+    default:
+        m_capture = new cv::VideoCapture(m_source.location.toStdString());
+        break;
+    }
+    if (!m_capture->isOpened()) {
+        qWarning() << "Can't capture" << m_source.toString();
+        m_captureStream->setStatus(CaptureStream::Status::Failed);
+        delete m_capture;
+        return;
+    }
+    if (m_source.isLive())
+        applySourceProperties();
+    bool isVideoFile = m_source.kind == CaptureSource::Synthetic ||
+                       (!m_source.isLive() && static_cast<int>(m_capture->get(cv::CAP_PROP_FRAME_COUNT)) > 0);
+    CaptureStream::FramePacing pacing = isVideoFile ? static_cast<CaptureStream::FramePacing>(m_pacing)
+                                                        : CaptureStream::FramePacing::Unpaced;
+    unsigned long sleepBetweenFrames = 0;
+    if (pacing == CaptureStream::FramePacing::SourceRate) {
+        double fps = m_source.fps > 0 ? m_source.fps : m_capture->get(cv::CAP_PROP_FPS);
+        if (fps > 0)
+            sleepBetweenFrames = static_cast<unsigned long>((1.0 / fps) * 1000000);
+    }
+    // Grab and retrieve of frame N+1 overlap with undistort and publish of frame N.
+    // Pool reuses retrieve buffers once the processor dropped them.
+    FramePool retrievePool(4);
+    m_processor = new CaptureProcessor(this, &m_retrieved);
+    m_processor->moveToThread(&m_processThread);
+    connect(&m_processThread, &QThread::started, m_processor, &CaptureProcessor::doWork);
+    connect(&m_processThread, &QThread::finished, m_processor, &QObject::deleteLater);
+    m_processThread.start();
+    // A live camera must never wait for the processor, otherwise frames pile up in the driver and get stale
+    bool dropWhenBusy = m_source.isLive();
+    int dropped = 0;
+    bool eof = false;
+    cv::Size frameSize;
+    int frameType = CV_8UC3;
+    m_captureStream->setStatus(CaptureStream::Status::Started);
+    while(m_loopRunning) {
+        frame_request_t request = {0, 0};
+        if (pacing == CaptureStream::FramePacing::External) {
+            if (!waitForRequest(request))
+                break;
+            // Frames that were not recorded are skipped to keep video and session log aligned
+            bool skipped = true;
+            while (m_frameIndex < request.frameIndex && skipped) {
+                skipped = m_capture->grab();
+                m_frameIndex++;
+            }
+        }
+        if (!m_capture->grab()) {
+            eof = true;
+            break;
+        }
+        captured_frame_t captured;
+        captured.timestamp = pacing == CaptureStream::FramePacing::External ? request.timestamp : monotonicNs();
+        applyControls();
+        captured.frame = retrievePool.acquire(frameSize, frameType);
+        m_capture->retrieve(captured.frame);
+        if (captured.frame.empty()) { // last frame of video
+            eof = true;
+            break;
+        }
+        frameSize = captured.frame.size();
+        frameType = captured.frame.type();
+        captured.frameIndex = m_frameIndex++;
+        if (dropWhenBusy)
+            dropped += m_retrieved.pushDropOldest(captured) ? 1 : 0;
+        else if (!m_retrieved.push(captured))
+            break; // closed by stop()
+
+        if (sleepBetweenFrames)
+            QThread::usleep(sleepBetweenFrames);
+    }
+    stopProcessor();
+    m_processor = nullptr;
+    if (dropped)
+        qDebug() << "Capture dropped" << dropped << "frames while processing was busy";
+    // Set after the processor drained the queue, so every grabbed frame was published before EOF is reported
+    if (eof)
+        m_captureStream->setStatus(CaptureStream::Status::EofOrDisconnected);
+    delete m_capture;
+}
+
+void CaptureWorker::processFrames(BoundedQueue<captured_frame_t> &retrieved)
+{
+    FramePool undistortPool(4);
+    captured_frame_t captured;
+    while (retrieved.pop(captured)) {
+        cv::Mat frame = captured.frame;
+        cv::Mat map1, map2;
+        if (undistortMaps(frame.size(), map1, map2)) {
+            frame = undistortPool.acquire(captured.frame.size(), captured.frame.type());
+            cv::remap(captured.frame, frame, map1, map2, cv::INTER_LINEAR);
+        }
+        captured.frame.release(); // hand retrieve buffer back to the pool
+
+        m_captureStream->m_lock->lockForWrite();
+        m_frameTimestamp = captured.timestamp;
+        m_publishedIndex = captured.frameIndex;
+        m_frame = frame;
+        m_captureStream->m_lock->unlock();
+
+        m_captureStream->rememberFrame(captured.timestamp, frame);
+        publishFrame(captured.timestamp, captured.frameIndex, frame);
+        if (!m_previewSurface.isEmpty())
+            CVMatSurfaceSource::imshow(m_previewSurface, frame);
+    }
+}
+
+void CaptureWorker::runV4l2()
+{
+    QString path = m_source.location;
+    V4l2Capture::format_t requested;
+    requested.width = m_source.width > 0 ? m_source.width : 640;
+    requested.height = m_source.height > 0 ? m_source.height : 480;
+    requested.fps = m_source.fps > 0 ? static_cast<int>(m_source.fps) : 30;
+    requested.pixelFormat = m_source.format == "mjpeg" ? V4l2Capture::MJPEG : V4l2Capture::YUYV;
+
+    V4l2Capture capture;
+    if (!capture.open(path, requested)) {
+        qWarning() << "Can't capture" << path << capture.errorString();
+        m_captureStream->setStatus(CaptureStream::Status::Failed);
+        return;
+    }
+    const V4l2Capture::format_t &format = capture.format();
+    int heldBuffer = -1;
+    qint64 previewDue = 0;
+    m_captureStream->setStatus(CaptureStream::Status::Started);
+    while (m_loopRunning) {
+        applyControls(capture);
+        V4l2Capture::frame_t frame;
+        if (!capture.dequeue(frame, 100)) {
+            if (capture.errorString().isEmpty())
+                continue; // timeout
+            qWarning() << "V4L2 capture failed" << capture.errorString();
+            m_captureStream->setStatus(CaptureStream::Status::EofOrDisconnected);
+            break;
+        }
+        uchar *data = const_cast<uchar *>(frame.data);
+        int previousBuffer = heldBuffer;
+        bool decoded = true;
+        m_captureStream->m_lock->lockForWrite();
+        m_frameTimestamp = frame.timestamp;
+        m_publishedIndex = m_frameIndex;
+        if (format.pixelFormat == V4l2Capture::YUYV) {
+            // Frame stays in the driver buffer until the next one arrives, conversion to BGR is deferred
+            m_native = cv::Mat(format.height, format.width, CV_8UC2, data, static_cast<size_t>(capture.bytesPerLine()));
+            m_frameConverted = false;
+            heldBuffer = frame.index;
+        } else {
+            cv::Mat encoded(1, static_cast<int>(frame.bytesUsed), CV_8UC1, data);
+            releaseSharedFrame();
+            cv::imdecode(encoded, cv::IMREAD_COLOR, &m_frame);
+            decoded = !m_frame.empty();
+            m_native = cv::Mat();
+            m_frameConverted = true;
+            undistortLocked();
+            previousBuffer = frame.index;
+            heldBuffer = -1;
+        }
+        m_captureStream->m_lock->unlock();
+        if (previousBuffer >= 0)
+            capture.requeue(previousBuffer);
+        if (!decoded) {
+            qWarning() << "Can't decode MJPEG frame";
+            continue;
+        }
+
+        if (m_captureStream->m_historyDepth > 0) {
+            // Kept frames outlive the driver buffer, so synchronized streams give up lazy conversion
+            m_captureStream->m_lock->lockForWrite();
+            convertNativeLocked();
+            cv::Mat converted = m_frame;
+            m_captureStream->m_lock->unlock();
+            m_captureStream->rememberFrame(frame.timestamp, converted);
+        }
+        publishFrame(frame.timestamp, m_frameIndex++, m_native.empty() ? m_frame : m_native);
+
+        // Preview is converted at display rate only, detector converts its ROI straight from the native frame
+        qint64 now = monotonicNs();
+        if (!m_previewSurface.isEmpty() && now >= previewDue) {
+            previewDue = now + 33000000;
+            m_captureStream->m_lock->lockForWrite();
+            convertNativeLocked();
+            cv::Mat preview = m_frame;
+            m_captureStream->m_lock->unlock();
+            CVMatSurfaceSource::imshow(m_previewSurface, preview);
+        }
+    }
+    m_captureStream->m_lock->lockForWrite();
+    if (!m_frameConverted)
+        convertNativeLocked();
+    m_native = cv::Mat();
+    m_captureStream->m_lock->unlock();
+    if (heldBuffer >= 0)
+        capture.requeue(heldBuffer);
+}
+
+void CaptureWorker::applyControls(V4l2Capture &capture)
+{
+    CaptureStream *c = m_captureStream;
+    if (c->m_exposureChanged.exchange(false) && !capture.setControl(V4l2Capture::Exposure, c->m_exposure))
+        qWarning() << "Can't set exposure" << capture.errorString();
+    if (c->m_gainChanged.exchange(false) && !capture.setControl(V4l2Capture::Gain, c->m_gain))
+        qWarning() << "Can't set gain" << capture.errorString();
+}
+
+void CaptureWorker::applySourceProperties()
+{
+    if (m_source.width > 0 && m_source.height > 0) {
+        m_capture->set(cv::CAP_PROP_FRAME_WIDTH, m_source.width);
+        m_capture->set(cv::CAP_PROP_FRAME_HEIGHT, m_source.height);
+    }
+    if (m_source.fps > 0)
+        m_capture->set(cv::CAP_PROP_FPS, m_source.fps);
+    if (m_source.format == "mjpeg")
+        m_capture->set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
+    else if (m_source.format == "yuyv")
+        m_capture->set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V'));
+    // Backends that don't support it return false, the FFmpeg options above cover network streams
+    if (m_source.bufferSize >= 0)
+        m_capture->set(cv::CAP_PROP_BUFFERSIZE, m_source.bufferSize);
+    qDebug() << "Capturing" << m_source.toString() << "got"
+             << m_capture->get(cv::CAP_PROP_FRAME_WIDTH) << "x" << m_capture->get(cv::CAP_PROP_FRAME_HEIGHT)
+             << m_capture->get(cv::CAP_PROP_FPS) << "fps, buffer" << m_capture->get(cv::CAP_PROP_BUFFERSIZE);
+}
+
+void CaptureWorker::applyControls()
+{
+    CaptureStream *c = m_captureStream;
+    if (c->m_exposureChanged.exchange(false)) {
+        int exposure = c->m_exposure;
+        m_capture->set(cv::CAP_PROP_AUTO_EXPOSURE, exposure < 0 ? 0.75 : 0.25);
+        if (exposure >= 0 && !m_capture->set(cv::CAP_PROP_EXPOSURE, exposure))
+            qWarning() << "Can't set exposure";
+    }
+    if (c->m_gainChanged.exchange(false) && !m_capture->set(cv::CAP_PROP_GAIN, c->m_gain))
+        qWarning() << "Can't set gain";
+}
+
+void CaptureWorker::undistortLocked()
+{
+    cv::Mat map1, map2;
+    if (undistortMaps(m_frame.size(), map1, map2)) {
+        cv::Mat undistorted;
+        cv::remap(m_frame, undistorted, map1, map2, cv::INTER_LINEAR);
+        m_frame = undistorted;
+    }
+}
+
+bool CaptureWorker::undistortMaps(const cv::Size &size, cv::Mat &map1, cv::Mat &map2)
+{
+    QReadLocker lock(m_captureStream->m_undistortLock);
+    if (!m_useUndistort)
+        return false;
+    QMutexLocker mapsLock(&m_mapsMutex);
+    if (m_mapsGeneration != m_undistortGeneration || m_mapsSize != size) {
+        // Same tables cv::undistort() builds internally on every call
+        cv::initUndistortRectifyMap(m_intrinsic, m_distCoeffs, cv::Mat(), m_intrinsic, size, CV_16SC2, m_map1, m_map2);
+        m_mapsSize = size;
+        m_mapsGeneration = m_undistortGeneration;
+    }
+    map1 = m_map1;
+    map2 = m_map2;
+    return true;
+}
+
+void CaptureWorker::releaseSharedFrame()
+{
+    // Consumers may still hold frameRef(), it must not be overwritten in place
+    if (m_frame.u && m_frame.u->refcount > 1)
+        m_frame.release();
+}
+
+void CaptureWorker::convertNativeLocked()
+{
+    if (m_frameConverted || m_native.empty())
+        return;
+    releaseSharedFrame();
+    cv::cvtColor(m_native, m_frame, cv::COLOR_YUV2BGR_YUYV);
+    undistortLocked();
+    m_frameConverted = true;
+}
+
+void CaptureWorker::publishFrame(qint64 timestamp, quint32 frameIndex, const cv::Mat &frame)
+{
+    SessionRecorder *recorder = m_captureStream->m_recorder;
+    if (recorder)
+        recorder->record(SESSION_FRAME_CAPTURED, &frameIndex, sizeof(frameIndex), timestamp);
+    m_captureStream->m_frameRecorder->push(frame, timestamp, frameIndex);
+    emit frameReady();
+}
+
+CaptureProcessor::CaptureProcessor(CaptureWorker *worker, BoundedQueue<CaptureWorker::captured_frame_t> *retrieved, QObject *parent) :
+    QObject(parent), m_worker(worker), m_retrieved(retrieved)
+{
+}
+
+void CaptureProcessor::doWork()
+{
+    m_worker->processFrames(*m_retrieved);
+}
+
+CaptureStream::CaptureStream(const QString &name, QObject *parent) :
+    QObject(parent), m_name(name), m_previewSurface(name), m_worker(nullptr), m_lock(nullptr), m_status(Status::Stopped),
+    m_pacing(FramePacing::SourceRate), m_recorder(nullptr),
+    m_exposure(-1), m_gain(0), m_exposureChanged(false), m_gainChanged(false),
+    m_historyDepth(0)
+{
+    m_undistortLock = new QReadWriteLock;
+    m_frameRecorder = new FrameRecorder(this);
+}
+
+CaptureStream::~CaptureStream()
+{
+    stop();
+}
+
+QString CaptureStream::name() const
+{
+    return m_name;
+}
+
+void CaptureStream::lockConvertedFrame() const
+{
+    m_lock->lockForRead();
+    if (m_worker->m_frameConverted)
+        return;
+    m_lock->unlock();
+    m_lock->lockForWrite();
+    m_worker->convertNativeLocked();
+}
+
+const cv::Mat CaptureStream::frameRef() const
+{
+    if (!m_worker)
+        return cv::Mat();
+    lockConvertedFrame();
+    cv::Mat frame = m_worker->m_frame;
+    m_lock->unlock();
+    return frame;
+}
+
+cv::Mat CaptureStream::frameCopy() const
+{
+    return frameCopy(nullptr);
+}
+
+cv::Mat CaptureStream::frameCopy(qint64 *timestamp) const
+{
+    if (timestamp)
+        *timestamp = 0;
+    if (!m_worker)
+        return cv::Mat();
+    lockConvertedFrame();
+    cv::Mat frame;
+    m_worker->m_frame.copyTo(frame);
+    if (timestamp)
+        *timestamp = m_worker->m_frameTimestamp;
+    m_lock->unlock();
+    return frame;
+}
+
+cv::Rect CaptureStream::frameRoi(const cv::Rect &roi, cv::Mat &out) const
+{
+    out.release();
+    if (!m_worker)
+        return cv::Rect();
+    QReadLocker lock(m_lock);
+    const cv::Mat &native = m_worker->m_native;
+    if (!m_worker->m_frameConverted && !native.empty()) {
+        QReadLocker undistortLock(m_undistortLock);
+        if (!m_worker->m_useUndistort) {
+            // YUYV macropixel holds two horizontally adjacent pixels, so ROI is widened to even columns
+            cv::Rect r = roi & cv::Rect(0, 0, native.cols, native.rows);
+            int x0 = r.x & ~1;
+            int x1 = qMin(native.cols, (r.x + r.width + 1) & ~1);
+            r.x = x0;
+            r.width = x1 - x0;
+            if (r.area() <= 0)
+                return cv::Rect();
+            cv::cvtColor(native(r), out, cv::COLOR_YUV2BGR_YUYV);
+            return r;
+        }
+    }
+    lock.unlock();
+    lockConvertedFrame();
+    const cv::Mat &frame = m_worker->m_frame;
+    cv::Rect r = roi & cv::Rect(0, 0, frame.cols, frame.rows);
+    if (r.area() > 0)
+        frame(r).copyTo(out);
+    m_lock->unlock();
+    return r;
+}
+
+cv::Size CaptureStream::frameSize() const
+{
+    if (!m_worker)
+        return cv::Size();
+    QReadLocker lock(m_lock);
+    return m_worker->m_native.empty() ? m_worker->m_frame.size() : m_worker->m_native.size();
+}
+
+qint64 CaptureStream::frameTimestamp() const
+{
+    if (!m_worker)
+        return 0;
+    QReadLocker lock(m_lock);
+    return m_worker->m_frameTimestamp;
+}
+
+quint32 CaptureStream::frameIndex() const
+{
+    if (!m_worker)
+        return 0;
+    QReadLocker lock(m_lock);
+    return m_worker->m_publishedIndex;
+}
+
+void CaptureStream::setHistoryDepth(int depth)
+{
+    QMutexLocker lock(&m_historyMutex);
+    m_historyDepth = qMax(0, depth);
+    while (m_history.size() > m_historyDepth)
+        m_history.dequeue();
+}
+
+cv::Mat CaptureStream::frameNear(qint64 timestamp, qint64 *frameTimestamp) const
+{
+    QMutexLocker lock(&m_historyMutex);
+    const timed_frame_t *nearest = nullptr;
+    for (const timed_frame_t &entry : m_history) {
+        if (!nearest || qAbs(entry.timestamp - timestamp) < qAbs(nearest->timestamp - timestamp))
+            nearest = &entry;
+    }
+    if (!nearest)
+        return cv::Mat();
+    if (frameTimestamp)
+        *frameTimestamp = nearest->timestamp;
+    return nearest->frame;
+}
+
+void CaptureStream::rememberFrame(qint64 timestamp, const cv::Mat &frame)
+{
+    QMutexLocker lock(&m_historyMutex);
+    if (m_historyDepth <= 0)
+        return;
+    timed_frame_t entry;
+    entry.timestamp = timestamp;
+    entry.frame = frame;
+    m_history.enqueue(entry);
+    while (m_history.size() > m_historyDepth)
+        m_history.dequeue();
+}
+
+CaptureStream::Status CaptureStream::status() const
+{
+    return m_status;
+}
+
+void CaptureStream::enableUndistort(const cv::Mat &intrinsic, const cv::Mat &distCoeffs)
+{
+    if (m_status != Status::Started) {
+        qWarning() << "Can't enable undistort before capture is started";
+        return;
+    }
+    QWriteLocker lock(m_undistortLock);
+    m_worker->m_intrinsic = intrinsic;
+    m_worker->m_distCoeffs = distCoeffs;
+    m_worker->m_useUndistort = true;
+    m_worker->m_undistortGeneration++;
+}
+
+void CaptureStream::setExposure(int exposure)
+{
+    m_exposure = exposure;
+    m_exposureChanged = true;
+}
+
+void CaptureStream::setGain(int gain)
+{
+    m_gain = gain;
+    m_gainChanged = true;
+}
+
+void CaptureStream::setFramePacing(FramePacing pacing)
+{
+    m_pacing = pacing;
+}
+
+CaptureStream::FramePacing CaptureStream::framePacing() const
+{
+    return m_pacing;
+}
+
+void CaptureStream::requestFrame(qint64 timestamp, quint32 frameIndex)
+{
+    if (!m_worker)
+        return;
+    CaptureWorker::frame_request_t request;
+    request.timestamp = timestamp;
+    request.frameIndex = frameIndex;
+    QMutexLocker lock(&m_worker->m_requestMutex);
+    m_worker->m_requests.enqueue(request);
+    m_worker->m_requestAdded.wakeOne();
+}
+
+void CaptureStream::setSessionRecorder(SessionRecorder *recorder)
+{
+    m_recorder = recorder;
+}
+
+FrameRecorder *CaptureStream::frameRecorder() const
+{
+    return m_frameRecorder;
+}
+
+void CaptureStream::setPreviewSurface(const QString &surfaceName)
+{
+    m_previewSurface = surfaceName;
+}
+void CaptureStream::start(const QString &device)
+{
+    CaptureSource source = CaptureSource::parse(device);
+    if (source.kind == CaptureSource::Invalid) {
+        qWarning() << "Invalid capture source" << device;
+        setStatus(Status::Failed);
+        return;
+    }
+    if (m_status == Status::Started)
+        stop();
+    else if (m_status == Status::Starting) {
+        qWarning() << "start() called while capture was in Starting mode, ignoring";
+        return;
+    }
+    setStatus(Status::Starting);
+    m_lock = new QReadWriteLock;
+    m_historyMutex.lock(); // frames of the previous source must not match new timestamps
+    m_history.clear();
+    m_historyMutex.unlock();
+    m_worker = new CaptureWorker(source, this, nullptr);
+    m_worker->moveToThread(&m_workerThread);
+    connect(&m_workerThread, &QThread::started, m_worker, &CaptureWorker::doWork);
+//    connect(&m_workerThread, &QThread::finished, this, &CaptureStream::stop);
+    connect(m_worker, &CaptureWorker::frameReady, this, &CaptureStream::frameReady);
+    connect(m_worker, &CaptureWorker::workDone, this, &CaptureStream::stop);
+    m_workerThread.start();
+}
+
+void CaptureStream::stop()
+{
+    if (m_status == Status::Stopped)
+        return;
+    qDebug() << "Capture is stopping from" << m_status << "state ...";
+
+    disconnect(m_worker, &CaptureWorker::frameReady, this, &CaptureStream::frameReady);
+    m_worker->stop();
+    m_workerThread.quit();
+    if(!m_workerThread.wait(1000)) {
+        // Processor must not be left running on frames of a terminated worker
+        m_worker->stopProcessor();
+        qWarning() << "Capture thread did not terminate until timeout, trying terminate()";
+        m_workerThread.terminate();
+        m_workerThread.wait();
+    }
+    delete m_worker;
+    m_worker = nullptr;
+    delete m_lock;
+    m_lock = nullptr;
+    setStatus(Status::Stopped);
+}
+
+void CaptureStream::setStatus(CaptureStream::Status status)
+{
+    if (status == m_status)
+        return;
+    m_status = status;
+    emit statusChanged();
+}
+
@@ -0,0 +1,271 @@
+#ifndef CAPTURESTREAM_HPP
+#define CAPTURESTREAM_HPP
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <atomic>
+#include <opencv2/core.hpp>
+
+#include "capturesource.h"
+#include "boundedqueue.h"
+
+namespace cv {
+class VideoCapture;
+}
+
+class QReadWriteLock;
+class SessionRecorder;
+class FrameRecorder;
+class V4l2Capture;
+class CaptureStream;
+class CaptureProcessor;
+class CaptureWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CaptureWorker(const CaptureSource &source, CaptureStream *captureStream, QObject *parent = nullptr);
+    ~CaptureWorker();
+
+    /**
+     * @brief stop Stops capture and exits doWork() loop
+     */
+    void stop();
+    /**
+     * @brief stopProcessor Closes the retrieved queue, which also releases a blocked push(), and joins the processor thread.
+     * Safe to call from any thread and more than once.
+     */
+    void stopProcessor();
+signals:
+    void frameReady();
+    void workDone();
+
+public slots:
+    void doWork();
+
+private:
+    friend class CaptureStream;
+    friend class CaptureProcessor;
+    typedef struct {
+        qint64 timestamp;
+        quint32 frameIndex;
+    } frame_request_t;
+    /**
+     * @brief Frame passed from grab/retrieve stage to undistort/publish stage
+     */
+    typedef struct {
+        cv::Mat frame;
+        qint64 timestamp;
+        quint32 frameIndex;
+    } captured_frame_t;
+    bool waitForRequest(frame_request_t &request);
+    void runVideoCapture();
+    /**
+     * @brief processFrames Undistorts and publishes retrieved frames until queue is closed, runs on its own thread
+     */
+    void processFrames(BoundedQueue<captured_frame_t> &retrieved);
+    void runV4l2();
+    void applySourceProperties();
+    void applyControls();
+    void applyControls(V4l2Capture &capture);
+    void undistortLocked();
+    /**
+     * @brief undistortMaps Returns remap() tables for frame size, recomputed only when size or calibration changes
+     * @return false if undistort is not enabled
+     */
+    bool undistortMaps(const cv::Size &size, cv::Mat &map1, cv::Mat &map2);
+    void releaseSharedFrame();
+    /**
+     * @brief convertNativeLocked Converts native YUYV frame to m_frame on first use, write lock must be held
+     */
+    void convertNativeLocked();
+    void publishFrame(qint64 timestamp, quint32 frameIndex, const cv::Mat &frame);
+
+    CaptureSource m_source;
+    cv::VideoCapture *m_capture;
+    CaptureStream *m_captureStream;
+    QString m_previewSurface;
+    cv::Mat m_frame;
+    qint64 m_frameTimestamp;
+    bool m_loopRunning;
+    bool m_useUndistort;
+    cv::Mat m_intrinsic;
+    cv::Mat m_distCoeffs;
+    int m_undistortGeneration; ///< Bumped by enableUndistort() to invalidate maps
+    QMutex m_mapsMutex;
+    cv::Mat m_map1;
+    cv::Mat m_map2;
+    cv::Size m_mapsSize;
+    int m_mapsGeneration;
+    int m_pacing;
+    quint32 m_frameIndex;
+    quint32 m_publishedIndex; ///< Index of m_frame
+    bool m_frameConverted; ///< m_frame is up to date with m_native
+    cv::Mat m_native;      ///< YUYV frame in a V4L2 driver buffer, empty for other sources
+    QMutex m_requestMutex;
+    QWaitCondition m_requestAdded;
+    QQueue<frame_request_t> m_requests;
+    // Queue depth bounds latency between grab/retrieve and undistort/publish stages
+    BoundedQueue<captured_frame_t> m_retrieved;
+    QThread m_processThread;
+    CaptureProcessor *m_processor; ///< Lives in m_processThread while runVideoCapture() runs
+};
+
+/**
+ * @brief The CaptureProcessor class runs the undistort/publish stage of CaptureWorker, so frame N is processed while N+1 is grabbed
+ */
+class CaptureProcessor : public QObject
+{
+    Q_OBJECT
+public:
+    CaptureProcessor(CaptureWorker *worker, BoundedQueue<CaptureWorker::captured_frame_t> *retrieved, QObject *parent = nullptr);
+
+public slots:
+    void doWork();
+
+private:
+    CaptureWorker *m_worker;
+    BoundedQueue<CaptureWorker::captured_frame_t> *m_retrieved;
+};
+
+/**
+ * @brief The CaptureStream class is one camera or video with its own worker thread, calibration and frame buffer.
+ * Streams are created and looked up by name through CaptureController.
+ */
+class CaptureStream : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString name READ name CONSTANT)
+    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+public:
+    explicit CaptureStream(const QString &name, QObject *parent = nullptr);
+    ~CaptureStream();
+
+    QString name() const;
+
+    const cv::Mat frameRef() const;
+    cv::Mat frameCopy() const;
+    /**
+     * @brief frameCopy Copy of current frame and its frameTimestamp(), taken under one lock so they always match
+     */
+    cv::Mat frameCopy(qint64 *timestamp) const;
+    /**
+     * @brief frameRoi Copies roi of current frame as BGR into out, converting it straight from the native format when possible
+     * @return Actual rectangle that was copied, it may be clipped or widened to native pixel boundaries
+     */
+    cv::Rect frameRoi(const cv::Rect &roi, cv::Mat &out) const;
+    cv::Size frameSize() const;
+    /**
+     * @brief frameTimestamp monotonicNs() when current frame was grabbed, to look up machine position in telemetry history
+     */
+    qint64 frameTimestamp() const;
+    /**
+     * @brief frameIndex Index of current frame since start(), same numbering as frame and session logs
+     */
+    quint32 frameIndex() const;
+    /**
+     * @brief setHistoryDepth Keeps last depth frames for frameNear(), 0 disables history
+     */
+    void setHistoryDepth(int depth);
+    /**
+     * @brief frameNear Returns kept frame closest to timestamp, empty if history is disabled or empty
+     * @param frameTimestamp Set to timestamp of returned frame
+     */
+    cv::Mat frameNear(qint64 timestamp, qint64 *frameTimestamp = nullptr) const;
+
+    /**
+     * @brief The Status enum
+     */
+    enum class Status {
+        Starting,          ///< Capture is in startup
+        Started,           ///< Capture successfully started and frameReady() signals is emitting
+        Stopped,           ///< Initial state or after @see stop() was called
+        EofOrDisconnected, ///< Video file ended or camera was disconnected
+        Failed             ///< After Starting if it wasn't successful
+    };
+    Q_ENUM(Status)
+    Status status() const;
+
+    void enableUndistort(const cv::Mat &intrinsic, const cv::Mat &distCoeffs);
+
+    /**
+     * @brief The FramePacing enum selects how fast frames of a video file are delivered, cameras are always free running
+     */
+    enum class FramePacing {
+        SourceRate, ///< Sleep 1/fps between frames
+        Unpaced,    ///< As fast as frames are decoded
+        External    ///< One frame per requestFrame() call, e.g. from SessionReplayer
+    };
+    Q_ENUM(FramePacing)
+    /**
+     * @brief setFramePacing Takes effect on next start()
+     */
+    void setFramePacing(FramePacing pacing);
+    FramePacing framePacing() const;
+    /**
+     * @brief requestFrame Delivers frame frameIndex stamped with timestamp, in External pacing mode only
+     */
+    void requestFrame(qint64 timestamp, quint32 frameIndex);
+    /**
+     * @brief setSessionRecorder Records index and timestamp of every captured frame, takes effect on next start()
+     */
+    void setSessionRecorder(SessionRecorder *recorder);
+    /**
+     * @brief frameRecorder Tap that streams every captured frame to a frame log while recording
+     */
+    FrameRecorder *frameRecorder() const;
+    /**
+     * @brief setPreviewSurface CVMatSurfaceSource that shows this stream, defaults to stream name, empty disables preview, takes effect on next start()
+     */
+    void setPreviewSurface(const QString &surfaceName);
+
+    /**
+     * @brief setExposure Manual exposure in device units (100 us for V4L2), negative value enables auto exposure
+     */
+    Q_INVOKABLE void setExposure(int exposure);
+    Q_INVOKABLE void setGain(int gain);
+
+public slots:
+    /**
+     * @brief start Starts capture from a source description, see CaptureSource for the syntax
+     */
+    void start(const QString &device);
+    void stop();
+signals:
+    void statusChanged();
+    void frameReady();
+    //void statisticsReady(QVariant ?
+
+private:
+    friend class CaptureWorker;
+    typedef struct {
+        qint64 timestamp;
+        cv::Mat frame;
+    } timed_frame_t;
+    void rememberFrame(qint64 timestamp, const cv::Mat &frame);
+
+    QString m_name;
+    QString m_previewSurface;
+    CaptureWorker* m_worker;
+    QThread m_workerThread;
+    mutable QReadWriteLock* m_lock;
+    mutable QReadWriteLock* m_undistortLock;
+
+    void setStatus(Status status);
+    void lockConvertedFrame() const;
+    Status m_status;
+    FramePacing m_pacing;
+    SessionRecorder *m_recorder;
+    FrameRecorder *m_frameRecorder;
+    std::atomic<int> m_exposure;
+    std::atomic<int> m_gain;
+    std::atomic<bool> m_exposureChanged; ///< Applied by the worker between frames
+    std::atomic<bool> m_gainChanged;
+    mutable QMutex m_historyMutex;
+    QQueue<timed_frame_t> m_history;
+    std::atomic<int> m_historyDepth;
+};
+
+#endif // CAPTURESTREAM_HPP
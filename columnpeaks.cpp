@@ -0,0 +1,64 @@
+#include "columnpeaks.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+void findColumnPeaks(const cv::Mat &image, int colFrom, int colTo, std::vector<ushort> &rows, std::vector<uchar> &levels)
+{
+    CV_Assert(image.type() == CV_8UC1 && image.rows <= 0xffff);
+    colFrom = std::max(colFrom, 0);
+    colTo = std::min(colTo, image.cols);
+    const int width = std::max(colTo - colFrom, 0);
+    rows.assign(width, 0);
+    levels.assign(width, 0);
+    int x = 0;
+#if CV_SIMD128
+    // Eight columns per pass down the image, running max and its row stay in registers
+    for (; x + 8 <= width; x += 8) {
+        cv::v_uint16x8 best = cv::v_setzero_u16();
+        cv::v_uint16x8 bestRow = cv::v_setzero_u16();
+        cv::v_uint16x8 row = cv::v_setzero_u16();
+        const cv::v_uint16x8 one = cv::v_setall_u16(1);
+        const uchar *p = image.ptr<uchar>(0) + colFrom + x;
+        for (int y = 0; y < image.rows; ++y, p += image.step) {
+            cv::v_uint16x8 value = cv::v_load_expand(p);
+            cv::v_uint16x8 greater = value > best;
+            bestRow = cv::v_select(greater, row, bestRow);
+            best = cv::v_max(best, value);
+            row = row + one;
+        }
+        ushort bestValues[8];
+        cv::v_store(bestValues, best);
+        cv::v_store(&rows[x], bestRow);
+        for (int i = 0; i < 8; ++i)
+            levels[x + i] = static_cast<uchar>(bestValues[i]);
+    }
+#endif
+    for (; x < width; ++x) {
+        int col = colFrom + x;
+        uchar best = 0;
+        ushort bestRow = 0;
+        for (int y = 0; y < image.rows; ++y) {
+            uchar value = image.at<uchar>(y, col);
+            if (value > best) {
+                best = value;
+                bestRow = static_cast<ushort>(y);
+            }
+        }
+        rows[x] = bestRow;
+        levels[x] = best;
+    }
+}
+
+float refineColumnPeak(const cv::Mat &image, int col, int row, int radius)
+{
+    int from = std::max(row - radius, 0);
+    int to = std::min(row + radius, image.rows - 1);
+    float sum = 0;
+    float moment = 0;
+    for (int y = from; y <= to; ++y) {
+        float w = image.at<uchar>(y, col);
+        sum += w;
+        moment += w * y;
+    }
+    return sum > 0 ? moment / sum : row;
+}
@@ -0,0 +1,20 @@
+#ifndef COLUMNPEAKS_H
+#define COLUMNPEAKS_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+/**
+ * @brief findColumnPeaks Brightest row of every column colFrom..colTo of an 8 bit image, first one on ties.
+ * Runs eight columns at a time with OpenCV universal intrinsics where available.
+ * @param rows Peak row per column
+ * @param levels Peak value per column
+ */
+void findColumnPeaks(const cv::Mat &image, int colFrom, int colTo, std::vector<ushort> &rows, std::vector<uchar> &levels);
+
+/**
+ * @brief refineColumnPeak Subpixel peak row, centroid of the column over peak +-radius rows
+ */
+float refineColumnPeak(const cv::Mat &image, int col, int row, int radius);
+
+#endif // COLUMNPEAKS_H
@@ -0,0 +1,101 @@
+#include "detectorbenchmark.h"
+#include "capturestream.hpp"
+#include "linedetector.h"
+#include "monotonicclock.h"
+
+#include <QDebug>
+#include <QtMath>
+
+DetectorBenchmark::DetectorBenchmark(CaptureStream *captureStream, LineDetector *lineDetector, QObject *parent) :
+    QObject(parent), m_captureStream(captureStream), m_lineDetector(lineDetector), m_running(false), m_hasTruth(false),
+    m_nextFrame(0), m_zeroed(false), m_zeroOffset(0), m_frames(0), m_detected(0), m_errorSquares(0), m_maxError(0),
+    m_startedAt(0)
+{
+    // Connected after LineDetector, so the frame is already processed when onFrameReady() is called
+    connect(m_captureStream, &CaptureStream::frameReady,
+            this,            &DetectorBenchmark::onFrameReady);
+    connect(m_captureStream, &CaptureStream::statusChanged,
+            this,            &DetectorBenchmark::onCaptureStatusChanged);
+}
+
+void DetectorBenchmark::start(const QString &source)
+{
+    CaptureSource parsed = CaptureSource::parse(source);
+    m_hasTruth = parsed.kind == CaptureSource::Synthetic;
+    m_savedPlane = m_lineDetector->laserPlane();
+    if (m_hasTruth) {
+        m_parameters = SyntheticLineCapture::Parameters::parse(parsed.location);
+        m_lineDetector->setLaserPlane(LaserPlane());
+    } else {
+        qWarning() << "No ground truth for" << parsed.toString() << ", only throughput is measured";
+    }
+    m_nextFrame = 0;
+    m_zeroed = false;
+    m_frames = 0;
+    m_detected = 0;
+    m_errorSquares = 0;
+    m_maxError = 0;
+    m_lineDetector->zerodxs();
+    m_captureStream->setFramePacing(CaptureStream::FramePacing::External);
+    m_captureStream->start(source);
+    m_running = true;
+    m_startedAt = monotonicNs();
+    requestNext();
+}
+
+void DetectorBenchmark::onFrameReady()
+{
+    if (!m_running)
+        return;
+    quint32 index = m_captureStream->frameIndex();
+    m_frames++;
+    // State falls to Hold as soon as a frame has no line, so Locked means this frame was detected
+    if (m_lineDetector->state() == LineDetector::Locked) {
+        m_detected++;
+        if (m_hasTruth) {
+            const LaserGeometry &geometry = m_parameters.geometry;
+            float offset = geometry.offsetFromDz(m_parameters.dzAt(index));
+            if (!m_zeroed) {
+                m_zeroOffset = offset;
+                m_zeroed = true;
+            }
+            // Detector measures relative to the zeroed frame
+            float expected = geometry.dzFromOffset(offset - m_zeroOffset);
+            float error = qAbs(m_lineDetector->dz() - expected);
+            m_errorSquares += error * error;
+            m_maxError = qMax(m_maxError, error);
+        }
+    }
+    if (m_frames % 100 == 0)
+        report();
+    requestNext();
+}
+
+void DetectorBenchmark::onCaptureStatusChanged()
+{
+    if (!m_running)
+        return;
+    CaptureStream::Status status = m_captureStream->status();
+    if (status == CaptureStream::Status::Starting || status == CaptureStream::Status::Started)
+        return;
+    m_running = false;
+    if (m_hasTruth)
+        m_lineDetector->setLaserPlane(m_savedPlane);
+    report();
+    emit finished();
+}
+
+void DetectorBenchmark::requestNext()
+{
+    m_captureStream->requestFrame(monotonicNs(), m_nextFrame++);
+}
+
+void DetectorBenchmark::report() const
+{
+    double seconds = (monotonicNs() - m_startedAt) / 1e9;
+    QDebug out = qDebug().nospace();
+    out << m_frames << " frames, " << (seconds > 0 ? m_frames / seconds : 0) << " fps, "
+        << m_detected << " detected";
+    if (m_hasTruth && m_detected > 0)
+        out << ", dz error rms " << qSqrt(m_errorSquares / m_detected) << " mm, max " << m_maxError << " mm";
+}
@@ -0,0 +1,55 @@
+#ifndef DETECTORBENCHMARK_H
+#define DETECTORBENCHMARK_H
+
+#include <QObject>
+
+#include "laserplane.h"
+#include "syntheticlinecapture.h"
+
+class CaptureStream;
+class LineDetector;
+
+/**
+ * @brief The DetectorBenchmark class feeds frames to LineDetector one by one as fast as it takes them,
+ * and reports throughput and, for synth: sources, dz error against ground truth.
+ */
+class DetectorBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    DetectorBenchmark(CaptureStream *captureStream, LineDetector *lineDetector, QObject *parent = nullptr);
+
+    /**
+     * @brief start Starts capture from source in External pacing mode, detector is zeroed on the first detected frame.
+     * Synthetic truth follows LaserGeometry, so a calibrated LaserPlane is set aside until the run finishes.
+     */
+    void start(const QString &source);
+
+signals:
+    void finished();
+
+private slots:
+    void onFrameReady();
+    void onCaptureStatusChanged();
+
+private:
+    void requestNext();
+    void report() const;
+
+    CaptureStream *m_captureStream;
+    LineDetector *m_lineDetector;
+    bool m_running;
+    bool m_hasTruth;
+    SyntheticLineCapture::Parameters m_parameters;
+    LaserPlane m_savedPlane;  ///< Detector's plane, restored when finished
+    quint32 m_nextFrame;
+    bool m_zeroed;
+    float m_zeroOffset; ///< Ground truth line offset of the frame detector was zeroed on
+    int m_frames;
+    int m_detected;
+    double m_errorSquares;
+    float m_maxError;
+    qint64 m_startedAt;
+};
+
+#endif // DETECTORBENCHMARK_H
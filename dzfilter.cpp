@@ -0,0 +1,207 @@
+#include "dzfilter.h"
+
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+const int RelockAfter = 3;      ///< Gated out samples in a row taken as a real step
+const float QualityFrames = 16; ///< Time constant of the lock quality average, samples
+const int QualityWarmup = 3;    ///< Gain is 1/(n + QualityWarmup) after the line is lost, 3 good samples reach 0.5
+}
+
+DzFilter::DzFilter(QObject *parent) : QObject(parent),
+    m_mode(Kalman), m_window(5), m_gate(0.5f),
+    m_processNoise(0.0005f), m_measurementNoise(0.03f), m_alpha(0.5f), m_beta(0.1f),
+    m_locked(false), m_rejected(0), m_dz(0), m_quality(0), m_qualitySamples(0),
+    m_ringHead(0), m_ringCount(0),
+    m_position(0), m_velocity(0), m_p00(0), m_p01(0), m_p11(0)
+{
+}
+
+DzFilter::Mode DzFilter::mode() const
+{
+    return m_mode;
+}
+
+void DzFilter::setMode(Mode mode)
+{
+    if (mode == m_mode)
+        return;
+    m_mode = mode;
+    reset();
+    emit settingsChanged();
+}
+
+int DzFilter::window() const
+{
+    return m_window;
+}
+
+void DzFilter::setWindow(int window)
+{
+    window = qBound(1, window | 1, static_cast<int>(MaxWindow));
+    if (window == m_window)
+        return;
+    m_window = window;
+    reset();
+    emit settingsChanged();
+}
+
+float DzFilter::gate() const
+{
+    return m_gate;
+}
+
+void DzFilter::setGate(float gate)
+{
+    if (gate <= 0)
+        return;
+    m_gate = gate;
+    emit settingsChanged();
+}
+
+void DzFilter::setKalmanNoise(float process, float measurement)
+{
+    m_processNoise = process;
+    m_measurementNoise = measurement;
+}
+
+void DzFilter::setAlphaBeta(float alpha, float beta)
+{
+    m_alpha = alpha;
+    m_beta = beta;
+}
+
+float DzFilter::dz() const
+{
+    return m_dz;
+}
+
+float DzFilter::quality() const
+{
+    return m_quality;
+}
+
+void DzFilter::ondzChanged(float dz)
+{
+    if (m_mode == Passthrough || !m_locked) {
+        relock(dz);
+        updateQuality(1);
+        return;
+    }
+    float predicted = predict();
+    float innovation = dz - predicted;
+    if (qAbs(innovation) > m_gate) {
+        updateQuality(0);
+        if (++m_rejected < RelockAfter)
+            return;
+        relock(dz);
+        return;
+    }
+    m_rejected = 0;
+    correct(dz, innovation);
+    updateQuality(1 - qAbs(innovation) / m_gate);
+}
+
+void DzFilter::ondzValidChanged(bool valid)
+{
+    if (!valid) {
+        reset();
+        m_quality = 0;
+        m_qualitySamples = 0;
+        emit qualityChanged(m_quality);
+    }
+    emit dzValidChanged(valid);
+}
+
+void DzFilter::reset()
+{
+    m_locked = false;
+    m_rejected = 0;
+    m_ringHead = 0;
+    m_ringCount = 0;
+}
+
+float DzFilter::predict()
+{
+    switch (m_mode) {
+    case Kalman:
+        m_position += m_velocity;
+        // P = F P F' + Q, white acceleration noise over one sample
+        m_p00 += 2 * m_p01 + m_p11 + m_processNoise * 0.25f;
+        m_p01 += m_p11 + m_processNoise * 0.5f;
+        m_p11 += m_processNoise;
+        return m_position;
+    case AlphaBeta:
+        m_position += m_velocity;
+        return m_position;
+    default:
+        return m_dz;
+    }
+}
+
+void DzFilter::correct(float z, float innovation)
+{
+    switch (m_mode) {
+    case Median: {
+        m_ring[m_ringHead] = z;
+        m_ringHead = (m_ringHead + 1) % m_window;
+        m_ringCount = qMin(m_ringCount + 1, m_window);
+        float sorted[MaxWindow];
+        std::copy(m_ring, m_ring + m_ringCount, sorted);
+        std::nth_element(sorted, sorted + m_ringCount / 2, sorted + m_ringCount);
+        m_dz = sorted[m_ringCount / 2];
+        break;
+    }
+    case Kalman: {
+        float s = m_p00 + m_measurementNoise * m_measurementNoise;
+        float k0 = m_p00 / s;
+        float k1 = m_p01 / s;
+        m_position += k0 * innovation;
+        m_velocity += k1 * innovation;
+        m_p11 -= k1 * m_p01;
+        m_p01 -= k0 * m_p01;
+        m_p00 -= k0 * m_p00;
+        m_dz = m_position;
+        break;
+    }
+    case AlphaBeta:
+        m_position += m_alpha * innovation;
+        m_velocity += m_beta * innovation;
+        m_dz = m_position;
+        break;
+    case Passthrough:
+        m_dz = z;
+        break;
+    }
+    emit dzChanged();
+    emit dzChanged(m_dz);
+}
+
+void DzFilter::relock(float z)
+{
+    m_locked = true;
+    m_rejected = 0;
+    m_ringHead = 0;
+    m_ringCount = 0;
+    m_position = z;
+    m_velocity = 0;
+    m_p00 = m_measurementNoise * m_measurementNoise;
+    m_p01 = 0;
+    m_p11 = m_gate * m_gate;
+    if (m_mode == Median) {
+        correct(z, 0);
+        return;
+    }
+    m_dz = z;
+    emit dzChanged();
+    emit dzChanged(m_dz);
+}
+
+void DzFilter::updateQuality(float score)
+{
+    // Average of the samples seen since the line came back, then exponential with QualityFrames
+    m_qualitySamples = qMin(m_qualitySamples + 1, static_cast<int>(QualityFrames));
+    m_quality += (score - m_quality) / qMin(QualityFrames, static_cast<float>(m_qualitySamples + QualityWarmup));
+    emit qualityChanged(m_quality);
+}
@@ -0,0 +1,102 @@
+#ifndef DZFILTER_H
+#define DZFILTER_H
+
+#include <QObject>
+
+/**
+ * @brief The DzFilter class smooths LineDetector dz over time before it reaches Automator.
+ * Samples too far from the prediction are gated out, several in a row are taken as a real step and the filter
+ * relocks on them. Every mode is constant work per sample.
+ */
+class DzFilter : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(Mode mode READ mode WRITE setMode NOTIFY settingsChanged)
+    Q_PROPERTY(int window READ window WRITE setWindow NOTIFY settingsChanged)
+    Q_PROPERTY(float gate READ gate WRITE setGate NOTIFY settingsChanged)
+    Q_PROPERTY(float dz READ dz NOTIFY dzChanged)
+    Q_PROPERTY(float quality READ quality NOTIFY qualityChanged)
+public:
+    explicit DzFilter(QObject *parent = nullptr);
+
+    enum Mode {
+        Passthrough,
+        Median,
+        Kalman,
+        AlphaBeta
+    };
+    Q_ENUM(Mode)
+
+    Mode mode() const;
+    void setMode(Mode mode);
+
+    /**
+     * @brief window Median window in samples, odd, up to MaxWindow
+     */
+    int window() const;
+    void setWindow(int window);
+    enum { MaxWindow = 15 };
+
+    /**
+     * @brief gate Largest accepted distance from the prediction, mm
+     */
+    float gate() const;
+    void setGate(float gate);
+
+    /**
+     * @brief setKalmanNoise Process noise (mm/frame^2) and measurement noise (mm) of the constant velocity model
+     */
+    void setKalmanNoise(float process, float measurement);
+    void setAlphaBeta(float alpha, float beta);
+
+    float dz() const;
+    /**
+     * @brief quality Lock quality 0..1, average of accepted samples scored by their closeness to the prediction.
+     * Restarts from 0 when the line is lost and ramps up over the first few samples, rejected samples score 0.
+     */
+    float quality() const;
+
+signals:
+    void settingsChanged();
+    void dzChanged();
+    void dzChanged(float dz);
+    void dzValidChanged(bool valid);
+    void qualityChanged(float quality);
+
+public slots:
+    void ondzChanged(float dz);
+    void ondzValidChanged(bool valid);
+    void reset();
+
+private:
+    float predict();
+    void correct(float z, float innovation);
+    void relock(float z);
+    void updateQuality(float score);
+
+    Mode m_mode;
+    int m_window;
+    float m_gate;
+    float m_processNoise;
+    float m_measurementNoise;
+    float m_alpha;
+    float m_beta;
+
+    bool m_locked;
+    int m_rejected;          ///< Consecutive gated out samples
+    float m_dz;
+    float m_quality;
+    int m_qualitySamples;    ///< Scored since quality was last reset, up to QualityFrames
+
+    // Median ring
+    float m_ring[MaxWindow];
+    int m_ringHead;
+    int m_ringCount;
+
+    // Kalman and alpha-beta state, one sample per step
+    float m_position;
+    float m_velocity;
+    float m_p00, m_p01, m_p11;
+};
+
+#endif // DZFILTER_H
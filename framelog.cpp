@@ -0,0 +1,87 @@
+#include "framelog.h"
+
+#include <QDebug>
+#include <string.h>
+
+FrameLogReader::FrameLogReader() :
+    m_data(nullptr), m_header(nullptr), m_count(0)
+{
+}
+
+FrameLogReader::~FrameLogReader()
+{
+    close();
+}
+
+bool FrameLogReader::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Can't open" << fileName << m_file.errorString();
+        return false;
+    }
+    qint64 size = m_file.size();
+    if (size < qint64(sizeof(frame_log_header_t))) {
+        qWarning() << fileName << "is not a frame log";
+        close();
+        return false;
+    }
+    m_data = m_file.map(0, size);
+    if (!m_data) {
+        qWarning() << "Can't map" << fileName << m_file.errorString();
+        close();
+        return false;
+    }
+    m_header = reinterpret_cast<const frame_log_header_t *>(m_data);
+    if (memcmp(m_header->magic, FRAME_LOG_MAGIC, sizeof(m_header->magic)) != 0 || m_header->version != FRAME_LOG_VERSION) {
+        qWarning() << fileName << "is not a frame log or has unsupported version";
+        close();
+        return false;
+    }
+    // Count is updated after each frame, slots beyond the file end are from an interrupted recording
+    qint64 slots = m_header->slotSize ? (size - m_header->headerSize) / m_header->slotSize : 0;
+    m_count = static_cast<int>(qMin<qint64>(m_header->count, slots));
+    return true;
+}
+
+void FrameLogReader::close()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+    m_data = nullptr;
+    m_header = nullptr;
+    m_count = 0;
+    m_file.close();
+}
+
+int FrameLogReader::count() const
+{
+    return m_count;
+}
+
+cv::Size FrameLogReader::size() const
+{
+    if (!m_header)
+        return cv::Size();
+    return cv::Size(static_cast<int>(m_header->width), static_cast<int>(m_header->height));
+}
+
+int FrameLogReader::type() const
+{
+    return m_header ? m_header->type : 0;
+}
+
+cv::Mat FrameLogReader::frame(int i) const
+{
+    if (i < 0 || i >= m_count)
+        return cv::Mat();
+    uchar *pixels = m_data + m_header->headerSize + qint64(i) * m_header->slotSize + FRAME_LOG_PIXELS_OFFSET;
+    return cv::Mat(static_cast<int>(m_header->height), static_cast<int>(m_header->width), m_header->type,
+                   pixels, m_header->stride);
+}
+
+const frame_log_meta_t &FrameLogReader::meta(int i) const
+{
+    return *reinterpret_cast<const frame_log_meta_t *>(m_data + m_header->headerSize + qint64(i) * m_header->slotSize);
+}
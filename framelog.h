@@ -0,0 +1,71 @@
+#ifndef FRAMELOG_H
+#define FRAMELOG_H
+
+#include <QFile>
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+/**
+ * Frame log is a preallocated file of fixed-size slots, one raw frame with its metadata per slot.
+ * Slots are page aligned and pixels are 64-byte aligned, so frames can be used straight from the mapped file.
+ */
+
+#define FRAME_LOG_MAGIC "CNCVFRM1"
+#define FRAME_LOG_VERSION 1
+#define FRAME_LOG_ALIGNMENT 4096
+#define FRAME_LOG_PIXELS_OFFSET 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize; ///< Offset of the first slot
+    uint32_t width;
+    uint32_t height;
+    int32_t type;        ///< cv::Mat::type()
+    uint32_t stride;     ///< Bytes per row
+    uint32_t slotSize;   ///< Metadata and pixels, FRAME_LOG_ALIGNMENT aligned
+    uint32_t capacity;   ///< Preallocated slots
+    uint32_t count;      ///< Frames written so far
+    uint32_t reserved;
+} frame_log_header_t;
+
+typedef struct {
+    int64_t timestamp;   ///< Frame timestamp, same time base as session log records
+    uint32_t index;      ///< Frame index since capture start, matches SESSION_FRAME_CAPTURED
+    uint32_t reserved;
+} frame_log_meta_t;
+
+inline uint32_t frameLogAlign(uint64_t size)
+{
+    return static_cast<uint32_t>((size + FRAME_LOG_ALIGNMENT - 1) & ~uint64_t(FRAME_LOG_ALIGNMENT - 1));
+}
+
+/**
+ * @brief The FrameLogReader class maps a frame log, frames are returned without copying
+ */
+class FrameLogReader
+{
+public:
+    FrameLogReader();
+    ~FrameLogReader();
+
+    bool open(const QString &fileName);
+    void close();
+
+    int count() const;
+    cv::Size size() const;
+    int type() const;
+    /**
+     * @brief frame Mat header pointing into the read-only mapped file, valid until close(), copy it before modifying
+     */
+    cv::Mat frame(int i) const;
+    const frame_log_meta_t &meta(int i) const;
+
+private:
+    QFile m_file;
+    uchar *m_data;
+    const frame_log_header_t *m_header;
+    int m_count;
+};
+
+#endif // FRAMELOG_H
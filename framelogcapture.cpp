@@ -0,0 +1,90 @@
+#include "framelogcapture.h"
+
+#include <QDebug>
+#include <opencv2/imgproc.hpp>
+
+FrameLogCapture::FrameLogCapture(const QString &fileName) :
+    m_opened(false), m_position(-1), m_slot(-1), m_repeated(0)
+{
+    m_opened = m_reader.open(fileName) && m_reader.count() > 0;
+}
+
+bool FrameLogCapture::isOpened() const
+{
+    return m_opened;
+}
+
+void FrameLogCapture::release()
+{
+    if (m_repeated)
+        qDebug() << "Frame log replay repeated" << m_repeated << "frames the recorder had dropped";
+    m_reader.close();
+    m_opened = false;
+    m_position = -1;
+    m_slot = -1;
+}
+
+bool FrameLogCapture::grab()
+{
+    if (!m_opened || m_position + 1 > m_reader.meta(m_reader.count() - 1).index)
+        return false;
+    m_position++;
+    while (m_slot + 1 < m_reader.count() && m_reader.meta(m_slot + 1).index <= m_position)
+        m_slot++;
+    return true;
+}
+
+bool FrameLogCapture::retrieve(cv::OutputArray image, int flag)
+{
+    Q_UNUSED(flag);
+    if (m_slot < 0) {
+        image.release();
+        return false;
+    }
+    if (m_reader.meta(m_slot).index != m_position)
+        m_repeated++;
+    cv::Mat frame = m_reader.frame(m_slot);
+    // Mapped file is read only, so the frame is always copied out
+    if (frame.type() == CV_8UC2)
+        cv::cvtColor(frame, image, cv::COLOR_YUV2BGR_YUYV);
+    else
+        frame.copyTo(image);
+    return !frame.empty();
+}
+
+bool FrameLogCapture::read(cv::OutputArray image)
+{
+    if (!grab()) {
+        image.release();
+        return false;
+    }
+    return retrieve(image);
+}
+
+bool FrameLogCapture::set(int propId, double value)
+{
+    if (propId == cv::CAP_PROP_POS_FRAMES) {
+        m_position = static_cast<qint64>(value) - 1;
+        m_slot = -1;
+        while (m_slot + 1 < m_reader.count() && m_reader.meta(m_slot + 1).index <= m_position)
+            m_slot++;
+        return true;
+    }
+    return false;
+}
+
+double FrameLogCapture::get(int propId) const
+{
+    switch (propId) {
+    case cv::CAP_PROP_FRAME_COUNT:
+        return m_opened ? m_reader.meta(m_reader.count() - 1).index + 1.0 : 0;
+    case cv::CAP_PROP_FRAME_WIDTH:
+        return m_reader.size().width;
+    case cv::CAP_PROP_FRAME_HEIGHT:
+        return m_reader.size().height;
+    case cv::CAP_PROP_POS_FRAMES:
+        return static_cast<double>(m_position + 1);
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef FRAMELOGCAPTURE_H
+#define FRAMELOGCAPTURE_H
+
+#include <opencv2/videoio.hpp>
+
+#include "framelog.h"
+
+/**
+ * @brief The FrameLogCapture class plays a frame log through the cv::VideoCapture interface.
+ * Positions follow recorded frame indices, so a frame the recorder dropped is replaced by the last recorded one
+ * and session log SESSION_FRAME_CAPTURED indices stay aligned. YUYV frames are converted to BGR.
+ */
+class FrameLogCapture : public cv::VideoCapture
+{
+public:
+    explicit FrameLogCapture(const QString &fileName);
+
+    bool isOpened() const override;
+    void release() override;
+    bool grab() override;
+    bool retrieve(cv::OutputArray image, int flag = 0) override;
+    bool read(cv::OutputArray image) override;
+    bool set(int propId, double value) override;
+    double get(int propId) const override;
+
+private:
+    FrameLogReader m_reader;
+    bool m_opened;
+    qint64 m_position; ///< Frame index of the grabbed frame, -1 before first grab()
+    int m_slot;        ///< Last slot with index <= m_position, -1 if none
+    int m_repeated;    ///< Frames replaced by the previous recorded one
+};
+
+#endif // FRAMELOGCAPTURE_H
@@ -0,0 +1,27 @@
+#include "framepool.h"
+
+FramePool::FramePool(int capacity) :
+    m_capacity(static_cast<size_t>(capacity))
+{
+    m_buffers.reserve(m_capacity);
+}
+
+cv::Mat FramePool::acquire(const cv::Size &size, int type)
+{
+    if (size.area() == 0)
+        return cv::Mat();
+    QMutexLocker lock(&m_mutex);
+    for (size_t i = 0; i < m_buffers.size(); ++i) {
+        cv::Mat &buffer = m_buffers[i];
+        // Only the pool references it, nobody downstream is using the buffer anymore
+        if (buffer.u && buffer.u->refcount == 1) {
+            buffer.create(size, type);
+            return buffer;
+        }
+    }
+    if (m_buffers.size() < m_capacity) {
+        m_buffers.push_back(cv::Mat(size, type));
+        return m_buffers.back();
+    }
+    return cv::Mat(size, type);
+}
@@ -0,0 +1,29 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QMutex>
+#include <vector>
+#include <opencv2/core.hpp>
+
+/**
+ * @brief The FramePool class recycles frame buffers between pipeline stages.
+ * A buffer is handed out again only after every cv::Mat outside the pool that referenced it was released,
+ * so consumers can keep published frames as long as they want without copying.
+ */
+class FramePool
+{
+public:
+    explicit FramePool(int capacity);
+
+    /**
+     * @brief acquire Returns an unreferenced buffer of given size and type, allocates an unpooled one if all are in use
+     */
+    cv::Mat acquire(const cv::Size &size, int type);
+
+private:
+    QMutex m_mutex;
+    std::vector<cv::Mat> m_buffers;
+    size_t m_capacity;
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,227 @@
+#include "framerecorder.h"
+
+#include <QDebug>
+#include <string.h>
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#endif
+
+FrameLogWriter::FrameLogWriter(FrameRecorder *recorder, QObject *parent) : QObject(parent),
+    m_recorder(recorder), m_data(nullptr), m_header(nullptr), m_createFailed(false)
+{
+}
+
+void FrameLogWriter::doWork()
+{
+    FrameRecorder *r = m_recorder;
+    forever {
+        r->m_mutex.lock();
+        while (r->m_queued.isEmpty() && !r->m_stopping)
+            r->m_frameQueued.wait(&r->m_mutex, 100);
+        if (r->m_queued.isEmpty()) {
+            r->m_mutex.unlock();
+            break;
+        }
+        int buffer = r->m_queued.dequeue();
+        r->m_mutex.unlock();
+
+        writeFrame(buffer);
+
+        r->m_mutex.lock();
+        r->m_free.append(buffer);
+        r->m_mutex.unlock();
+    }
+    closeFile();
+    emit workDone();
+}
+
+bool FrameLogWriter::createFile(const cv::Mat &frame)
+{
+    FrameRecorder *r = m_recorder;
+    quint32 stride = static_cast<quint32>(frame.cols * frame.elemSize());
+    quint32 headerSize = frameLogAlign(sizeof(frame_log_header_t));
+    quint32 slotSize = frameLogAlign(FRAME_LOG_PIXELS_OFFSET + quint64(stride) * frame.rows);
+    int capacity = r->m_capacity;
+    qint64 fileSize = headerSize + qint64(slotSize) * capacity;
+#ifdef Q_OS_UNIX
+    // Reserve blocks up front, so the writer does not stall on allocation while recording.
+    // A mapped page without a block behind it raises SIGBUS when written, so capacity is shrunk until all fit.
+    int error;
+    while ((error = posix_fallocate(r->m_file.handle(), 0, fileSize)) != 0) {
+        if (capacity <= 1) {
+            qWarning() << "Can't reserve space for frame log" << strerror(error);
+            return false;
+        }
+        capacity /= 2;
+        fileSize = headerSize + qint64(slotSize) * capacity;
+    }
+    if (capacity < r->m_capacity)
+        qWarning() << "Not enough space for" << r->m_capacity << "frames, frame log capacity is" << capacity
+                   << "frames";
+#endif
+    if (!r->m_file.resize(fileSize)) {
+        qWarning() << "Can't allocate" << fileSize << "bytes for frame log" << r->m_file.errorString();
+        return false;
+    }
+    m_data = r->m_file.map(0, fileSize);
+    if (!m_data) {
+        qWarning() << "Can't map frame log" << r->m_file.errorString();
+        return false;
+    }
+    m_header = reinterpret_cast<frame_log_header_t *>(m_data);
+    memset(m_header, 0, sizeof(frame_log_header_t));
+    memcpy(m_header->magic, FRAME_LOG_MAGIC, sizeof(m_header->magic));
+    m_header->version = FRAME_LOG_VERSION;
+    m_header->headerSize = headerSize;
+    m_header->width = static_cast<quint32>(frame.cols);
+    m_header->height = static_cast<quint32>(frame.rows);
+    m_header->type = frame.type();
+    m_header->stride = stride;
+    m_header->slotSize = slotSize;
+    m_header->capacity = static_cast<quint32>(capacity);
+    m_header->count = 0;
+    return true;
+}
+
+void FrameLogWriter::writeFrame(int buffer)
+{
+    FrameRecorder *r = m_recorder;
+    const cv::Mat &image = r->m_pool[buffer].image;
+    if (!m_header && (m_createFailed || !createFile(image))) {
+        m_createFailed = true;
+        r->m_dropped++;
+        return;
+    }
+    if (image.cols != static_cast<int>(m_header->width) || image.rows != static_cast<int>(m_header->height) ||
+            image.type() != m_header->type) {
+        r->m_dropped++;
+        return;
+    }
+    if (m_header->count >= m_header->capacity) {
+        if (r->m_dropped++ == 0)
+            qWarning() << "Frame log is full, dropping frames";
+        return;
+    }
+    uchar *slot = m_data + m_header->headerSize + qint64(m_header->count) * m_header->slotSize;
+    memcpy(slot, &r->m_pool[buffer].meta, sizeof(frame_log_meta_t));
+    uchar *pixels = slot + FRAME_LOG_PIXELS_OFFSET;
+    if (image.isContinuous()) {
+        memcpy(pixels, image.data, size_t(m_header->stride) * image.rows);
+    } else {
+        for (int y = 0; y < image.rows; ++y)
+            memcpy(pixels + size_t(m_header->stride) * y, image.ptr(y), m_header->stride);
+    }
+    m_header->count++;
+}
+
+void FrameLogWriter::closeFile()
+{
+    FrameRecorder *r = m_recorder;
+    qint64 usedSize = -1;
+    if (m_header) {
+        usedSize = m_header->headerSize + qint64(m_header->count) * m_header->slotSize;
+        qDebug() << "Frame log closed with" << m_header->count << "frames";
+    }
+    if (m_data)
+        r->m_file.unmap(m_data);
+    m_data = nullptr;
+    m_header = nullptr;
+    // Unused preallocated slots are released
+    if (usedSize >= 0)
+        r->m_file.resize(usedSize);
+    r->m_file.close();
+}
+
+FrameRecorder::FrameRecorder(QObject *parent) : QObject(parent),
+    m_writer(nullptr), m_capacity(0), m_recording(false), m_stopping(false), m_dropped(0)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    stop();
+}
+
+bool FrameRecorder::recording() const
+{
+    return m_recording;
+}
+
+quint32 FrameRecorder::dropped() const
+{
+    return m_dropped;
+}
+
+void FrameRecorder::start(const QString &fileName, int capacity)
+{
+    if (m_recording)
+        stop();
+    if (capacity <= 0) {
+        qWarning() << "Frame log capacity must be positive";
+        return;
+    }
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qWarning() << "Can't open" << fileName << m_file.errorString();
+        return;
+    }
+    m_capacity = capacity;
+    m_stopping = false;
+    m_dropped = 0;
+    m_queued.clear();
+    m_free.clear();
+    for (int i = 0; i < PoolSize; ++i)
+        m_free.append(i);
+
+    m_writer = new FrameLogWriter(this);
+    m_writer->moveToThread(&m_writerThread);
+    connect(&m_writerThread, &QThread::started, m_writer, &FrameLogWriter::doWork);
+    m_writerThread.start();
+    m_recording = true;
+    qDebug() << "Recording frames to" << fileName;
+    emit recordingChanged();
+}
+
+void FrameRecorder::stop()
+{
+    if (!m_recording)
+        return;
+    m_recording = false;
+    m_mutex.lock();
+    m_stopping = true;
+    m_frameQueued.wakeOne();
+    m_mutex.unlock();
+    m_writerThread.quit();
+    m_writerThread.wait();
+    delete m_writer;
+    m_writer = nullptr;
+    if (m_dropped > 0)
+        qWarning() << "Frame recorder dropped" << m_dropped << "frames";
+    emit recordingChanged();
+}
+
+void FrameRecorder::push(const cv::Mat &frame, qint64 timestamp, quint32 index)
+{
+    if (!m_recording || frame.empty())
+        return;
+    m_mutex.lock();
+    if (m_free.isEmpty()) {
+        m_mutex.unlock();
+        m_dropped++;
+        return;
+    }
+    int buffer = m_free.takeLast();
+    m_mutex.unlock();
+
+    // Buffer is owned by the caller until queued, copy outside of the lock
+    buffer_t &b = m_pool[buffer];
+    frame.copyTo(b.image);
+    b.meta.timestamp = timestamp;
+    b.meta.index = index;
+    b.meta.reserved = 0;
+
+    m_mutex.lock();
+    m_queued.enqueue(buffer);
+    m_frameQueued.wakeOne();
+    m_mutex.unlock();
+}
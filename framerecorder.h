@@ -0,0 +1,94 @@
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
+#include <QFile>
+#include <atomic>
+#include <opencv2/core.hpp>
+
+#include "framelog.h"
+
+class FrameRecorder;
+class FrameLogWriter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameLogWriter(FrameRecorder *recorder, QObject *parent = nullptr);
+
+signals:
+    void workDone();
+
+public slots:
+    void doWork();
+
+private:
+    bool createFile(const cv::Mat &frame);
+    void writeFrame(int buffer);
+    void closeFile();
+
+    FrameRecorder *m_recorder;
+    uchar *m_data;
+    frame_log_header_t *m_header;
+    bool m_createFailed; ///< File could not be created, remaining frames are dropped without retrying
+};
+
+/**
+ * @brief The FrameRecorder class streams raw frames to a frame log.
+ * push() is called from the capture thread and only copies the frame into a free buffer of a fixed pool,
+ * the file is preallocated and mapped by a background thread. Frames are dropped when no buffer is free.
+ */
+class FrameRecorder : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool recording READ recording NOTIFY recordingChanged)
+    Q_PROPERTY(quint32 dropped READ dropped NOTIFY recordingChanged)
+public:
+    explicit FrameRecorder(QObject *parent = nullptr);
+    ~FrameRecorder();
+
+    bool recording() const;
+    quint32 dropped() const;
+
+    /**
+     * @brief push Queues a copy of frame, never blocks on disk
+     */
+    void push(const cv::Mat &frame, qint64 timestamp, quint32 index);
+
+signals:
+    void recordingChanged();
+
+public slots:
+    /**
+     * @brief start Frame geometry is taken from the first pushed frame, capacity is in frames
+     */
+    void start(const QString &fileName, int capacity = 3000);
+    void stop();
+
+private:
+    friend class FrameLogWriter;
+    enum { PoolSize = 16 };
+    typedef struct {
+        cv::Mat image;
+        frame_log_meta_t meta;
+    } buffer_t;
+
+    FrameLogWriter *m_writer;
+    QThread m_writerThread;
+    QFile m_file;
+    int m_capacity;
+    QMutex m_mutex;
+    QWaitCondition m_frameQueued;
+    buffer_t m_pool[PoolSize];
+    QVector<int> m_free;  ///< Pool buffers owned by nobody
+    QQueue<int> m_queued; ///< Pool buffers waiting for the writer
+    std::atomic<bool> m_recording;
+    bool m_stopping;
+    std::atomic<quint32> m_dropped;
+};
+
+#endif // FRAMERECORDER_H
@@ -0,0 +1,185 @@
+#include "gcodeestimator.h"
+#include "gcodeprogram.h"
+#include "gcodemodalstate.h"
+
+#include <math.h>
+#include <vector>
+
+namespace {
+
+struct segment_t {
+    int line;          ///< block index
+    float length;      ///< [mm]
+    float nominal;     ///< [mm/s]
+    float entry;       ///< [mm/s] maximum, then planned
+    float dwell;       ///< [s] spent after the segment before the next one starts
+};
+
+/**
+ * @brief trapezoidTime Time to travel length with entry speed v0, exit speed v1 and cruise speed vmax
+ */
+float trapezoidTime(float length, float v0, float v1, float vmax, float a)
+{
+    if (length <= 0)
+        return 0;
+    if (vmax <= 0)
+        return 0;
+    float accelDistance = (vmax * vmax - v0 * v0) / (2 * a);
+    float decelDistance = (vmax * vmax - v1 * v1) / (2 * a);
+    if (accelDistance + decelDistance <= length)
+        return (vmax - v0) / a + (vmax - v1) / a + (length - accelDistance - decelDistance) / vmax;
+    float peak = sqrtf((2 * a * length + v0 * v0 + v1 * v1) / 2);
+    return (peak - v0) / a + (peak - v1) / a;
+}
+
+} // namespace
+
+GcodeEstimator::GcodeEstimator()
+{
+    m_machine.rapidFeed = 12000;
+    m_machine.defaultFeed = 1000;
+    m_machine.acceleration = 500;
+    m_machine.junctionDeviation = 0.05f;
+}
+
+GcodeEstimator::Machine GcodeEstimator::machine() const
+{
+    return m_machine;
+}
+
+void GcodeEstimator::setMachine(const Machine &machine)
+{
+    m_machine = machine;
+}
+
+GcodeEstimator::Result GcodeEstimator::estimate(const GcodeProgram &program) const
+{
+    Result result;
+
+    const QVector<GcodeBlock> &blocks = program.blocks();
+    const int count = blocks.size();
+    const float a = m_machine.acceleration;
+
+    std::vector<segment_t> segments;
+    segments.reserve(static_cast<size_t>(count));
+    float leadingDwell = 0;
+
+    // Forward pass: geometry, nominal speeds and junction limits
+    GcodeModalState state;
+    float lastUnit[3] = {0, 0, 0};
+    bool stopBeforeNext = true;
+    for (int i = 0; i < count; ++i) {
+        const GcodeBlock &b = blocks[i];
+        state.apply(b);
+        if (b.flags & (GcodeBlock::Pause | GcodeBlock::ProgramEnd | GcodeBlock::Dwell))
+            stopBeforeNext = true;
+        if ((b.flags & GcodeBlock::Dwell) && b.has(GcodeBlock::P)) {
+            if (segments.empty())
+                leadingDwell += b.value(GcodeBlock::P);
+            else
+                segments.back().dwell += b.value(GcodeBlock::P);
+        }
+        if (b.motion == GcodeBlock::NoMotion)
+            continue;
+
+        const float *position = state.lastPosition;
+        const float *target = state.position;
+        float delta[3];
+        for (int axis = 0; axis < 3; ++axis)
+            delta[axis] = target[axis] - position[axis];
+        float chord = sqrtf(delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2]);
+        float length = chord;
+        if (b.motion == GcodeBlock::ArcCW || b.motion == GcodeBlock::ArcCCW) {
+            float ci = b.value(GcodeBlock::I) * state.unitScale();
+            float cj = b.value(GcodeBlock::J) * state.unitScale();
+            float radius = sqrtf(ci * ci + cj * cj);
+            if (radius > 0) {
+                float startAngle = atan2f(-cj, -ci);
+                float endAngle = atan2f(target[1] - position[1] - cj, target[0] - position[0] - ci);
+                float sweep = endAngle - startAngle;
+                if (b.motion == GcodeBlock::ArcCW && sweep >= 0)
+                    sweep -= 2 * static_cast<float>(M_PI);
+                else if (b.motion == GcodeBlock::ArcCCW && sweep <= 0)
+                    sweep += 2 * static_cast<float>(M_PI);
+                float planar = fabsf(sweep) * radius;
+                length = sqrtf(planar * planar + delta[2] * delta[2]);
+            }
+        }
+        if (length <= 0)
+            continue;
+
+        segment_t s;
+        s.line = i;
+        s.length = length;
+        s.dwell = 0;
+        if (b.motion == GcodeBlock::Rapid) {
+            s.nominal = m_machine.rapidFeed / 60.0f;
+            result.rapidLength += length;
+        } else {
+            s.nominal = (state.feed > 0 ? state.feed : m_machine.defaultFeed) / 60.0f;
+            result.cutLength += length;
+        }
+
+        float unit[3] = {0, 0, 0};
+        if (chord > 0) {
+            for (int axis = 0; axis < 3; ++axis)
+                unit[axis] = delta[axis] / chord;
+        }
+        if (stopBeforeNext || segments.empty()) {
+            s.entry = 0;
+        } else {
+            // Junction deviation, see grbl planner.c
+            float cosTheta = -(lastUnit[0] * unit[0] + lastUnit[1] * unit[1] + lastUnit[2] * unit[2]);
+            float limit;
+            if (cosTheta > 0.999999f) {
+                limit = 0;
+            } else if (cosTheta < -0.999999f) {
+                limit = 1e9f;
+            } else {
+                float sinHalfTheta = sqrtf(0.5f * (1.0f - cosTheta));
+                limit = sqrtf(a * m_machine.junctionDeviation * sinHalfTheta / (1.0f - sinHalfTheta));
+            }
+            s.entry = fminf(limit, fminf(s.nominal, segments.back().nominal));
+        }
+        for (int axis = 0; axis < 3; ++axis)
+            lastUnit[axis] = unit[axis];
+        stopBeforeNext = false;
+        segments.push_back(s);
+    }
+
+    // Backward pass: every segment must be able to decelerate to the next entry speed
+    const int n = static_cast<int>(segments.size());
+    float exitSpeed = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        segment_t &s = segments[i];
+        if (s.dwell > 0)
+            exitSpeed = 0;
+        float reachable = sqrtf(exitSpeed * exitSpeed + 2 * a * s.length);
+        if (s.entry > reachable)
+            s.entry = reachable;
+        exitSpeed = s.entry;
+    }
+    // Forward pass: and accelerate from the previous one
+    for (int i = 0; i + 1 < n; ++i) {
+        float reachable = sqrtf(segments[i].entry * segments[i].entry + 2 * a * segments[i].length);
+        if (segments[i + 1].entry > reachable)
+            segments[i + 1].entry = reachable;
+    }
+
+    // Per-line cumulative time
+    result.cumulativeTime.resize(count);
+    float *cumulative = result.cumulativeTime.data();
+    double elapsed = leadingDwell;
+    int line = 0;
+    for (int i = 0; i < n; ++i) {
+        const segment_t &s = segments[i];
+        float v1 = (i + 1 < n && s.dwell == 0) ? segments[i + 1].entry : 0;
+        for (; line < s.line; ++line)
+            cumulative[line] = static_cast<float>(elapsed);
+        elapsed += trapezoidTime(s.length, s.entry, v1, s.nominal, a) + s.dwell;
+    }
+    for (; line < count; ++line)
+        cumulative[line] = static_cast<float>(elapsed);
+    result.duration = elapsed;
+    return result;
+}
@@ -0,0 +1,43 @@
+#ifndef GCODEESTIMATOR_H
+#define GCODEESTIMATOR_H
+
+#include <QVector>
+
+class GcodeProgram;
+
+/**
+ * @brief The GcodeEstimator class computes path lengths and job duration of a parsed program.
+ * Motion is planned the way grbl-like controllers do it: junction speeds are limited by junction deviation,
+ * then backward and forward passes limit them by acceleration, and each segment gets a trapezoidal profile.
+ * Every pass is linear over a compact segment array, so millions of lines take a fraction of a second.
+ */
+class GcodeEstimator
+{
+public:
+    struct Machine {
+        float rapidFeed;         ///< [mm/min] used for G0
+        float defaultFeed;       ///< [mm/min] used for G1/G2/G3 until F word
+        float acceleration;      ///< [mm/s^2]
+        float junctionDeviation; ///< [mm]
+    };
+
+    struct Result {
+        Result() : cutLength(0), rapidLength(0), duration(0) {}
+        double cutLength;              ///< [mm] G1/G2/G3
+        double rapidLength;            ///< [mm] G0
+        double duration;               ///< [s]
+        QVector<float> cumulativeTime; ///< [s] elapsed at the end of each line, index is line number - 1
+    };
+
+    GcodeEstimator();
+
+    Machine machine() const;
+    void setMachine(const Machine &machine);
+
+    Result estimate(const GcodeProgram &program) const;
+
+private:
+    Machine m_machine;
+};
+
+#endif // GCODEESTIMATOR_H
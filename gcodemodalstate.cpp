@@ -0,0 +1,118 @@
+#include "gcodemodalstate.h"
+
+GcodeModalState::GcodeModalState() :
+    inches(false), absolute(true), motion(GcodeBlock::NoMotion),
+    feed(0), power(0), powerKnown(false), laser(LaserOff), knownAxes(0)
+{
+    for (int i = 0; i < 4; ++i) {
+        position[i] = 0;
+        lastPosition[i] = 0;
+    }
+}
+
+void GcodeModalState::apply(const GcodeBlock &block)
+{
+    for (int i = 0; i < 4; ++i)
+        lastPosition[i] = position[i];
+
+    if (block.flags & GcodeBlock::Inches)
+        inches = true;
+    if (block.flags & GcodeBlock::Millimeters)
+        inches = false;
+    if (block.flags & GcodeBlock::Absolute)
+        absolute = true;
+    if (block.flags & GcodeBlock::Relative)
+        absolute = false;
+    if (block.flags & GcodeBlock::LaserOn)
+        laser = LaserOn;
+    if (block.flags & GcodeBlock::LaserDynamic)
+        laser = LaserDynamic;
+    if (block.flags & (GcodeBlock::LaserOff | GcodeBlock::ProgramEnd))
+        laser = LaserOff;
+    if (block.has(GcodeBlock::F) && block.value(GcodeBlock::F) > 0)
+        feed = block.value(GcodeBlock::F) * unitScale();
+    if (block.has(GcodeBlock::S)) {
+        power = block.value(GcodeBlock::S);
+        powerKnown = true;
+    }
+
+    if (block.flags & GcodeBlock::SetPosition) {
+        for (int axis = 0; axis < 4; ++axis) {
+            if (block.has(static_cast<GcodeBlock::Word>(axis))) {
+                float scale = axis < 3 ? unitScale() : 1.0f;
+                position[axis] = block.values[axis] * scale;
+                knownAxes |= 1 << axis;
+            }
+        }
+        return;
+    }
+    if (block.motion == GcodeBlock::NoMotion)
+        return;
+    motion = block.motion;
+    for (int axis = 0; axis < 4; ++axis) {
+        if (!block.has(static_cast<GcodeBlock::Word>(axis)))
+            continue;
+        float scale = axis < 3 ? unitScale() : 1.0f;
+        float v = block.values[axis] * scale;
+        position[axis] = absolute ? v : position[axis] + v;
+        knownAxes |= 1 << axis;
+    }
+}
+
+QList<QByteArray> GcodeModalState::preamble() const
+{
+    static const char axes[] = "XYZB";
+    QList<QByteArray> lines;
+    lines << "G21" << "M5" << "G90";
+
+    // Rapid to the last position: Z and B first, so the XY rapid is not made at whatever height the machine stopped at
+    QByteArray xy = "G0";
+    QByteArray zb = "G0";
+    for (int axis = 0; axis < 4; ++axis) {
+        if (!hasAxis(axis))
+            continue;
+        QByteArray &line = axis < 2 ? xy : zb;
+        line += axes[axis];
+        line += QByteArray::number(position[axis], 'f', 4);
+    }
+    if (zb.size() > 2)
+        lines << zb;
+    if (xy.size() > 2)
+        lines << xy;
+
+    if (inches)
+        lines << "G20";
+    if (!absolute)
+        lines << "G91";
+
+    // G2/G3 are modal too, a resumed arc continuation line may carry only X Y I J
+    QByteArray modal;
+    switch (motion) {
+    case GcodeBlock::Rapid:
+        modal = "G0";
+        break;
+    case GcodeBlock::ArcCW:
+        modal = "G2";
+        break;
+    case GcodeBlock::ArcCCW:
+        modal = "G3";
+        break;
+    default:
+        modal = "G1";
+        break;
+    }
+    if (feed > 0)
+        modal += "F" + QByteArray::number(feed / unitScale(), 'f', 3);
+    if (motion != GcodeBlock::NoMotion || feed > 0)
+        lines << modal;
+
+    if (laser != LaserOff) {
+        QByteArray on = laser == LaserOn ? "M3" : "M4";
+        if (powerKnown)
+            on += "S" + QByteArray::number(power, 'f', 3);
+        lines << on;
+    } else if (powerKnown) {
+        lines << "S" + QByteArray::number(power, 'f', 3);
+    }
+    return lines;
+}
@@ -0,0 +1,48 @@
+#ifndef GCODEMODALSTATE_H
+#define GCODEMODALSTATE_H
+
+#include <QList>
+#include <QByteArray>
+
+#include "gcodeprogram.h"
+
+/**
+ * @brief The GcodeModalState struct tracks machine state while walking GcodeBlock's in program order.
+ * Lengths are kept in millimeters regardless of G20/G21, feed in mm/min.
+ */
+struct GcodeModalState
+{
+    enum Laser : quint8 {
+        LaserOff,
+        LaserOn,     ///< M3
+        LaserDynamic ///< M4
+    };
+
+    GcodeModalState();
+
+    /**
+     * @brief apply Updates state with block, previous position is left in lastPosition
+     */
+    void apply(const GcodeBlock &block);
+
+    /**
+     * @brief preamble Minimal commands that bring a machine to this state, for resuming a program
+     */
+    QList<QByteArray> preamble() const;
+
+    float unitScale() const { return inches ? 25.4f : 1.0f; }
+    bool hasAxis(int axis) const { return knownAxes & (1 << axis); }
+
+    bool inches;
+    bool absolute;
+    quint8 motion;       ///< GcodeBlock::Motion
+    float feed;          ///< [mm/min], 0 if not yet set
+    float power;         ///< S word
+    bool powerKnown;
+    Laser laser;
+    float position[4];   ///< x, y, z, b
+    float lastPosition[4];
+    quint8 knownAxes;    ///< Axes that were set by the program
+};
+
+#endif // GCODEMODALSTATE_H
@@ -6,6 +6,8 @@
 #include <QDebug>
 
 #include "gcodeplayer.h"
+#include "gcodemodalstate.h"
+#include "sessionrecorder.h"
 
 GcodePlayer::GcodePlayer(QObject *parent) : QObject(parent)
 {
@@ -14,6 +16,8 @@ GcodePlayer::GcodePlayer(QObject *parent) : QObject(parent)
     m_linesCount = 0;
     m_state = Stopped;
 
+    m_mcHost = "192.168.88.77";
+    m_mcPort = 23;
     m_tcp = new QTcpSocket(this);
     m_connectionState = Disconnected;
     emit connectionStateChanged();
@@ -24,6 +28,10 @@ GcodePlayer::GcodePlayer(QObject *parent) : QObject(parent)
     connect(m_tcp, &QIODevice::readyRead,
             this,  &GcodePlayer::onMCResponse);
     m_querySent = false;
+    m_preambleSent = false;
+    m_resumeLine = 0;
+    m_recorder = nullptr;
+    m_replay = false;
 }
 
 void GcodePlayer::registerQmlTypes()
@@ -36,6 +44,11 @@ GcodePlayerModel *GcodePlayer::model() const
     return m_model;
 }
 
+const GcodeProgram &GcodePlayer::program() const
+{
+    return m_program;
+}
+
 void GcodePlayer::loadFile(const QUrl &fileUrl)
 {
     if (m_state == Playing || m_state == Paused) {
@@ -54,18 +67,22 @@ void GcodePlayer::loadFile(const QUrl &fileUrl)
         qWarning() << "Can't open" << fileName << f.errorString();
         return;
     }
-    int lineNumber = 1;
-    while (!f.atEnd()) {
-        QString code = QString::fromLocal8Bit(f.readLine());
-        m_model->addItem(GcodePlayerItem(GcodePlayerItem::Pending, lineNumber, code));
+    m_program.parse(f.readAll());
 
-        lineNumber++;
-    }
+    QList<GcodePlayerItem> items;
+    items.reserve(m_program.blocksCount());
+    for (int i = 0; i < m_program.blocksCount(); ++i)
+        items.append(GcodePlayerItem(GcodePlayerItem::Pending, i + 1, QString::fromLocal8Bit(m_program.sourceLine(i))));
+    m_model->setItems(items);
+    m_estimate = m_estimator.estimate(m_program);
+    qDebug() << "Estimated duration" << m_estimate.duration << "s, cut" << m_estimate.cutLength << "mm, rapid" << m_estimate.rapidLength << "mm";
+    emit statisticsChanged();
 
     m_currentLineNumber = 1;
-    emit currentLineChanged();
-    m_linesCount = lineNumber - 1;
+    m_linesCount = m_program.blocksCount();
     emit linesCountChanged();
+    // progress and remainingTime notify through currentLineChanged, emit it once the new estimate and count are in
+    emit currentLineChanged();
     m_state = Stopped;
     emit stateChanged();
 }
@@ -85,6 +102,36 @@ int GcodePlayer::linesCount() const
     return m_linesCount;
 }
 
+double GcodePlayer::estimatedDuration() const
+{
+    return m_estimate.duration;
+}
+
+double GcodePlayer::cutLength() const
+{
+    return m_estimate.cutLength;
+}
+
+double GcodePlayer::rapidLength() const
+{
+    return m_estimate.rapidLength;
+}
+
+double GcodePlayer::progress() const
+{
+    if (m_estimate.duration <= 0)
+        return m_linesCount > 0 ? double(m_currentLineNumber - 1) / m_linesCount : 0;
+    int done = m_currentLineNumber - 2; // time at the end of the last completed line
+    if (done < 0 || done >= m_estimate.cumulativeTime.size())
+        return 0;
+    return m_estimate.cumulativeTime[done] / m_estimate.duration;
+}
+
+double GcodePlayer::remainingTime() const
+{
+    return m_estimate.duration * (1.0 - progress());
+}
+
 GcodePlayer::State GcodePlayer::state() const
 {
     return m_state;
@@ -95,17 +142,64 @@ GcodePlayer::ConnectionState GcodePlayer::connectionState() const
     return m_connectionState;
 }
 
+QString GcodePlayer::mcHost() const
+{
+    return m_mcHost;
+}
+
+void GcodePlayer::setMcHost(const QString &host)
+{
+    m_mcHost = host;
+}
+
+quint16 GcodePlayer::mcPort() const
+{
+    return m_mcPort;
+}
+
+void GcodePlayer::setMcPort(quint16 port)
+{
+    m_mcPort = port;
+}
+
+void GcodePlayer::setSessionRecorder(SessionRecorder *recorder)
+{
+    m_recorder = recorder;
+}
+
+void GcodePlayer::setReplayMode(bool replay)
+{
+    if (replay == m_replay)
+        return;
+    m_replay = replay;
+    m_tcp->abort();
+    m_connectionState = replay ? Connected : Disconnected;
+    emit connectionStateChanged(replay);
+    emit connectionStateChanged();
+}
+
+void GcodePlayer::injectResponse(const QString &line)
+{
+    processMCResponse(line);
+}
+
 void GcodePlayer::send(const QString &command)
 {
     if (m_connectionState != Disconnected) {
-        m_tcp->write(command.toLocal8Bit());
+        QByteArray bytes = command.toLocal8Bit();
+        if (!m_replay)
+            m_tcp->write(bytes);
+        if (m_recorder)
+            m_recorder->record(SESSION_MC_LINE_SENT, bytes.constData(), static_cast<quint32>(bytes.size()));
     }
 }
 
 void GcodePlayer::connectToMC()
 {
+    if (m_replay)
+        return;
     if (m_connectionState == Disconnected) {
-        m_tcp->connectToHost("192.168.88.77", 23);
+        m_tcp->connectToHost(m_mcHost, m_mcPort);
         QTimer::singleShot(2000, [=](){
             if (this->m_connectionState != Connected)
                 this->m_tcp->abort();
@@ -115,21 +209,23 @@ void GcodePlayer::connectToMC()
 
 void GcodePlayer::play()
 {
+    // Play wins over a resume still waiting for its ack
+    m_resumeLine = 0;
     if (m_state == Stopped) {
         if (m_linesCount > 0) {
             m_currentLineNumber = 1;
             emit currentLineChanged();
             m_model->changeAllStates(GcodePlayerItem::Pending);
-            sendNextLine();
             m_state = Playing;
             emit stateChanged();
+            sendNextLine();
         } else {
             qWarning() << "Nothing to play";
         }
     } else if (m_state == Paused) {
-        sendNextLine();
         m_state = Playing;
         emit stateChanged();
+        sendNextLine();
     } else {
         qWarning() << "Can't play from state" << m_state;
     }
@@ -144,7 +240,46 @@ void GcodePlayer::pause()
 void GcodePlayer::stop()
 {
     m_state = Stopped;
+    m_preamble.clear();
+    // An ack still on its way is for a line or preamble command nobody waits for anymore
+    m_querySent = false;
+    m_preambleSent = false;
+    m_resumeLine = 0;
+    emit stateChanged();
+}
+
+void GcodePlayer::resumeFrom(int lineNumber)
+{
+    if (m_state == Playing) {
+        qWarning() << "Can't resume while playing";
+        m_resumeLine = 0;
+        return;
+    }
+    if (lineNumber < 1 || lineNumber > m_linesCount) {
+        qWarning() << "Line" << lineNumber << "is out of range";
+        m_resumeLine = 0;
+        return;
+    }
+    if (m_querySent) {
+        // Ack of the line sent before pausing must not be taken for the first preamble ack
+        qDebug() << "Resume from line" << lineNumber << "waits for the outstanding ack";
+        m_resumeLine = lineNumber;
+        return;
+    }
+    m_resumeLine = 0;
+    GcodeModalState modalState;
+    const QVector<GcodeBlock> &blocks = m_program.blocks();
+    for (int i = 0; i < lineNumber - 1; ++i)
+        modalState.apply(blocks[i]);
+    m_preamble = modalState.preamble();
+    qDebug() << "Resuming from line" << lineNumber << "with preamble" << m_preamble;
+
+    m_model->changeAllStates(GcodePlayerItem::Pending);
+    m_currentLineNumber = lineNumber;
+    emit currentLineChanged();
+    m_state = Playing;
     emit stateChanged();
+    sendNextLine();
 }
 
 void GcodePlayer::onSocketStateChanged(QAbstractSocket::SocketState state)
@@ -208,14 +343,65 @@ void GcodePlayer::onMCResponse()
 
 void GcodePlayer::sendNextLine()
 {
-    GcodePlayerItem line = m_model->getItem(m_currentLineNumber - 1);
-    m_tcp->write(line.m_code.toLocal8Bit());
+    if (!m_preamble.isEmpty()) {
+        const QByteArray &command = m_preamble.first();
+        writeLine(command.constData(), command.size());
+        m_querySent = true;
+        m_preambleSent = true;
+        return;
+    }
+    // Blank and comment-only lines are not sent
+    bool skipped = false;
+    while (m_currentLineNumber <= m_linesCount && m_program.block(m_currentLineNumber - 1).isEmpty()) {
+        GcodePlayerItem item = m_model->getItem(m_currentLineNumber - 1);
+        item.m_status = GcodePlayerItem::Ok;
+        m_model->replaceItem(m_currentLineNumber - 1, item);
+        m_currentLineNumber++;
+        skipped = true;
+    }
+    if (m_currentLineNumber > m_linesCount) {
+        m_state = Stopped;
+        emit stateChanged();
+        return;
+    }
+    if (skipped)
+        emit currentLineChanged();
+    const GcodeBlock &block = m_program.block(m_currentLineNumber - 1);
+    writeLine(m_program.codeData(m_currentLineNumber - 1), block.codeLength);
     m_querySent = true;
 }
 
+void GcodePlayer::writeLine(const char *data, int size)
+{
+    if (!m_replay) {
+        m_tcp->write(data, size);
+        m_tcp->write("\n", 1);
+    }
+    if (m_recorder)
+        m_recorder->record(SESSION_MC_LINE_SENT, data, static_cast<quint32>(size));
+}
+
 void GcodePlayer::processMCResponse(const QString &line)
 {
-    if (m_querySent) {
+    if (m_recorder) {
+        QByteArray bytes = line.toLocal8Bit();
+        m_recorder->record(SESSION_MC_RESPONSE, bytes.constData(), static_cast<quint32>(bytes.size()));
+    }
+    if (m_querySent && m_preambleSent && !m_preamble.isEmpty()) {
+        qDebug() << "mc preamble:" << m_preamble.first() << line;
+        m_querySent = false;
+        m_preambleSent = false;
+        m_preamble.removeFirst();
+        if (line != "ok") {
+            qWarning() << "Preamble command failed, stopping";
+            m_preamble.clear();
+            m_state = Error;
+            emit stateChanged();
+            return;
+        }
+        if (m_state == Playing)
+            sendNextLine();
+    } else if (m_querySent) {
         qDebug() << "mc q:" << line;
         m_querySent = false;
 
@@ -237,7 +423,10 @@ void GcodePlayer::processMCResponse(const QString &line)
             if (m_state == Playing)
                 sendNextLine();
         }
+        if (m_resumeLine > 0)
+            resumeFrom(m_resumeLine);
     } else {
         qDebug() << "mc:" << line;
+        emit responseReceived(line);
     }
 }
@@ -4,6 +4,10 @@
 #include <QObject>
 #include <QTcpSocket>
 #include "gcodeplayermodel.h"
+#include "gcodeprogram.h"
+#include "gcodeestimator.h"
+
+class SessionRecorder;
 
 class GcodePlayer : public QObject
 {
@@ -13,6 +17,14 @@ class GcodePlayer : public QObject
     Q_PROPERTY(int linesCount READ linesCount NOTIFY linesCountChanged)
     Q_PROPERTY(State state READ state NOTIFY stateChanged);
     Q_PROPERTY(ConnectionState connectionState READ connectionState NOTIFY connectionStateChanged)
+    Q_PROPERTY(double estimatedDuration READ estimatedDuration NOTIFY statisticsChanged)
+    Q_PROPERTY(double cutLength READ cutLength NOTIFY statisticsChanged)
+    Q_PROPERTY(double rapidLength READ rapidLength NOTIFY statisticsChanged)
+    // Also re-notified by loadFile() after statisticsChanged()
+    Q_PROPERTY(double progress READ progress NOTIFY currentLineChanged)
+    Q_PROPERTY(double remainingTime READ remainingTime NOTIFY currentLineChanged)
+    Q_PROPERTY(QString mcHost READ mcHost WRITE setMcHost)
+    Q_PROPERTY(quint16 mcPort READ mcPort WRITE setMcPort)
 
 public:
     explicit GcodePlayer(QObject *parent = nullptr);
@@ -35,6 +47,7 @@ public:
     static void registerQmlTypes();
 
     GcodePlayerModel *model() const;
+    const GcodeProgram &program() const;
     Q_INVOKABLE void loadFile(const QUrl &fileUrl);
 
     int currentLineNumber() const;
@@ -42,17 +55,47 @@ public:
 
     int linesCount() const;
 
+    /**
+     * @brief estimatedDuration Job duration [s] estimated when file was loaded
+     */
+    double estimatedDuration() const;
+    double cutLength() const;
+    double rapidLength() const;
+    /**
+     * @brief progress Estimated fraction of job time spent before current line, 0..1
+     */
+    double progress() const;
+    double remainingTime() const;
+
     State state() const;
     ConnectionState connectionState() const;
 
+    QString mcHost() const;
+    void setMcHost(const QString &host);
+    quint16 mcPort() const;
+    void setMcPort(quint16 port);
+    /**
+     * @brief setSessionRecorder Lines sent to and responses received from MC are written to recorder
+     */
+    void setSessionRecorder(SessionRecorder *recorder);
+    /**
+     * @brief setReplayMode Detaches from MC, lines are not sent and responses come from injectResponse()
+     */
+    void setReplayMode(bool replay);
+    void injectResponse(const QString &line);
 
 
 signals:
     void currentLineChanged();
     void linesCountChanged();
+    void statisticsChanged();
     void stateChanged();
     void connectionStateChanged();
     void connectionStateChanged(bool connected);
+    /**
+     * @brief responseReceived MC line that is not an ack of a played line, e.g. for commands given with send()
+     */
+    void responseReceived(const QString &line);
 
 
 public slots:
@@ -60,6 +103,10 @@ public slots:
     void play();
     void pause();
     void stop();
+    /**
+     * @brief resumeFrom Restores modal state of lines before lineNumber and continues playing from it
+     */
+    void resumeFrom(int lineNumber);
     void send(const QString &command);
 
 private slots:
@@ -70,15 +117,26 @@ private slots:
 private:
     void sendNextLine();
     void processMCResponse(const QString &line);
+    void writeLine(const char *data, int size);
 
     GcodePlayerModel *m_model;
+    GcodeProgram m_program;
+    GcodeEstimator m_estimator;
+    GcodeEstimator::Result m_estimate;
     int m_currentLineNumber;
     int m_linesCount;
     State m_state;
     ConnectionState m_connectionState;
     QTcpSocket *m_tcp;
+    QString m_mcHost;
+    quint16 m_mcPort;
     QString m_tcpLine;
     bool m_querySent;
+    QList<QByteArray> m_preamble;
+    bool m_preambleSent;
+    int m_resumeLine; ///< resumeFrom() deferred until the pending line ack arrives, 0 if none
+    SessionRecorder *m_recorder;
+    bool m_replay;
 };
 
 #endif // GCODEPLAYER_H
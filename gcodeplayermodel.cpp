@@ -54,6 +54,13 @@ void GcodePlayerModel::addItem(const GcodePlayerItem &item)
     endInsertRows();
 }
 
+void GcodePlayerModel::setItems(const QList<GcodePlayerItem> &items)
+{
+    beginResetModel();
+    m_items = items;
+    endResetModel();
+}
+
 GcodePlayerItem GcodePlayerModel::getItem(int index)
 {
     if (index < 0 || index >= m_items.length())
@@ -24,6 +24,7 @@ public:
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
     void addItem(const GcodePlayerItem &item);
+    void setItems(const QList<GcodePlayerItem> &items);
     GcodePlayerItem getItem(int index);
     void replaceItem(int index, const GcodePlayerItem &item);
     void changeAllStates(GcodePlayerItem::Status to);
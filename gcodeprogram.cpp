@@ -0,0 +1,239 @@
+#include "gcodeprogram.h"
+
+#include <string.h>
+
+namespace {
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * @brief parseNumber Parses [+-]digits[.digits], skips whitespace inside, advances p past the number
+ */
+bool parseNumber(const char *&p, const char *end, float &value)
+{
+    while (p < end && isSpace(*p))
+        p++;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    double integral = 0;
+    double fraction = 0;
+    double scale = 1;
+    bool digits = false;
+    while (p < end && isDigit(*p)) {
+        integral = integral * 10 + (*p - '0');
+        digits = true;
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && isDigit(*p)) {
+            fraction = fraction * 10 + (*p - '0');
+            scale *= 10;
+            digits = true;
+            p++;
+        }
+    }
+    double v = integral + fraction / scale;
+    value = static_cast<float>(negative ? -v : v);
+    return digits;
+}
+
+} // namespace
+
+GcodeProgram::GcodeProgram() :
+    m_modalMotion(GcodeBlock::NoMotion)
+{
+}
+
+void GcodeProgram::parse(const QByteArray &source)
+{
+    clear();
+    m_source = source;
+    m_code.reserve(source.size());
+
+    const char *data = m_source.constData();
+    const char *end = data + m_source.size();
+    m_blocks.reserve(m_source.count('\n') + 1);
+    const char *line = data;
+    while (line < end) {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+        const char *lineEnd = eol ? eol : end;
+        const char *trimmedEnd = lineEnd;
+        if (trimmedEnd > line && trimmedEnd[-1] == '\r')
+            trimmedEnd--;
+
+        GcodeBlock block;
+        block.sourceOffset = static_cast<quint32>(line - data);
+        block.sourceLength = static_cast<quint32>(trimmedEnd - line);
+        parseLine(line, trimmedEnd, block);
+        m_blocks.append(block);
+
+        line = eol ? eol + 1 : end;
+    }
+    m_code.squeeze();
+}
+
+void GcodeProgram::clear()
+{
+    m_source.clear();
+    m_code.clear();
+    m_blocks.clear();
+    m_modalMotion = GcodeBlock::NoMotion;
+}
+
+void GcodeProgram::parseLine(const char *begin, const char *end, GcodeBlock &block)
+{
+    block.codeOffset = static_cast<quint32>(m_code.size());
+    block.codeLength = 0;
+    block.motion = GcodeBlock::NoMotion;
+    block.flags = 0;
+    block.words = 0;
+    memset(block.values, 0, sizeof(block.values));
+
+    // $H, $X, $J=... are not G-code words and must reach the controller exactly as written
+    const char *first = begin;
+    while (first < end && isSpace(*first))
+        first++;
+    if (first < end && (*first == '$' || *first == '%')) {
+        appendVerbatim(first, end, block);
+        return;
+    }
+
+    bool motionWord = false;
+    bool text = false;
+    const char *p = begin;
+    while (p < end) {
+        char c = *p;
+        if (c == ';')
+            break;
+        if (c == '(') {
+            const char *close = static_cast<const char *>(memchr(p, ')', end - p));
+            p = close ? close + 1 : end;
+            continue;
+        }
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        if (c < 'A' || c > 'Z') {
+            text = text || !isSpace(c);
+            p++;
+            continue;
+        }
+        p++;
+        const char *numberBegin = p;
+        float value = 0;
+        if (!parseNumber(p, end, value))
+            continue;
+        m_code.append(c);
+        for (const char *n = numberBegin; n < p; ++n) {
+            if (!isSpace(*n))
+                m_code.append(*n);
+        }
+
+        int number = static_cast<int>(value);
+        switch (c) {
+        case 'G':
+            switch (number) {
+            case 0: case 1: case 2: case 3:
+                m_modalMotion = static_cast<quint8>(GcodeBlock::Rapid + number);
+                motionWord = true;
+                break;
+            case 4:  block.flags |= GcodeBlock::Dwell; break;
+            case 20: block.flags |= GcodeBlock::Inches; break;
+            case 21: block.flags |= GcodeBlock::Millimeters; break;
+            case 90: block.flags |= GcodeBlock::Absolute; break;
+            case 91: block.flags |= GcodeBlock::Relative; break;
+            case 92: block.flags |= GcodeBlock::SetPosition; break;
+            default: block.flags |= GcodeBlock::Unknown; break;
+            }
+            break;
+        case 'M':
+            switch (number) {
+            case 0: case 1: block.flags |= GcodeBlock::Pause; break;
+            case 2: case 30: block.flags |= GcodeBlock::ProgramEnd; break;
+            case 3:  block.flags |= GcodeBlock::LaserOn; break;
+            case 4:  block.flags |= GcodeBlock::LaserDynamic; break;
+            case 5:  block.flags |= GcodeBlock::LaserOff; break;
+            case 24: block.flags |= GcodeBlock::Resume; break;
+            default: block.flags |= GcodeBlock::Unknown; break;
+            }
+            break;
+        default: {
+            static const char letters[] = "XYZBIJFSP";
+            const char *w = static_cast<const char *>(memchr(letters, c, GcodeBlock::WordsCount));
+            if (w) {
+                int word = static_cast<int>(w - letters);
+                block.words |= 1 << word;
+                block.values[word] = value;
+            }
+            break;
+        }
+        }
+    }
+    block.codeLength = static_cast<quint16>(m_code.size() - static_cast<int>(block.codeOffset));
+    if (block.codeLength == 0 && text) {
+        appendVerbatim(first, end, block);
+        return;
+    }
+    // G92 and G4 take axis and P words without moving
+    if (!(block.flags & (GcodeBlock::SetPosition | GcodeBlock::Dwell)) && (motionWord || block.hasAxes()))
+        block.motion = m_modalMotion;
+}
+
+void GcodeProgram::appendVerbatim(const char *begin, const char *end, GcodeBlock &block)
+{
+    while (end > begin && isSpace(end[-1]))
+        end--;
+    m_code.truncate(static_cast<int>(block.codeOffset));
+    m_code.append(begin, static_cast<int>(end - begin));
+    block.codeLength = static_cast<quint16>(end - begin);
+    block.flags = GcodeBlock::Verbatim;
+    block.words = 0;
+}
+
+int GcodeProgram::blocksCount() const
+{
+    return m_blocks.size();
+}
+
+const GcodeBlock &GcodeProgram::block(int index) const
+{
+    return m_blocks.at(index);
+}
+
+const QVector<GcodeBlock> &GcodeProgram::blocks() const
+{
+    return m_blocks;
+}
+
+const char *GcodeProgram::codeData(int index) const
+{
+    return m_code.constData() + m_blocks.at(index).codeOffset;
+}
+
+QByteArray GcodeProgram::code(int index) const
+{
+    const GcodeBlock &b = m_blocks.at(index);
+    return m_code.mid(static_cast<int>(b.codeOffset), b.codeLength);
+}
+
+QByteArray GcodeProgram::sourceLine(int index) const
+{
+    const GcodeBlock &b = m_blocks.at(index);
+    return m_source.mid(static_cast<int>(b.sourceOffset), static_cast<int>(b.sourceLength));
+}
+
+const QByteArray &GcodeProgram::source() const
+{
+    return m_source;
+}
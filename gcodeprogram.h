@@ -0,0 +1,92 @@
+#ifndef GCODEPROGRAM_H
+#define GCODEPROGRAM_H
+
+#include <QByteArray>
+#include <QVector>
+
+/**
+ * @brief The GcodeBlock struct is a pre-tokenized source line.
+ * Motion is already resolved against modal G0/G1/G2/G3, so consumers don't need to track it.
+ */
+struct GcodeBlock
+{
+    enum Motion : quint8 {
+        NoMotion,
+        Rapid,   ///< G0
+        Linear,  ///< G1
+        ArcCW,   ///< G2
+        ArcCCW   ///< G3
+    };
+
+    enum Flag : quint16 {
+        Absolute    = 1 << 0,  ///< G90
+        Relative    = 1 << 1,  ///< G91
+        Inches      = 1 << 2,  ///< G20
+        Millimeters = 1 << 3,  ///< G21
+        Dwell       = 1 << 4,  ///< G4
+        SetPosition = 1 << 5,  ///< G92
+        LaserOn     = 1 << 6,  ///< M3
+        LaserDynamic= 1 << 7,  ///< M4
+        LaserOff    = 1 << 8,  ///< M5
+        Pause       = 1 << 9,  ///< M0, M1
+        Resume      = 1 << 10, ///< M24
+        ProgramEnd  = 1 << 11, ///< M2, M30
+        Unknown     = 1 << 12, ///< Any other G or M code
+        Verbatim    = 1 << 13  ///< $ system command, % or other text without words, kept as written
+    };
+
+    enum Word {
+        X, Y, Z, B, I, J, F, S, P,
+        WordsCount
+    };
+
+    bool isEmpty() const { return codeLength == 0; }
+    bool has(Word word) const { return words & (1 << word); }
+    float value(Word word) const { return values[word]; }
+    bool hasAxes() const { return words & ((1 << X) | (1 << Y) | (1 << Z) | (1 << B)); }
+
+    quint32 sourceOffset; ///< Line span in the original file bytes, without line ending
+    quint32 sourceLength;
+    quint32 codeOffset;   ///< Command without comments and whitespace in GcodeProgram::codeData()
+    quint16 codeLength;
+    quint8 motion;
+    quint16 flags;
+    quint16 words;        ///< Bitmask of present words, see Word
+    float values[WordsCount];
+};
+
+/**
+ * @brief The GcodeProgram class parses a program once into GcodeBlock's, one block per source line.
+ * Line number is block index + 1.
+ */
+class GcodeProgram
+{
+public:
+    GcodeProgram();
+
+    void parse(const QByteArray &source);
+    void clear();
+
+    int blocksCount() const;
+    const GcodeBlock &block(int index) const;
+    const QVector<GcodeBlock> &blocks() const;
+
+    /**
+     * @brief codeData Stripped command of the block, not null terminated, see GcodeBlock::codeLength
+     */
+    const char *codeData(int index) const;
+    QByteArray code(int index) const;
+    QByteArray sourceLine(int index) const;
+    const QByteArray &source() const;
+
+private:
+    void parseLine(const char *begin, const char *end, GcodeBlock &block);
+    void appendVerbatim(const char *begin, const char *end, GcodeBlock &block);
+
+    QByteArray m_source;
+    QByteArray m_code;
+    QVector<GcodeBlock> m_blocks;
+    quint8 m_modalMotion;
+};
+
+#endif // GCODEPROGRAM_H
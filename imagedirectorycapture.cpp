@@ -0,0 +1,89 @@
+#include "imagedirectorycapture.h"
+
+#include <QDir>
+#include <QCollator>
+#include <algorithm>
+#include <opencv2/imgcodecs.hpp>
+
+ImageDirectoryCapture::ImageDirectoryCapture(const QString &path, double fps) :
+    m_position(-1), m_fps(fps > 0 ? fps : 10)
+{
+    QDir dir(path);
+    QStringList names = dir.entryList(QStringList() << "*.png" << "*.jpg" << "*.jpeg" << "*.bmp" << "*.tif" << "*.tiff",
+                                      QDir::Files);
+    // frame2.png before frame10.png
+    QCollator collator;
+    collator.setNumericMode(true);
+    std::sort(names.begin(), names.end(), [&collator](const QString &a, const QString &b) {
+        return collator.compare(a, b) < 0;
+    });
+    for (const QString &name : names)
+        m_files.append(dir.filePath(name));
+}
+
+bool ImageDirectoryCapture::isOpened() const
+{
+    return !m_files.isEmpty();
+}
+
+void ImageDirectoryCapture::release()
+{
+    m_files.clear();
+    m_position = -1;
+}
+
+bool ImageDirectoryCapture::grab()
+{
+    if (m_position + 1 >= m_files.size())
+        return false;
+    m_position++;
+    return true;
+}
+
+bool ImageDirectoryCapture::retrieve(cv::OutputArray image, int flag)
+{
+    Q_UNUSED(flag);
+    if (m_position < 0 || m_position >= m_files.size()) {
+        image.release();
+        return false;
+    }
+    cv::Mat decoded = cv::imread(m_files[m_position].toStdString(), cv::IMREAD_COLOR);
+    decoded.copyTo(image);
+    return !decoded.empty();
+}
+
+bool ImageDirectoryCapture::read(cv::OutputArray image)
+{
+    if (!grab()) {
+        image.release();
+        return false;
+    }
+    return retrieve(image);
+}
+
+bool ImageDirectoryCapture::set(int propId, double value)
+{
+    if (propId == cv::CAP_PROP_FPS && value > 0) {
+        m_fps = value;
+        return true;
+    }
+    if (propId == cv::CAP_PROP_POS_FRAMES) {
+        m_position = static_cast<int>(value) - 1;
+        return true;
+    }
+    return false;
+}
+
+double ImageDirectoryCapture::get(int propId) const
+{
+    switch (propId) {
+    case cv::CAP_PROP_FRAME_COUNT:
+        return m_files.size();
+    case cv::CAP_PROP_FPS:
+        return m_fps;
+    case cv::CAP_PROP_POS_FRAMES:
+        return m_position + 1;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef IMAGEDIRECTORYCAPTURE_H
+#define IMAGEDIRECTORYCAPTURE_H
+
+#include <QStringList>
+#include <opencv2/videoio.hpp>
+
+/**
+ * @brief The ImageDirectoryCapture class plays images of a directory in name order through the cv::VideoCapture interface
+ */
+class ImageDirectoryCapture : public cv::VideoCapture
+{
+public:
+    ImageDirectoryCapture(const QString &path, double fps);
+
+    bool isOpened() const override;
+    void release() override;
+    bool grab() override;
+    bool retrieve(cv::OutputArray image, int flag = 0) override;
+    bool read(cv::OutputArray image) override;
+    bool set(int propId, double value) override;
+    double get(int propId) const override;
+
+private:
+    QStringList m_files;
+    int m_position; ///< Index of the grabbed image, -1 before first grab()
+    double m_fps;
+};
+
+#endif // IMAGEDIRECTORYCAPTURE_H
@@ -0,0 +1,269 @@
+#include "lasercalibrator.h"
+#include "linedetector.h"
+#include "gcodeplayer.h"
+
+#include <QDebug>
+#include <algorithm>
+
+LaserCalibrator::LaserCalibrator(LineDetector *lineDetector, GcodePlayer *player, const QString &fileName, QObject *parent) :
+    QObject(parent), m_lineDetector(lineDetector), m_player(player), m_fileName(fileName),
+    m_running(false), m_relative(false), m_awaitingAck(false), m_moveQueued(false), m_measuring(false),
+    m_step(0), m_offset(0),
+    m_axis("Z"), m_range(3), m_steps(13), m_samplesPerStep(10)
+{
+    m_ackTimer = new QTimer(this);
+    m_ackTimer->setSingleShot(true);
+    m_ackTimer->setInterval(10000);
+    connect(m_ackTimer, &QTimer::timeout,
+            this,       &LaserCalibrator::onAckTimeout);
+    m_measureTimer = new QTimer(this);
+    m_measureTimer->setSingleShot(true);
+    m_measureTimer->setInterval(3000);
+    connect(m_measureTimer, &QTimer::timeout,
+            this,           &LaserCalibrator::onMeasureTimeout);
+    connect(m_lineDetector, &LineDetector::lineMeasured,
+            this,           &LaserCalibrator::onLineMeasured);
+    connect(m_player,       &GcodePlayer::responseReceived,
+            this,           &LaserCalibrator::onMcResponse);
+    connect(m_player,       QOverload<bool>::of(&GcodePlayer::connectionStateChanged),
+            this,           &LaserCalibrator::onMcConnectionChanged);
+}
+
+bool LaserCalibrator::load()
+{
+    LaserPlane plane;
+    if (!plane.load(m_fileName))
+        return false;
+    m_plane = plane;
+    m_lineDetector->setLaserPlane(m_plane);
+    qDebug() << "Laser plane loaded from" << m_fileName << "rms" << m_plane.rms() << "mm";
+    emit calibrated();
+    return true;
+}
+
+void LaserCalibrator::start()
+{
+    if (m_running || m_steps < 3)
+        return;
+    // A playing program would continue in relative mode and take our oks for its line acks
+    if (m_player->state() != GcodePlayer::Stopped) {
+        setMessage("Stop the program first");
+        return;
+    }
+    if (m_player->connectionState() != GcodePlayer::Connected) {
+        setMessage("MC not connected");
+        return;
+    }
+    m_running = true;
+    emit runningChanged();
+    m_samples.clear();
+    m_step = 0;
+    m_offset = 0;
+    m_relative = false;
+    emit progressChanged();
+    setMessage("Moving to start");
+    sendCommand("G91\n");
+}
+
+void LaserCalibrator::cancel()
+{
+    if (!m_running)
+        return;
+    setMessage("Cancelled");
+    finish(false);
+}
+
+void LaserCalibrator::onMcResponse(const QString &line)
+{
+    if (!m_running || !m_awaitingAck)
+        return;
+    m_awaitingAck = false;
+    m_ackTimer->stop();
+    if (line != "ok") {
+        setMessage(QString("MC: %1").arg(line));
+        finish(false);
+        return;
+    }
+    if (!m_relative) {
+        m_relative = true;
+        moveBy(-m_range);
+        return;
+    }
+    // ok of a move only means it was queued in the planner, ok of a dwell comes once the planner has drained
+    if (m_moveQueued) {
+        m_moveQueued = false;
+        sendCommand("G4 P0\n");
+        return;
+    }
+    // Axis is at rest, median of the step's samples rejects frames taken while it still rings
+    m_positions.clear();
+    m_measuring = true;
+    m_measureTimer->start();
+}
+
+void LaserCalibrator::onMcConnectionChanged(bool connected)
+{
+    if (connected || !m_running)
+        return;
+    setMessage("MC disconnected");
+    finish(false);
+}
+
+void LaserCalibrator::onAckTimeout()
+{
+    if (!m_awaitingAck)
+        return;
+    setMessage("No ack from MC");
+    finish(false);
+}
+
+void LaserCalibrator::onLineMeasured(float position)
+{
+    if (!m_measuring)
+        return;
+    m_positions.push_back(position);
+    if (static_cast<int>(m_positions.size()) >= m_samplesPerStep)
+        finishStep();
+}
+
+void LaserCalibrator::onMeasureTimeout()
+{
+    if (!m_measuring)
+        return;
+    setMessage(QString("No line at %1%2").arg(m_axis).arg(m_offset));
+    finish(false);
+}
+
+void LaserCalibrator::sendCommand(const QString &command)
+{
+    m_awaitingAck = true;
+    m_ackTimer->start();
+    m_player->send(command);
+}
+
+void LaserCalibrator::moveBy(float delta)
+{
+    m_offset += delta;
+    m_moveQueued = true;
+    sendCommand(QString("G0 %1%2\n").arg(m_axis).arg(delta));
+}
+
+void LaserCalibrator::finishStep()
+{
+    m_measuring = false;
+    m_measureTimer->stop();
+    std::nth_element(m_positions.begin(), m_positions.begin() + m_positions.size() / 2, m_positions.end());
+    LaserPlane::sample_t sample;
+    sample.dz = m_offset;
+    sample.position = m_positions[m_positions.size() / 2];
+    m_samples.push_back(sample);
+    m_step++;
+    emit progressChanged();
+    if (m_step < m_steps) {
+        setMessage(QString("Step %1/%2").arg(m_step + 1).arg(m_steps));
+        moveBy(2 * m_range / (m_steps - 1));
+    } else {
+        finish(true);
+    }
+}
+
+void LaserCalibrator::finish(bool fitPlane)
+{
+    m_ackTimer->stop();
+    m_measureTimer->stop();
+    m_awaitingAck = false;
+    m_moveQueued = false;
+    m_measuring = false;
+    // Return to where calibration started and restore absolute positioning, acks are not waited for
+    if (m_relative && m_offset != 0)
+        m_player->send(QString("G0 %1%2\n").arg(m_axis).arg(-m_offset));
+    m_player->send("G90\n");
+    m_offset = 0;
+    m_relative = false;
+    m_running = false;
+    emit runningChanged();
+
+    if (!fitPlane)
+        return;
+    LaserPlane plane;
+    if (!plane.fit(m_samples)) {
+        setMessage("Fit failed, plane not saved");
+        return;
+    }
+    m_plane = plane;
+    m_lineDetector->setLaserPlane(m_plane);
+    if (!m_plane.save(m_fileName))
+        qWarning() << "Can't save laser plane to" << m_fileName;
+    setMessage(QString("rms %1 mm").arg(m_plane.rms(), 0, 'f', 3));
+    emit calibrated();
+}
+
+void LaserCalibrator::setMessage(const QString &message)
+{
+    m_message = message;
+    emit messageChanged();
+}
+
+bool LaserCalibrator::running() const
+{
+    return m_running;
+}
+
+int LaserCalibrator::progress() const
+{
+    return m_steps > 0 ? m_step * 100 / m_steps : 0;
+}
+
+float LaserCalibrator::rms() const
+{
+    return m_plane.isValid() ? m_plane.rms() : 0;
+}
+
+QString LaserCalibrator::message() const
+{
+    return m_message;
+}
+
+QString LaserCalibrator::axis() const
+{
+    return m_axis;
+}
+
+void LaserCalibrator::setAxis(const QString &axis)
+{
+    if (!m_running)
+        m_axis = axis;
+}
+
+float LaserCalibrator::range() const
+{
+    return m_range;
+}
+
+void LaserCalibrator::setRange(float range)
+{
+    if (!m_running)
+        m_range = range;
+}
+
+int LaserCalibrator::steps() const
+{
+    return m_steps;
+}
+
+void LaserCalibrator::setSteps(int steps)
+{
+    if (!m_running)
+        m_steps = steps;
+}
+
+int LaserCalibrator::samplesPerStep() const
+{
+    return m_samplesPerStep;
+}
+
+void LaserCalibrator::setSamplesPerStep(int samples)
+{
+    if (samples > 0)
+        m_samplesPerStep = samples;
+}
@@ -0,0 +1,108 @@
+#ifndef LASERCALIBRATOR_H
+#define LASERCALIBRATOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <vector>
+
+#include "laserplane.h"
+
+class GcodePlayer;
+class LineDetector;
+
+/**
+ * @brief The LaserCalibrator class steps the axis carrying camera and laser through a known range,
+ * records beam position at each step and fits a LaserPlane, which is saved and handed to LineDetector.
+ * Moving the axis up by d is taken as the surface moving d further away, i.e. dz = +d.
+ * Runs only while the player is stopped and connected, every command waits for its ok before the next step
+ * and each move is followed by G4 P0, whose ok means the axis has arrived.
+ */
+class LaserCalibrator : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(float rms READ rms NOTIFY calibrated)
+    Q_PROPERTY(QString message READ message NOTIFY messageChanged)
+    Q_PROPERTY(QString axis READ axis WRITE setAxis)
+    Q_PROPERTY(float range READ range WRITE setRange)
+    Q_PROPERTY(int steps READ steps WRITE setSteps)
+    Q_PROPERTY(int samplesPerStep READ samplesPerStep WRITE setSamplesPerStep)
+public:
+    LaserCalibrator(LineDetector *lineDetector, GcodePlayer *player, const QString &fileName, QObject *parent = nullptr);
+
+    /**
+     * @brief load Applies a previously saved plane to the detector, if there is one
+     */
+    bool load();
+
+    /**
+     * @brief start Refuses to run unless the player is Stopped and MC is connected
+     */
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void cancel();
+
+    bool running() const;
+    int progress() const;
+    float rms() const;
+    QString message() const;
+
+    QString axis() const;
+    void setAxis(const QString &axis);
+
+    float range() const;
+    void setRange(float range);
+
+    int steps() const;
+    void setSteps(int steps);
+
+    int samplesPerStep() const;
+    void setSamplesPerStep(int samples);
+
+signals:
+    void runningChanged();
+    void progressChanged();
+    void messageChanged();
+    void calibrated();
+
+public slots:
+    void onLineMeasured(float position);
+
+private slots:
+    void onMcResponse(const QString &line);
+    void onMcConnectionChanged(bool connected);
+    void onAckTimeout();
+    void onMeasureTimeout();
+
+private:
+    void sendCommand(const QString &command);
+    void moveBy(float delta);
+    void finishStep();
+    void finish(bool fitPlane);
+    void setMessage(const QString &message);
+
+    LineDetector *m_lineDetector;
+    GcodePlayer *m_player;
+    QString m_fileName;
+    LaserPlane m_plane;
+    QTimer *m_ackTimer;
+    QTimer *m_measureTimer;
+
+    bool m_running;
+    bool m_relative;         ///< G91 acknowledged
+    bool m_awaitingAck;
+    bool m_moveQueued;       ///< Last ack was for a move, G4 P0 is sent to wait until it is done
+    bool m_measuring;
+    int m_step;
+    float m_offset;                        ///< Axis position relative to calibration start, mm
+    std::vector<float> m_positions;        ///< Beam positions collected at current step
+    std::vector<LaserPlane::sample_t> m_samples;
+    QString m_message;
+
+    QString m_axis;
+    float m_range;           ///< Sweep is -range..+range around start, mm
+    int m_steps;
+    int m_samplesPerStep;
+};
+
+#endif // LASERCALIBRATOR_H
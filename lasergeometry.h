@@ -0,0 +1,35 @@
+#ifndef LASERGEOMETRY_H
+#define LASERGEOMETRY_H
+
+/**
+ * @brief The LaserGeometry struct relates laser line displacement on the sensor to height change dz.
+ * Camera looks straight down, laser is mounted lx mm aside and lz mm above the focal point.
+ */
+struct LaserGeometry
+{
+    float ppmm; ///< Sensor pixels per mm
+    float s0;   ///< Lens to surface distance, mm
+    float f;    ///< Focal length, mm
+    float lz;   ///< Laser height above the lens, mm
+    float lx;   ///< Laser offset from optical axis, mm
+
+    LaserGeometry() : ppmm(9.8833333f), s0(124), f(3.6f), lz(36), lx(243) {}
+
+    /**
+     * @brief dzFromOffset Height change in mm for line displacement dxs in pixels from the zero position
+     */
+    float dzFromOffset(float dxs) const
+    {
+        return (lz * dxs * (s0 - f)) / (lx * f * ppmm - lz * dxs);
+    }
+
+    /**
+     * @brief offsetFromDz Inverse of dzFromOffset()
+     */
+    float offsetFromDz(float dz) const
+    {
+        return (dz * lx * f * ppmm) / (lz * (s0 - f + dz));
+    }
+};
+
+#endif // LASERGEOMETRY_H
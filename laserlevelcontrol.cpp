@@ -0,0 +1,119 @@
+#include "laserlevelcontrol.h"
+#include "capturestream.hpp"
+#include "linedetector.h"
+
+#include <QtMath>
+
+namespace {
+const float Smoothing = 0.4f;         ///< Level average weight of a new frame, settles in a few frames
+const float ThresholdPosition = 0.5f; ///< Threshold between background (0) and beam (1)
+const float MinContrast = 0.05f;      ///< Beam over background, relative to full scale, below which threshold is kept
+const float TargetLevel = 0.7f;       ///< Beam level exposure is steered to
+const float LevelTolerance = 0.15f;
+const float SaturatedLevel = 0.95f;
+const int ExposureSettleFrames = 3;
+}
+
+LaserLevelControl::LaserLevelControl(LineDetector *lineDetector, CaptureStream *captureStream, QObject *parent) :
+    QObject(parent), m_lineDetector(lineDetector), m_captureStream(captureStream),
+    m_autoThreshold(false), m_autoExposure(false),
+    m_peak(0), m_background(0), m_beamLevel(0), m_primed(false),
+    m_exposure(100), m_minExposure(1), m_maxExposure(2000), m_framesSinceExposure(0)
+{
+    connect(m_lineDetector, &LineDetector::profileLevels,
+            this,           &LaserLevelControl::onProfileLevels);
+}
+
+bool LaserLevelControl::autoThreshold() const
+{
+    return m_autoThreshold;
+}
+
+void LaserLevelControl::setAutoThreshold(bool enabled)
+{
+    if (enabled == m_autoThreshold)
+        return;
+    m_autoThreshold = enabled;
+    m_primed = false;
+    emit settingsChanged();
+}
+
+bool LaserLevelControl::autoExposure() const
+{
+    return m_autoExposure;
+}
+
+void LaserLevelControl::setAutoExposure(bool enabled)
+{
+    if (enabled == m_autoExposure)
+        return;
+    m_autoExposure = enabled;
+    m_primed = false;
+    m_captureStream->setExposure(enabled ? m_exposure : -1);
+    m_framesSinceExposure = 0;
+    emit settingsChanged();
+}
+
+int LaserLevelControl::exposure() const
+{
+    return m_exposure;
+}
+
+void LaserLevelControl::setExposureLimits(int min, int max)
+{
+    m_minExposure = qMax(1, min);
+    m_maxExposure = qMax(m_minExposure, max);
+    m_exposure = qBound(m_minExposure, m_exposure, m_maxExposure);
+}
+
+void LaserLevelControl::setInitialExposure(int exposure)
+{
+    m_exposure = qBound(m_minExposure, exposure, m_maxExposure);
+}
+
+float LaserLevelControl::beamLevel() const
+{
+    return m_beamLevel;
+}
+
+void LaserLevelControl::onProfileLevels(float peak, float background, float fullScale)
+{
+    if (!m_autoThreshold && !m_autoExposure)
+        return;
+    if (fullScale <= 0)
+        return;
+    if (!m_primed) {
+        m_peak = peak;
+        m_background = background;
+        m_primed = true;
+    } else {
+        m_peak += Smoothing * (peak - m_peak);
+        m_background += Smoothing * (background - m_background);
+    }
+    m_beamLevel = m_peak / fullScale;
+    emit levelsChanged();
+
+    if (m_autoThreshold && (m_peak - m_background) > MinContrast * fullScale)
+        m_lineDetector->setThreshold(m_background + ThresholdPosition * (m_peak - m_background));
+
+    if (!m_autoExposure)
+        return;
+    if (++m_framesSinceExposure < ExposureSettleFrames)
+        return;
+    // Saturated beam hides its real level, halve exposure instead of scaling by it
+    float level = peak / fullScale;
+    float gain;
+    if (level >= SaturatedLevel)
+        gain = 0.5f;
+    else if (qAbs(level - TargetLevel) > LevelTolerance)
+        gain = qBound(0.5f, TargetLevel / qMax(level, 0.01f), 2.0f);
+    else
+        return;
+    int exposure = qBound(m_minExposure, qRound(m_exposure * gain), m_maxExposure);
+    if (exposure == m_exposure)
+        return;
+    m_exposure = exposure;
+    m_captureStream->setExposure(m_exposure);
+    m_framesSinceExposure = 0;
+    emit exposureChanged();
+}
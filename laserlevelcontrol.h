@@ -0,0 +1,68 @@
+#ifndef LASERLEVELCONTROL_H
+#define LASERLEVELCONTROL_H
+
+#include <QObject>
+
+class CaptureStream;
+class LineDetector;
+
+/**
+ * @brief The LaserLevelControl class keeps the beam in the detector's range as material reflectivity changes.
+ * Threshold follows halfway between background and beam, exposure is stepped to keep the beam under saturation.
+ * Works from the profile levels LineDetector already has, a few multiplications per frame.
+ */
+class LaserLevelControl : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool autoThreshold READ autoThreshold WRITE setAutoThreshold NOTIFY settingsChanged)
+    Q_PROPERTY(bool autoExposure READ autoExposure WRITE setAutoExposure NOTIFY settingsChanged)
+    Q_PROPERTY(int exposure READ exposure NOTIFY exposureChanged)
+    Q_PROPERTY(float beamLevel READ beamLevel NOTIFY levelsChanged)
+public:
+    LaserLevelControl(LineDetector *lineDetector, CaptureStream *captureStream, QObject *parent = nullptr);
+
+    bool autoThreshold() const;
+    void setAutoThreshold(bool enabled);
+
+    /**
+     * @brief setAutoExposure Manual exposure control of the stream, starts from exposure()
+     */
+    bool autoExposure() const;
+    void setAutoExposure(bool enabled);
+
+    /**
+     * @brief exposure Last exposure set, device units
+     */
+    int exposure() const;
+    void setExposureLimits(int min, int max);
+    void setInitialExposure(int exposure);
+
+    /**
+     * @brief beamLevel Beam row sum relative to saturation, smoothed, 0..1
+     */
+    float beamLevel() const;
+
+signals:
+    void settingsChanged();
+    void exposureChanged();
+    void levelsChanged();
+
+public slots:
+    void onProfileLevels(float peak, float background, float fullScale);
+
+private:
+    LineDetector *m_lineDetector;
+    CaptureStream *m_captureStream;
+    bool m_autoThreshold;
+    bool m_autoExposure;
+    float m_peak;        ///< Smoothed levels, threshold units
+    float m_background;
+    float m_beamLevel;
+    bool m_primed;
+    int m_exposure;
+    int m_minExposure;
+    int m_maxExposure;
+    int m_framesSinceExposure; ///< Frames since the last exposure step, a step takes a frame or two to show
+};
+
+#endif // LASERLEVELCONTROL_H
@@ -0,0 +1,183 @@
+#include "laserplane.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core.hpp>
+
+const float LaserPlane::MinPositionSpan = 4;
+const float LaserPlane::MaxRms = 0.2f;
+
+namespace {
+const double MinConditionRatio = 1e-9; ///< Smallest to largest singular value of the column-scaled system
+const float MinSlope = 1e-4f;          ///< mm/px, flatter means the beam did not follow the axis
+}
+
+LaserPlane::LaserPlane() :
+    m_valid(false), m_alpha(0), m_beta(0), m_gamma(0), m_rms(0), m_samples(0),
+    m_positionMin(0), m_positionMax(0)
+{
+}
+
+bool LaserPlane::fit(const std::vector<sample_t> &samples)
+{
+    m_valid = false;
+    if (samples.size() < 3)
+        return false;
+    float positionMin = samples.front().position;
+    float positionMax = positionMin;
+    for (const sample_t &s : samples) {
+        positionMin = std::min(positionMin, s.position);
+        positionMax = std::max(positionMax, s.position);
+    }
+    if (!(positionMax - positionMin >= MinPositionSpan)) {
+        qWarning() << "Laser plane fit rejected, positions span only" << positionMax - positionMin << "px";
+        return false;
+    }
+    // dz * (1 + gamma * p) = alpha * p + beta is linear in alpha, beta, gamma
+    cv::Mat a(static_cast<int>(samples.size()), 3, CV_64FC1);
+    cv::Mat b(static_cast<int>(samples.size()), 1, CV_64FC1);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        int r = static_cast<int>(i);
+        double p = samples[i].position;
+        double dz = samples[i].dz;
+        a.at<double>(r, 0) = p;
+        a.at<double>(r, 1) = 1;
+        a.at<double>(r, 2) = -p * dz;
+        b.at<double>(r, 0) = dz;
+    }
+    // Columns differ by orders of magnitude, scale them before judging the rank
+    cv::Mat scaled = a.clone();
+    for (int c = 0; c < scaled.cols; ++c) {
+        double n = cv::norm(scaled.col(c));
+        if (n > 0)
+            scaled.col(c) /= n;
+    }
+    cv::Mat w;
+    cv::SVD::compute(scaled, w, cv::SVD::NO_UV);
+    if (!(w.at<double>(w.rows - 1, 0) > MinConditionRatio * w.at<double>(0, 0))) {
+        qWarning() << "Laser plane fit rejected, rank deficient";
+        return false;
+    }
+    cv::Mat x;
+    if (!cv::solve(a, b, x, cv::DECOMP_SVD))
+        return false;
+    m_alpha = x.at<double>(0, 0);
+    m_beta = x.at<double>(1, 0);
+    m_gamma = x.at<double>(2, 0);
+    m_positionMin = positionMin;
+    m_positionMax = positionMax;
+
+    double squares = 0;
+    for (const sample_t &s : samples) {
+        double e = dzAt(s.position) - s.dz;
+        squares += e * e;
+    }
+    m_rms = std::sqrt(squares / samples.size());
+    m_samples = static_cast<int>(samples.size());
+    if (!isSane()) {
+        qWarning() << "Laser plane fit rejected, rms" << m_rms << "slope" << slopeAt(positionMin) << slopeAt(positionMax);
+        return false;
+    }
+    m_valid = true;
+    return true;
+}
+
+bool LaserPlane::isSane() const
+{
+    if (!std::isfinite(m_alpha) || !std::isfinite(m_beta) || !std::isfinite(m_gamma))
+        return false;
+    if (!std::isfinite(m_rms) || m_rms > MaxRms)
+        return false;
+    // No pole between the sampled ends, i.e. 1 + gamma * p keeps its sign, and a usable slope of one sign
+    double d0 = 1 + m_gamma * m_positionMin;
+    double d1 = 1 + m_gamma * m_positionMax;
+    if (!(d0 * d1 > 0))
+        return false;
+    float s0 = slopeAt(m_positionMin);
+    float s1 = slopeAt(m_positionMax);
+    return std::isfinite(s0) && std::isfinite(s1) && s0 * s1 > 0
+            && std::fabs(s0) >= MinSlope && std::fabs(s1) >= MinSlope;
+}
+
+float LaserPlane::slopeAt(float position) const
+{
+    double d = 1 + m_gamma * position;
+    return static_cast<float>((m_alpha - m_beta * m_gamma) / (d * d));
+}
+
+bool LaserPlane::isValid() const
+{
+    return m_valid;
+}
+
+float LaserPlane::dzAt(float position) const
+{
+    return static_cast<float>((m_alpha * position + m_beta) / (1 + m_gamma * position));
+}
+
+std::vector<float> LaserPlane::lut(int rows) const
+{
+    std::vector<float> table(static_cast<size_t>(rows) * LutResolution + 1);
+    // Model is only known to be free of poles within the sampled range, beyond it the end values are held
+    for (size_t i = 0; i < table.size(); ++i) {
+        float position = static_cast<float>(i) / LutResolution;
+        table[i] = dzAt(std::min(std::max(position, m_positionMin), m_positionMax));
+    }
+    return table;
+}
+
+float LaserPlane::rms() const
+{
+    return static_cast<float>(m_rms);
+}
+
+int LaserPlane::sampleCount() const
+{
+    return m_samples;
+}
+
+bool LaserPlane::save(const QString &fileName) const
+{
+    if (!m_valid || !isSane())
+        return false;
+    cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+    fs << "alpha" << m_alpha;
+    fs << "beta" << m_beta;
+    fs << "gamma" << m_gamma;
+    fs << "rms" << m_rms;
+    fs << "samples" << m_samples;
+    fs << "positionMin" << m_positionMin;
+    fs << "positionMax" << m_positionMax;
+    fs << "date" << QDateTime::currentDateTime().toString(Qt::ISODate).toStdString();
+    return true;
+}
+
+bool LaserPlane::load(const QString &fileName)
+{
+    cv::FileStorage fs;
+    try {
+        if (!fs.open(fileName.toStdString(), cv::FileStorage::READ))
+            return false;
+    } catch (const cv::Exception &e) {
+        qWarning() << "Can't read laser plane" << fileName << e.what();
+        return false;
+    }
+    if (fs["alpha"].empty() || fs["beta"].empty() || fs["gamma"].empty()
+            || fs["positionMin"].empty() || fs["positionMax"].empty())
+        return false;
+    fs["alpha"] >> m_alpha;
+    fs["beta"] >> m_beta;
+    fs["gamma"] >> m_gamma;
+    fs["rms"] >> m_rms;
+    fs["samples"] >> m_samples;
+    fs["positionMin"] >> m_positionMin;
+    fs["positionMax"] >> m_positionMax;
+    m_valid = isSane();
+    if (!m_valid)
+        qWarning() << "Laser plane" << fileName << "is degenerate, ignored";
+    return m_valid;
+}
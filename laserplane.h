@@ -0,0 +1,77 @@
+#ifndef LASERPLANE_H
+#define LASERPLANE_H
+
+#include <QString>
+#include <vector>
+
+/**
+ * @brief The LaserPlane class maps beam position to dz with a model fitted from known Z steps.
+ * Triangulation with the laser plane at an angle to the optical axis reduces to
+ * dz = (alpha * p + beta) / (1 + gamma * p), p being the beam row counted from the bottom of the detector frame.
+ */
+class LaserPlane
+{
+public:
+    LaserPlane();
+
+    typedef struct {
+        float dz;       ///< Commanded axis offset from calibration start, mm
+        float position; ///< Beam position, px
+    } sample_t;
+
+    /**
+     * @brief fit Least squares fit of the model to samples. Rejected, leaving the plane invalid, when positions span
+     * less than MinPositionSpan, the system is rank deficient, or the result has a pole or a flat slope in the
+     * sampled range or rms above MaxRms.
+     */
+    bool fit(const std::vector<sample_t> &samples);
+    bool isValid() const;
+
+    /**
+     * @brief dzAt Evaluates the model, use lut() in the per frame path
+     */
+    float dzAt(float position) const;
+    /**
+     * @brief lut Dense dz table for positions 0..rows with LutResolution entries per pixel, flat outside the sampled range
+     */
+    std::vector<float> lut(int rows) const;
+    enum { LutResolution = 8 };
+    static const float MinPositionSpan; ///< px
+    static const float MaxRms;          ///< mm
+
+    float rms() const;
+    int sampleCount() const;
+
+    bool save(const QString &fileName) const;
+    bool load(const QString &fileName);
+
+private:
+    bool isSane() const;
+    float slopeAt(float position) const;
+
+    bool m_valid;
+    double m_alpha;
+    double m_beta;
+    double m_gamma;
+    double m_rms;   ///< Fit residual, mm
+    int m_samples;
+    float m_positionMin;    ///< Sampled range, px
+    float m_positionMax;
+};
+
+/**
+ * @brief lookupDz Linear interpolation in a LaserPlane::lut() table, clamped to its ends
+ */
+inline float lookupDz(const std::vector<float> &lut, float position)
+{
+    float x = position * LaserPlane::LutResolution;
+    if (x <= 0)
+        return lut.front();
+    size_t i = static_cast<size_t>(x);
+    if (i + 1 >= lut.size())
+        return lut.back();
+    float t = x - i;
+    return lut[i] + t * (lut[i + 1] - lut[i]);
+}
+
+#endif // LASERPLANE_H
@@ -1,15 +1,18 @@
 #include <opencv2/opencv.hpp>
 
 #include <QTimer>
+#include <algorithm>
+#include <limits>
 
 #include "linedetector.h"
-#include "capturecontroller.hpp"
+#include "capturestream.hpp"
 #include "cvmatsurfacesource.hpp"
+#include "columnpeaks.h"
 
 Q_LOGGING_CATEGORY(lineDetector, "vhrd.vision.linedetector")
 
-LineDetector::LineDetector(CaptureController *captureController, QObject *parent) : QObject(parent),
-    m_captureController(captureController)
+LineDetector::LineDetector(CaptureStream *captureStream, QObject *parent) : QObject(parent),
+    m_captureStream(captureStream)
 {
     m_timer = new QTimer(this);
     m_timer->setInterval(2000);
@@ -22,11 +25,13 @@ LineDetector::LineDetector(CaptureController *captureController, QObject *parent
     m_dz = 0;
     m_zerodxs = false;
     m_dxs0 = 0;
-    m_ppmm = 9.8833333;
-    m_s0 = 124;
-    m_f = 3.6;
-    m_lz = 36;
-    m_lx = 243;
+    m_lutRows = 0;
+    m_primaryId = -1;
+    m_lineCount = 1;
+    m_columnProfile = false;
+    m_columnBin = 4;
+    m_columnMinLevel = 64;
+    m_columnZeroRequested = false;
 
     m_angle = 0;
 
@@ -50,12 +55,36 @@ LineDetector::State LineDetector::state() const
 
 void LineDetector::onFrameReady()
 {
-    cv::Mat frame = m_captureController->frameCopy();
+    cv::Size frameSize = m_captureStream->frameSize();
+    if (frameSize.area() == 0)
+        return;
 
-    cv::Mat rm = cv::getRotationMatrix2D(cv::Point(frame.cols / 2, frame.rows / 2), m_angle + 90, 1.0);
-    cv::Mat rotated;
-    cv::warpAffine(frame, rotated, rm, cv::Size(frame.cols, frame.rows));
-    frame = rotated;
+    // Integration limits
+    quint16 colfrom = m_integrateFrom * frameSize.width;
+    quint16 colto = m_integrateTo * frameSize.width;
+
+    // Only the integration band of the rotated frame is used, fetch just the part of the source frame it comes from
+    cv::Mat rm = cv::getRotationMatrix2D(cv::Point(frameSize.width / 2, frameSize.height / 2), m_angle + 90, 1.0);
+    cv::Mat inverse;
+    cv::invertAffineTransform(rm, inverse);
+    std::vector<cv::Point2f> band;
+    band.push_back(cv::Point2f(colfrom, 0));
+    band.push_back(cv::Point2f(colto, 0));
+    band.push_back(cv::Point2f(colfrom, frameSize.height));
+    band.push_back(cv::Point2f(colto, frameSize.height));
+    std::vector<cv::Point2f> sourceBand;
+    cv::transform(band, sourceBand, inverse);
+    cv::Rect roi = cv::boundingRect(sourceBand);
+    roi -= cv::Point(2, 2); // room for interpolation at the band edges
+    roi += cv::Size(4, 4);
+    cv::Mat roiFrame;
+    cv::Rect copied = m_captureStream->frameRoi(roi, roiFrame);
+    if (roiFrame.empty())
+        return;
+    rm.at<double>(0, 2) += rm.at<double>(0, 0) * copied.x + rm.at<double>(0, 1) * copied.y;
+    rm.at<double>(1, 2) += rm.at<double>(1, 0) * copied.x + rm.at<double>(1, 1) * copied.y;
+    cv::Mat frame;
+    cv::warpAffine(roiFrame, frame, rm, frameSize);
 
     // Convert to HSV, filter
     cv::Mat hsv;
@@ -79,10 +108,6 @@ void LineDetector::onFrameReady()
     cv::Mat masked;
     hsvSplitted[2].copyTo(masked, red_hue);
 
-    // Integration limits
-    quint16 colfrom = m_integrateFrom * frame.cols;
-    quint16 colto = m_integrateTo * frame.cols;
-
     // Show as red channel
     cv::Mat desaturateMask(frame.rows, frame.cols, CV_8UC1, cv::Scalar(0));
     cv::rectangle(desaturateMask, cv::Point(0, 0), cv::Point(colfrom, frame.rows), cv::Scalar(255), -1);
@@ -98,6 +123,9 @@ void LineDetector::onFrameReady()
     cv::merge(channels, merged);
     CVMatSurfaceSource::imshow("second", merged);
 
+    if (m_columnProfile)
+        measureColumns(masked, colfrom, colto);
+
     // Integrate
     QVector<float> linesSum;
     quint8 *mdata = static_cast<quint8 *>(masked.data);
@@ -109,42 +137,50 @@ void LineDetector::onFrameReady()
         linesSum.push_back(s);
     }
     float max = 0;
+    float total = 0;
     float thresholdAbs = m_threshold * frame.cols * 255;
-    QVector<int> overThreshold;
     for (int i = 0; i < linesSum.size(); i++) {
         if (linesSum[i] > max) {
             max = linesSum[i];
         }
-        if (linesSum[i] > thresholdAbs) {
-            overThreshold.push_back(i);
-        }
+        total += linesSum[i];
     }
+    // In threshold units, the beam is a few rows so the mean is close to the background
+    float scale = 1.0f / (frame.cols * 255);
+    emit profileLevels(max * scale, total / linesSum.size() * scale, (colto - colfrom) * 255 * scale);
+
+    // Split the profile into beams and follow them, so a reflection is a separate peak instead of widening the beam
+    segmentPeaks(linesSum, thresholdAbs, MergeGap, m_peaks);
+    m_tracker.update(m_peaks);
+    emit peaksDetected(m_peaks);
+
     for (int i = 0; i < linesSum.size(); i++) {
         linesSum[i] = linesSum[i] / max;
     }
     emit integrationComplete(linesSum);
 
-    // Find thicknes and center of a light beam
-    if (overThreshold.count() >= 2) {
-        int x1 = overThreshold.last();
-        QPointF pt1((float)x1 / float(frame.rows), linesSum[x1]);
-        int x2 = overThreshold.first();
-        QPointF pt2((float)x2 / float(frame.rows), pt1.y());
+    const LinePeak *primary = primaryPeak();
+    if (primary) {
+        // Find thicknes and center of a light beam
+        QPointF pt1((float)primary->last / float(frame.rows), linesSum[primary->last]);
+        QPointF pt2((float)primary->first / float(frame.rows), pt1.y());
         emit lineDetected(pt1, pt2);
 
         // Find dz
-        float dxs = x1 + (float)(x2 - x1) / 2.0f;
+        float dxs = primary->position;
+        emit lineMeasured(dxs);
+        bool zero = m_zerodxs;
         if (m_zerodxs) {
             m_dxs0 = dxs;
             m_zerodxs = false;
         }
-        dxs -= m_dxs0;
-        //float M = m_f / (m_s0 - m_f);
-        //float dx = dxs / (M * m_ppmm);
-        m_dz = (m_lz * dxs * (m_s0 - m_f) ) / (m_lx * m_f * m_ppmm - m_lz * dxs);
+        m_dz = dzFrom(dxs, m_dxs0, frame.rows);
         emit dzChanged();
         emit dzChanged(m_dz);
 
+        if (m_lineCount > 1)
+            measureLines(frame.rows, zero);
+
         if (m_state != Locked) {
             m_state = Locked;
             m_timer->stop();
@@ -160,6 +196,85 @@ void LineDetector::onFrameReady()
     }
 }
 
+const LinePeak *LineDetector::primaryPeak()
+{
+    // Stay on the tracked beam while it is there, otherwise take the strongest peak
+    const LinePeak *strongest = nullptr;
+    for (const LinePeak &peak : m_peaks) {
+        if (peak.id == m_primaryId && peak.width >= 2)
+            return &peak;
+        if (peak.width >= 2 && (!strongest || peak.intensity > strongest->intensity))
+            strongest = &peak;
+    }
+    m_primaryId = strongest ? strongest->id : -1;
+    return strongest;
+}
+
+float LineDetector::dzFrom(float position, float zeroPosition, int rows)
+{
+    if (m_plane.isValid()) {
+        if (m_lutRows != rows) {
+            m_lut = m_plane.lut(rows);
+            m_lutRows = rows;
+        }
+        return lookupDz(m_lut, position) - lookupDz(m_lut, zeroPosition);
+    }
+    return m_geometry.dzFromOffset(position - zeroPosition);
+}
+
+void LineDetector::measureLines(int rows, bool zero)
+{
+    // Lines are ordered by position, the n-th line is compared with the n-th line at zero time
+    QVector<float> positions;
+    for (const LinePeak &peak : m_peaks) {
+        if (peak.width >= 2)
+            positions.push_back(peak.position);
+    }
+    std::sort(positions.begin(), positions.end());
+    if (positions.size() > m_lineCount)
+        positions.resize(m_lineCount);
+    if (zero || m_lineZero.isEmpty())
+        m_lineZero = positions;
+    // A missing or extra line would shift the pairing
+    if (positions.size() != m_lineZero.size())
+        return;
+    QVector<float> dz;
+    for (int i = 0; i < positions.size(); ++i)
+        dz.push_back(dzFrom(positions[i], m_lineZero[i], rows));
+    emit linesMeasured(dz);
+}
+
+void LineDetector::measureColumns(const cv::Mat &masked, int colfrom, int colto)
+{
+    findColumnPeaks(masked, colfrom, colto, m_columnRows, m_columnLevels);
+    const int width = static_cast<int>(m_columnRows.size());
+    const int bins = (width + m_columnBin - 1) / m_columnBin;
+    // Positions count rows from the bottom, as the row sum profile does
+    QVector<float> positions(bins, std::numeric_limits<float>::quiet_NaN());
+    for (int bin = 0; bin < bins; ++bin) {
+        float sum = 0;
+        int count = 0;
+        for (int x = bin * m_columnBin; x < qMin((bin + 1) * m_columnBin, width); ++x) {
+            if (m_columnLevels[x] < m_columnMinLevel)
+                continue;
+            sum += (masked.rows - 1) - refineColumnPeak(masked, colfrom + x, m_columnRows[x], ColumnPeakRadius);
+            count++;
+        }
+        if (count > 0)
+            positions[bin] = sum / count;
+    }
+    if (m_columnZero.size() != bins || m_columnZeroRequested) {
+        m_columnZero = positions;
+        m_columnZeroRequested = false;
+    }
+    QVector<float> dz(bins, std::numeric_limits<float>::quiet_NaN());
+    for (int bin = 0; bin < bins; ++bin) {
+        if (!qIsNaN(positions[bin]) && !qIsNaN(m_columnZero[bin]))
+            dz[bin] = dzFrom(positions[bin], m_columnZero[bin], masked.rows);
+    }
+    emit columnProfileMeasured(dz);
+}
+
 void LineDetector::onTimeout()
 {
     m_state = Unlocked;
@@ -167,6 +282,59 @@ void LineDetector::onTimeout()
     emit dzValidChanged(false);
 }
 
+void LineDetector::setLaserPlane(const LaserPlane &plane)
+{
+    m_plane = plane;
+    m_lutRows = 0;
+}
+
+const LaserPlane &LineDetector::laserPlane() const
+{
+    return m_plane;
+}
+
+int LineDetector::lineCount() const
+{
+    return m_lineCount;
+}
+
+void LineDetector::setLineCount(int count)
+{
+    if (count < 1 || count == m_lineCount)
+        return;
+    m_lineCount = count;
+    m_lineZero.clear();
+    emit lineCountChanged();
+}
+
+bool LineDetector::columnProfile() const
+{
+    return m_columnProfile;
+}
+
+void LineDetector::setColumnProfile(bool enabled)
+{
+    if (enabled == m_columnProfile)
+        return;
+    m_columnProfile = enabled;
+    m_columnZero.clear();
+    emit columnProfileChanged();
+}
+
+int LineDetector::columnBin() const
+{
+    return m_columnBin;
+}
+
+void LineDetector::setColumnBin(int columns)
+{
+    if (columns < 1 || columns == m_columnBin)
+        return;
+    m_columnBin = columns;
+    m_columnZero.clear();
+    emit columnProfileChanged();
+}
+
 float LineDetector::rotation() const
 {
     return m_angle;
@@ -184,7 +352,10 @@ float LineDetector::threshold() const
 
 void LineDetector::setThreshold(float threshold)
 {
+    if (threshold == m_threshold)
+        return;
     m_threshold = threshold;
+    emit thresholdChanged();
 }
 
 float LineDetector::dz() const
@@ -195,6 +366,7 @@ float LineDetector::dz() const
 void LineDetector::zerodxs()
 {
     m_zerodxs = true;
+    m_columnZeroRequested = true;
 }
 
 float LineDetector::integrateTo() const
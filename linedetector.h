@@ -4,8 +4,13 @@
 #include <QObject>
 #include <QLoggingCategory>
 
-class CaptureController;
+#include "lasergeometry.h"
+#include "laserplane.h"
+#include "linepeaks.h"
+
+class CaptureStream;
 class QTimer;
+namespace cv { class Mat; }
 
 class LineDetector : public QObject
 {
@@ -24,8 +29,11 @@ class LineDetector : public QObject
     Q_PROPERTY(State state READ state NOTIFY stateChanged)
     Q_PROPERTY(float dz READ dz NOTIFY dzChanged)
     Q_PROPERTY(float rotation READ rotation WRITE setRotation)
+    Q_PROPERTY(int lineCount READ lineCount WRITE setLineCount NOTIFY lineCountChanged)
+    Q_PROPERTY(bool columnProfile READ columnProfile WRITE setColumnProfile NOTIFY columnProfileChanged)
+    Q_PROPERTY(int columnBin READ columnBin WRITE setColumnBin NOTIFY columnProfileChanged)
 public:
-    explicit LineDetector(CaptureController *captureController, QObject *parent = nullptr);
+    explicit LineDetector(CaptureStream *captureStream, QObject *parent = nullptr);
 
     enum State {
         Unlocked,
@@ -75,6 +83,27 @@ public:
     float rotation() const;
     void setRotation(float angle);
 
+    /**
+     * @brief lineCount Number of projected laser lines, more than one enables linesMeasured()
+     */
+    int lineCount() const;
+    void setLineCount(int count);
+
+    /**
+     * @brief columnProfile Also find the beam in every bin of columnBin columns of the integration band,
+     * giving a height cross-section per frame through columnProfileMeasured()
+     */
+    bool columnProfile() const;
+    void setColumnProfile(bool enabled);
+    int columnBin() const;
+    void setColumnBin(int columns);
+
+    /**
+     * @brief setLaserPlane Fitted beam position to dz model, replaces LaserGeometry once valid
+     */
+    void setLaserPlane(const LaserPlane &plane);
+    const LaserPlane &laserPlane() const;
+
 signals:
     void hsvThresholdsChanged();
     void integrationLimitsChanged();
@@ -85,6 +114,28 @@ signals:
     void dzChanged();
     void dzChanged(float dz);
     void dzValidChanged(bool valid);
+    /**
+     * @brief lineMeasured Beam position in rows from the bottom of the rotated frame, before zeroing and conversion to dz
+     */
+    void lineMeasured(float position);
+    /**
+     * @brief peaksDetected All beams over threshold in the frame, primary one included
+     */
+    void peaksDetected(const QVector<LinePeak> &peaks);
+    /**
+     * @brief linesMeasured dz of each projected line ordered by position, emitted when all lineCount lines are seen
+     */
+    void linesMeasured(const QVector<float> &dz);
+    void lineCountChanged();
+    /**
+     * @brief profileLevels Strongest row, mean row and saturated row sums of the frame, in threshold units
+     */
+    void profileLevels(float peak, float background, float fullScale);
+    /**
+     * @brief columnProfileMeasured dz per column bin from integrateFrom to integrateTo, NaN where the beam is not found
+     */
+    void columnProfileMeasured(const QVector<float> &dz);
+    void columnProfileChanged();
 
 public slots:
     void onFrameReady();
@@ -93,7 +144,14 @@ private slots:
     void onTimeout();
 
 private:
-    CaptureController *m_captureController;
+    const LinePeak *primaryPeak();
+    float dzFrom(float position, float zeroPosition, int rows);
+    void measureLines(int rows, bool zero);
+    void measureColumns(const cv::Mat &masked, int colfrom, int colto);
+
+    enum { MergeGap = 2 }; ///< Rows under threshold still counted as the same peak
+    enum { ColumnPeakRadius = 3 };
+    CaptureStream *m_captureStream;
     quint8 m_hueLowRangeFrom;
     quint8 m_hueLowRangeTo;
     quint8 m_hueHighRangeFrom;
@@ -110,11 +168,22 @@ private:
     float m_dz;
     bool m_zerodxs;
     float m_dxs0;
-    float m_ppmm;
-    float m_s0;
-    float m_f;
-    float m_lz;
-    float m_lx;
+    LaserGeometry m_geometry;
+    LaserPlane m_plane;
+    std::vector<float> m_lut; ///< m_plane evaluated for m_lutRows rows
+    int m_lutRows;
+    QVector<LinePeak> m_peaks;
+    LineTracker m_tracker;
+    int m_primaryId;          ///< Track id of the beam dz is measured on
+    int m_lineCount;
+    QVector<float> m_lineZero; ///< Line positions at zero time when lineCount > 1
+    bool m_columnProfile;
+    int m_columnBin;
+    uchar m_columnMinLevel;    ///< Weakest column peak taken as the beam
+    bool m_columnZeroRequested;
+    QVector<float> m_columnZero;
+    std::vector<ushort> m_columnRows;
+    std::vector<uchar> m_columnLevels;
     float m_angle;
 };
 
@@ -0,0 +1,109 @@
+#include "linepeaks.h"
+
+#include <QtMath>
+
+void segmentPeaks(const QVector<float> &profile, float threshold, int mergeGap, QVector<LinePeak> &peaks)
+{
+    peaks.clear();
+    float strongest = 0;
+    int i = 0;
+    const int size = profile.size();
+    while (i < size) {
+        if (profile[i] <= threshold) {
+            i++;
+            continue;
+        }
+        LinePeak peak;
+        peak.id = -1;
+        peak.age = 0;
+        peak.first = i;
+        peak.last = i;
+        float sum = 0;
+        float moment = 0;
+        float top = 0;
+        int gap = 0;
+        for (; i < size && gap <= mergeGap; i++) {
+            if (profile[i] <= threshold) {
+                gap++;
+                continue;
+            }
+            gap = 0;
+            peak.last = i;
+            float w = profile[i] - threshold;
+            sum += w;
+            moment += w * i;
+            top = qMax(top, profile[i]);
+        }
+        i = peak.last + 1;
+        peak.position = sum > 0 ? moment / sum : peak.first;
+        peak.width = peak.last - peak.first + 1;
+        peak.intensity = top;
+        strongest = qMax(strongest, top);
+        peaks.push_back(peak);
+    }
+    if (strongest > 0) {
+        for (LinePeak &peak : peaks)
+            peak.intensity /= strongest;
+    }
+}
+
+LineTracker::LineTracker() :
+    m_nextId(0), m_maxJump(24), m_maxMissed(5)
+{
+}
+
+void LineTracker::update(QVector<LinePeak> &peaks)
+{
+    for (Track &track : m_tracks)
+        track.missed++;
+
+    // Greedy nearest neighbour, peaks and tracks are a handful at most
+    for (LinePeak &peak : peaks) {
+        int best = -1;
+        float bestDistance = m_maxJump;
+        for (int t = 0; t < m_tracks.size(); ++t) {
+            if (m_tracks[t].missed == 0)
+                continue;
+            float distance = qAbs(m_tracks[t].position - peak.position);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = t;
+            }
+        }
+        if (best < 0) {
+            Track track;
+            track.id = m_nextId++;
+            track.age = 0;
+            track.missed = 0;
+            track.position = peak.position;
+            m_tracks.push_back(track);
+            best = m_tracks.size() - 1;
+        }
+        Track &track = m_tracks[best];
+        track.age++;
+        track.missed = 0;
+        track.position = peak.position;
+        peak.id = track.id;
+        peak.age = track.age;
+    }
+
+    for (int t = m_tracks.size() - 1; t >= 0; --t) {
+        if (m_tracks[t].missed > m_maxMissed)
+            m_tracks.remove(t);
+    }
+}
+
+void LineTracker::clear()
+{
+    m_tracks.clear();
+}
+
+void LineTracker::setMaxJump(float rows)
+{
+    m_maxJump = rows;
+}
+
+void LineTracker::setMaxMissed(int frames)
+{
+    m_maxMissed = frames;
+}
@@ -0,0 +1,58 @@
+#ifndef LINEPEAKS_H
+#define LINEPEAKS_H
+
+#include <QVector>
+#include <QMetaType>
+
+/**
+ * @brief The LinePeak struct is one beam found in the row sum profile
+ */
+struct LinePeak
+{
+    int id;          ///< Track id, stable while the beam is followed from frame to frame
+    int age;         ///< Frames the track has been seen in
+    int first;       ///< First profile index over threshold
+    int last;        ///< Last profile index over threshold
+    float position;  ///< Intensity weighted center, profile index
+    float width;     ///< Over threshold extent, rows
+    float intensity; ///< Peak of the profile relative to the strongest peak of the frame, 0..1
+};
+Q_DECLARE_METATYPE(LinePeak)
+
+/**
+ * @brief segmentPeaks Splits profile into runs over threshold, runs closer than mergeGap are one peak
+ */
+void segmentPeaks(const QVector<float> &profile, float threshold, int mergeGap, QVector<LinePeak> &peaks);
+
+/**
+ * @brief The LineTracker class follows peaks over frames by nearest position, so a reflection showing up next to
+ * the beam does not take over its id.
+ */
+class LineTracker
+{
+public:
+    LineTracker();
+
+    /**
+     * @brief update Assigns ids and ages to peaks, tracks missing for more than maxMissed frames are dropped
+     */
+    void update(QVector<LinePeak> &peaks);
+    void clear();
+
+    void setMaxJump(float rows);
+    void setMaxMissed(int frames);
+
+private:
+    struct Track {
+        int id;
+        int age;
+        int missed;
+        float position;
+    };
+    QVector<Track> m_tracks;
+    int m_nextId;
+    float m_maxJump;
+    int m_maxMissed;
+};
+
+#endif // LINEPEAKS_H
@@ -1,6 +1,8 @@
 #include <QApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QCommandLineParser>
+#include <QDebug>
 
 #include "capturecontroller.hpp"
 #include "cvmatsurfacesource.hpp"
@@ -10,6 +12,15 @@
 #include "gcodeplayer.h"
 #include "rayreceiver.h"
 #include "automator.h"
+#include "sessionrecorder.h"
+#include "sessionreplayer.h"
+#include "framerecorder.h"
+#include "detectorbenchmark.h"
+#include "lasercalibrator.h"
+#include "dzfilter.h"
+#include "laserlevelcontrol.h"
+#include "mosaicbuilder.h"
+#include "mosaicimageprovider.h"
 
 int main(int argc, char *argv[])
 {
@@ -17,21 +28,75 @@ int main(int argc, char *argv[])
 
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption mcHostOption("mc-host", "Motion controller address.", "host", "192.168.88.77");
+    QCommandLineOption mcPortOption("mc-port", "Motion controller TCP port.", "port", "23");
+    QCommandLineOption rayPortOption("ray-port", "UDP port to receive ray telemetry on.", "port", "45454");
+    QCommandLineOption rayPeerHostOption("ray-peer-host", "Ray board address for laser and exhaust commands.", "host", "192.168.88.99");
+    QCommandLineOption rayPeerPortOption("ray-peer-port", "Ray board UDP command port.", "port", "9999");
+    QCommandLineOption rayBinaryCommandsOption("ray-binary-commands", "Send binary ray commands with acks and retries.");
+    QCommandLineOption captureSourceOption("capture-source", "Capture source: camera index, file, image directory, URL, gst:pipeline, v4l2:device or synth:params, "
+                                                             "optionally followed by ?width=..&height=..&fps=..&buffer=..", "source",
+                                           "http://192.168.88.235:8080/?action=stream");
+    parser.addOption(captureSourceOption);
+    QCommandLineOption captureStreamOption("capture", "Start an additional named capture stream, e.g. second=/dev/video2. "
+                                                      "Shown on the video surface of the same name.", "name=source");
+    QCommandLineOption captureSyncOption("capture-sync", "Soft-synchronize all capture streams whose frames are within tolerance.", "ms");
+    parser.addOption(captureStreamOption);
+    parser.addOption(captureSyncOption);
+    QCommandLineOption benchmarkOption("benchmark", "Run the detector on --capture-source frame by frame as fast as possible, "
+                                                    "report throughput and dz error of synth: sources, then quit.");
+    parser.addOption(benchmarkOption);
+    QCommandLineOption machineOption("machine", "Machine name the laser plane calibration is stored under, defaults to --mc-host.", "name");
+    parser.addOption(machineOption);
+    QCommandLineOption mosaicOption("mosaic", "Build a tiled mosaic of the bed from placed frames into a directory.", "directory");
+    QCommandLineOption mosaicParamsOption("mosaic-params", "Mosaic parameters: ppmm, camera-ppmm, offset-x, offset-y, width, height, "
+                                                           "step, feather, refine, max-shift as key=value&...", "params");
+    QCommandLineOption mosaicStreamOption("mosaic-stream", "Capture stream the mosaic is built from.", "name", CaptureController::mainStream);
+    parser.addOption(mosaicOption);
+    parser.addOption(mosaicParamsOption);
+    parser.addOption(mosaicStreamOption);
+    parser.addOption(mcHostOption);
+    parser.addOption(mcPortOption);
+    parser.addOption(rayPortOption);
+    parser.addOption(rayPeerHostOption);
+    parser.addOption(rayPeerPortOption);
+    QCommandLineOption recordOption("record", "Record telemetry, detector output and MC traffic to a session log.", "file");
+    parser.addOption(rayBinaryCommandsOption);
+    QCommandLineOption replayOption("replay", "Drive capture, telemetry and MC responses from a recorded session log.", "file");
+    QCommandLineOption replayVideoOption("replay-video", "Video or frame log (.cvframes) recorded along with the replayed session.", "file");
+    QCommandLineOption replaySpeedOption("replay-speed", "Replay speed: realtime or afap (as fast as possible).", "speed", "realtime");
+    QCommandLineOption replayQuitOption("replay-quit", "Quit when replay is finished.");
+    QCommandLineOption recordFramesOption("record-frames", "Record raw captured frames to a frame log.", "file");
+    QCommandLineOption recordFramesCapacityOption("record-frames-capacity", "Frames preallocated in the frame log.", "count", "3000");
+    parser.addOption(recordOption);
+    parser.addOption(recordFramesOption);
+    parser.addOption(recordFramesCapacityOption);
+    parser.addOption(replayOption);
+    parser.addOption(replayVideoOption);
+    parser.addOption(replaySpeedOption);
+    parser.addOption(replayQuitOption);
+    parser.process(app);
+
     QQmlApplicationEngine engine;
 
     qmlRegisterType<CVMatSurfaceSource>("io.opencv", 1, 0, "CVMatSurfaceSource");
     //qmlRegisterType<CaptureController>("io.opencv", 1, 0, "CaptureController");
 
+    // Declared before its producers so it outlives the threads that record into it
+    SessionRecorder recorder;
+
     CaptureController captureController;
+    CaptureStream *laserStream = captureController.stream(CaptureController::mainStream);
 
-    CameraCalibrator cameraCalibrator(&captureController);
-    QObject::connect(&captureController, &CaptureController::frameReady,
-                     &cameraCalibrator,  &CameraCalibrator::onFrameReady);
+    CameraCalibrator cameraCalibrator(laserStream);
+    captureController.subscribe(CaptureController::mainStream, &cameraCalibrator, &CameraCalibrator::onFrameReady);
 
     qmlRegisterUncreatableType<LineDetector>("tech.vhrd.vision", 1, 0, "LineDetector", "Only for enums");
-    LineDetector lineDetector(&captureController);
-    QObject::connect(&captureController, &CaptureController::frameReady,
-                     &lineDetector,      &LineDetector::onFrameReady);
+    LineDetector lineDetector(laserStream);
+    captureController.subscribe(CaptureController::mainStream, &lineDetector, &LineDetector::onFrameReady);
+    LaserLevelControl laserLevelControl(&lineDetector, laserStream);
     LineDetectorDataSource lineDetectorDataSource;
     QObject::connect(&lineDetector,           &LineDetector::integrationComplete,
                      &lineDetectorDataSource, &LineDetectorDataSource::updateIntegratedPlot);
@@ -39,24 +104,56 @@ int main(int argc, char *argv[])
                      &lineDetectorDataSource, &LineDetectorDataSource::drawBeamThickness);
 
     engine.rootContext()->setContextProperty("captureController", &captureController);
+    engine.rootContext()->setContextProperty("captureSource", parser.value(captureSourceOption));
+    engine.rootContext()->setContextProperty("frameRecorder", laserStream->frameRecorder());
+    if (parser.isSet(recordFramesOption))
+        laserStream->frameRecorder()->start(parser.value(recordFramesOption),
+                                            parser.value(recordFramesCapacityOption).toInt());
     engine.rootContext()->setContextProperty("cameraCalibrator", &cameraCalibrator);
     engine.rootContext()->setContextProperty("lineDetector", &lineDetector);
     engine.rootContext()->setContextProperty("lineDetectorDataSource", &lineDetectorDataSource);
+    engine.rootContext()->setContextProperty("laserLevelControl", &laserLevelControl);
 
     GcodePlayer::registerQmlTypes();
     GcodePlayerModel::registerQmlTypes();
     GcodePlayer player;
+    player.setMcHost(parser.value(mcHostOption));
+    player.setMcPort(parser.value(mcPortOption).toUShort());
     engine.rootContext()->setContextProperty("player", &player);
 
     RayReceiver receiver;
+    if (parser.isSet(rayPortOption))
+        receiver.setListenPort(parser.value(rayPortOption).toUShort());
+    receiver.setPeer(parser.value(rayPeerHostOption), parser.value(rayPeerPortOption).toUShort());
+    if (parser.isSet(rayBinaryCommandsOption))
+        receiver.setCommandEncoding(RayCommandSender::Binary);
     engine.rootContext()->setContextProperty("ray", &receiver);
 
+    QString mosaicStream = parser.value(mosaicStreamOption);
+    MosaicBuilder mosaicBuilder(captureController.addStream(mosaicStream), &receiver);
+    captureController.subscribe(mosaicStream, &mosaicBuilder, &MosaicBuilder::onFrameReady);
+    engine.addImageProvider("mosaic", new MosaicImageProvider(mosaicBuilder.canvas()));
+    engine.rootContext()->setContextProperty("mosaicBuilder", &mosaicBuilder);
+    engine.rootContext()->setContextProperty("mosaicParams", parser.value(mosaicParamsOption));
+    if (parser.isSet(mosaicOption))
+        mosaicBuilder.start(parser.value(mosaicOption), parser.value(mosaicParamsOption));
+
+    qmlRegisterUncreatableType<DzFilter>("tech.vhrd.vision", 1, 0, "DzFilter", "Only for enums");
+    DzFilter dzFilter;
+    engine.rootContext()->setContextProperty("dzFilter", &dzFilter);
+    QObject::connect(&lineDetector, QOverload<float>::of(&LineDetector::dzChanged),
+                     &dzFilter,     &DzFilter::ondzChanged);
+    QObject::connect(&lineDetector, &LineDetector::dzValidChanged,
+                     &dzFilter,     &DzFilter::ondzValidChanged);
+
     Automator automator;
     engine.rootContext()->setContextProperty("automator", &automator);
-    QObject::connect(&lineDetector, QOverload<float>::of(&LineDetector::dzChanged),
+    QObject::connect(&dzFilter,     QOverload<float>::of(&DzFilter::dzChanged),
                      &automator,    &Automator::ondzChanged);
-    QObject::connect(&lineDetector, &LineDetector::dzValidChanged,
+    QObject::connect(&dzFilter,     &DzFilter::dzValidChanged,
                      &automator,    &Automator::ondzValidChanged);
+    QObject::connect(&dzFilter,     &DzFilter::qualityChanged,
+                     &automator,    &Automator::ondzQualityChanged);
     QObject::connect(&player,       QOverload<bool>::of(&GcodePlayer::connectionStateChanged),
                      &automator,    &Automator::onMcConnectionStateChanged);
     QObject::connect(&receiver,     &RayReceiver::stateChanged,
@@ -70,6 +167,48 @@ int main(int argc, char *argv[])
     QObject::connect(&automator,    &Automator::sendToMC,
                      &player,       &GcodePlayer::send);
 
+    QString machine = parser.isSet(machineOption) ? parser.value(machineOption) : parser.value(mcHostOption);
+    LaserCalibrator laserCalibrator(&lineDetector, &player, QString("laserplane-%1.yml").arg(machine));
+    QObject::connect(&laserCalibrator, &LaserCalibrator::calibrated,
+                     &automator,       [&]() { automator.setLaserPlaneActive(lineDetector.laserPlane().isValid()); });
+    laserCalibrator.load();
+    engine.rootContext()->setContextProperty("laserCalibrator", &laserCalibrator);
+
+    engine.rootContext()->setContextProperty("recorder", &recorder);
+    laserStream->setSessionRecorder(&recorder);
+    receiver.setSessionRecorder(&recorder);
+    player.setSessionRecorder(&recorder);
+    QObject::connect(&lineDetector, QOverload<float>::of(&LineDetector::dzChanged),
+                     &recorder,     &SessionRecorder::recordDz);
+    QObject::connect(&lineDetector, &LineDetector::stateChanged,
+                     &recorder,     [&]() { recorder.recordDetectorState(lineDetector.state()); });
+    QObject::connect(&automator,    &Automator::sendToMC,
+                     &recorder,     &SessionRecorder::recordAutomatorCommand);
+    QObject::connect(&automator,    &Automator::changePower,
+                     &recorder,     &SessionRecorder::recordAutomatorPower);
+    if (parser.isSet(recordOption))
+        recorder.start(parser.value(recordOption));
+
+    DetectorBenchmark benchmark(laserStream, &lineDetector);
+    if (parser.isSet(benchmarkOption)) {
+        QObject::connect(&benchmark, &DetectorBenchmark::finished,
+                         &app,       &QCoreApplication::quit);
+        benchmark.start(parser.value(captureSourceOption));
+    }
+
+    SessionReplayer replayer(laserStream, &receiver, &player);
+    engine.rootContext()->setContextProperty("replayer", &replayer);
+    if (parser.isSet(replayOption)) {
+        if (!replayer.open(parser.value(replayOption), parser.value(replayVideoOption)))
+            return 1;
+        if (parser.value(replaySpeedOption) == "afap")
+            replayer.setMode(SessionReplayer::AsFastAsPossible);
+        if (parser.isSet(replayQuitOption))
+            QObject::connect(&replayer, &SessionReplayer::finished,
+                             &app,      &QCoreApplication::quit);
+        replayer.start();
+    }
+
     const QUrl url(QStringLiteral("qrc:/main.qml"));
     QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
                      &app, [url](QObject *obj, const QUrl &objUrl) {
@@ -78,5 +217,22 @@ int main(int argc, char *argv[])
     }, Qt::QueuedConnection);
     engine.load(url);
 
+    // Started after QML is loaded so their preview surfaces exist
+    QMap<QString, QString> extraStreams;
+    for (const QString &stream : parser.values(captureStreamOption)) {
+        int separator = stream.indexOf('=');
+        if (separator <= 0) {
+            qWarning() << "Capture stream must be given as name=source:" << stream;
+            continue;
+        }
+        extraStreams.insert(stream.left(separator), stream.mid(separator + 1));
+        captureController.addStream(stream.left(separator));
+    }
+    if (parser.isSet(captureSyncOption))
+        captureController.setSync(captureController.streamNames(),
+                                  static_cast<qint64>(parser.value(captureSyncOption).toDouble() * 1000000));
+    for (auto it = extraStreams.constBegin(); it != extraStreams.constEnd(); ++it)
+        captureController.start(it.key(), it.value());
+
     return app.exec();
 }
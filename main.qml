@@ -165,7 +165,34 @@ Window {
                     from: 0
                     to: 1
                     stepSize: 0.01
-                    onValueChanged: lineDetector.threshold = value
+                    enabled: !laserLevelControl.autoThreshold
+                    // Follows auto threshold, only a user drag writes back
+                    value: lineDetector.threshold
+                    onMoved: lineDetector.threshold = value
+                }
+
+                CheckBox {
+                    text: "Auto"
+                    checked: laserLevelControl.autoThreshold
+                    onToggled: laserLevelControl.autoThreshold = checked
+                }
+            }
+            RowLayout {
+                Layout.maximumHeight: 24
+                Text {
+                    text: "Auto exposure:"
+                    color: "gray"
+                    Layout.preferredWidth: settingsLayout.width * 0.4
+                }
+
+                CheckBox {
+                    checked: laserLevelControl.autoExposure
+                    onToggled: laserLevelControl.autoExposure = checked
+                }
+
+                Text {
+                    color: "gray"
+                    text: laserLevelControl.exposure + " (" + (laserLevelControl.beamLevel * 100).toFixed(0) + "%)"
                 }
             }
             RowLayout {
@@ -183,6 +210,33 @@ Window {
                     onValueChanged: lineDetector.rotation = value
                 }
             }
+            RowLayout {
+                Layout.maximumHeight: 24
+                Text {
+                    text: "dz filter:"
+                    color: "gray"
+                    Layout.preferredWidth: settingsLayout.width * 0.4
+                }
+
+                ComboBox {
+                    model: ["Off", "Median", "Kalman", "Alpha-beta"]
+                    currentIndex: dzFilter.mode
+                    onActivated: dzFilter.mode = index
+                }
+            }
+            RowLayout {
+                Layout.maximumHeight: 24
+                Text {
+                    text: "Column profile:"
+                    color: "gray"
+                    Layout.preferredWidth: settingsLayout.width * 0.4
+                }
+
+                CheckBox {
+                    checked: lineDetector.columnProfile
+                    onToggled: lineDetector.columnProfile = checked
+                }
+            }
 
 
             Item {
@@ -281,7 +335,15 @@ Window {
             anchors.right: stateLabel.left
             anchors.rightMargin: 8
             color: "gray"
-            text: lineDetector.dz.toFixed(3)
+            text: dzFilter.dz.toFixed(3)
+        }
+
+        Text {
+            anchors.top: dzLabel.top
+            anchors.right: dzLabel.left
+            anchors.rightMargin: 8
+            color: dzFilter.quality < automator.minQuality ? "#f44336" : "gray"
+            text: "q " + dzFilter.quality.toFixed(2)
         }
 
         Button {
@@ -291,11 +353,21 @@ Window {
             anchors.rightMargin: 8
             text: "0"
             height: 34
-            onClicked: lineDetector.zerodxs()
+            onClicked: {
+                lineDetector.zerodxs()
+                dzFilter.reset()
+            }
         }
     }
 
 
+    function formatDuration(seconds) {
+        var s = Math.round(seconds)
+        var h = Math.floor(s / 3600)
+        var m = Math.floor((s % 3600) / 60)
+        return h + ":" + String(m).padStart(2, '0') + ":" + String(s % 60).padStart(2, '0')
+    }
+
     function osdRescale(item, videoSource, videoOutput) {
         if (videoSource.width === 0)
             return
@@ -326,6 +398,11 @@ Window {
 //        onCurrentLineChanged: commandsListView.positionViewAtIndex(currentLineNumber, ListView.Center)
 //    }
 
+    MosaicView {
+        id: mosaicView
+        visible: false
+    }
+
     FileDialog {
         id: playerFileDialog
         title: "Choose gcode file"
@@ -371,6 +448,38 @@ Window {
                 onClicked: player.stop();
             }
 
+            SpinBox {
+                id: resumeLineSpinBox
+                from: 1
+                to: Math.max(1, player.linesCount)
+                editable: true
+            }
+
+            Button {
+                text: "Resume"
+                onClicked: player.resumeFrom(resumeLineSpinBox.value);
+            }
+
+            Button {
+                text: recorder.recording ? "Stop recording" : "Record"
+                onClicked: {
+                    if (recorder.recording)
+                        recorder.stop();
+                    else
+                        recorder.start("session-" + Qt.formatDateTime(new Date(), "yyyyMMdd-hhmmss") + ".cvlog");
+                }
+            }
+
+            Button {
+                text: frameRecorder.recording ? "Stop frames" : "Record frames"
+                onClicked: {
+                    if (frameRecorder.recording)
+                        frameRecorder.stop();
+                    else
+                        frameRecorder.start("frames-" + Qt.formatDateTime(new Date(), "yyyyMMdd-hhmmss") + ".cvframes");
+                }
+            }
+
             Text {
                 id: connectionStatusLabel
                 font.bold: true
@@ -436,7 +545,9 @@ Window {
                 font.bold: true
                 font.pointSize: 14
                 color: "#ccc"
-                text: player.currentLineNumber + " / " + player.linesCount + " (" + (player.currentLineNumber / player.linesCount).toFixed(1) + " %)"
+                text: player.currentLineNumber + " / " + player.linesCount +
+                      " (" + (player.progress * 100).toFixed(1) + " %) " +
+                      formatDuration(player.remainingTime) + " / " + formatDuration(player.estimatedDuration)
             }
 
             Item {
@@ -757,15 +868,22 @@ Window {
         spacing: 10
         width: 200
 
+        TextField {
+            id: captureSourceField
+            Layout.fillWidth: true
+            text: captureSource
+            selectByMouse: true
+        }
+
         Button {
             text: "Capture"
             onClicked: {
-                captureController.start("abcd")
+                captureController.start(captureSourceField.text)
             }
         }
 
         Button {
-            text: "Take pic"
+            text: "Take pic (" + cameraCalibrator.picturesCount + ")"
             onClicked: cameraCalibrator.takePicture()
         }
 
@@ -775,12 +893,16 @@ Window {
         }
 
         Button {
-            text: "Load pics"
+            text: cameraCalibrator.busy ? "Loading " + cameraCalibrator.progress + "%" : "Load pics"
+            enabled: !cameraCalibrator.busy
             onClicked: cameraCalibrator.loadPictures("./pictures")
         }
 
         Button {
-            text: "Calibrate"
+            text: cameraCalibrator.calibrating ? "Calibrating " + cameraCalibrator.calibrationProgress + "%"
+                                               : cameraCalibrator.rms > 0 ? "Calibrate (" + cameraCalibrator.rms.toFixed(2) + " px)"
+                                                                          : "Calibrate"
+            enabled: !cameraCalibrator.calibrating
             onClicked: cameraCalibrator.calibrate()
         }
 
@@ -799,6 +921,18 @@ Window {
             onClicked: cameraCalibrator.applyCalibrationData()
         }
 
+        Button {
+            text: laserCalibrator.running ? "Laser " + laserCalibrator.progress + "%"
+                                          : laserCalibrator.rms > 0 ? "Calib laser (" + laserCalibrator.rms.toFixed(3) + " mm)"
+                                                                    : "Calib laser"
+            onClicked: laserCalibrator.running ? laserCalibrator.cancel() : laserCalibrator.start()
+        }
+
+        Button {
+            text: "Mosaic"
+            onClicked: mosaicView.visible = true
+        }
+
         Item {
             Layout.fillHeight: true
         }
@@ -0,0 +1,40 @@
+#ifndef MONOTONICCLOCK_H
+#define MONOTONICCLOCK_H
+
+#include <QtGlobal>
+#include <chrono>
+#include <atomic>
+
+/**
+ * @brief monotonicNs Timestamp [ns] of a steady clock shared by capture, telemetry and detection
+ */
+inline qint64 monotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline std::atomic<qint64> &virtualClockNs()
+{
+    static std::atomic<qint64> ns(-1);
+    return ns;
+}
+
+/**
+ * @brief setVirtualClockNs Makes sessionNs() follow replayed session time, negative value switches back to monotonicNs()
+ */
+inline void setVirtualClockNs(qint64 ns)
+{
+    virtualClockNs().store(ns, std::memory_order_release);
+}
+
+/**
+ * @brief sessionNs Time base for rate limits and recorded timestamps, equals monotonicNs() unless a session is replayed
+ */
+inline qint64 sessionNs()
+{
+    qint64 ns = virtualClockNs().load(std::memory_order_acquire);
+    return ns < 0 ? monotonicNs() : ns;
+}
+
+#endif // MONOTONICCLOCK_H
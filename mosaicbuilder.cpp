@@ -0,0 +1,229 @@
+#include "mosaicbuilder.h"
+#include "capturestream.hpp"
+#include "rayreceiver.h"
+
+#include <QDebug>
+#include <QUrlQuery>
+#include <QtMath>
+#include <opencv2/imgproc.hpp>
+
+namespace {
+const int FlushEvery = 25;       ///< Placed frames between tile writes
+const double MinResponse = 0.15; ///< Weakest phase correlation peak trusted for refinement
+const double MinCoverage = 0.5;  ///< Part of the frame the canvas must already have for refinement
+}
+
+MosaicBuilder::Parameters::Parameters() :
+    ppmm(4), cameraPpmm(9.8833333f), offsetX(0), offsetY(0), bedWidth(2200), bedHeight(1500),
+    minStep(5), feather(0.15f), refine(true), maxShift(3)
+{
+}
+
+MosaicBuilder::Parameters MosaicBuilder::Parameters::parse(const QString &description)
+{
+    Parameters p;
+    QUrlQuery query(description);
+    auto value = [&query](const char *key, float fallback) {
+        return query.hasQueryItem(key) ? query.queryItemValue(key).toFloat() : fallback;
+    };
+    p.ppmm = value("ppmm", p.ppmm);
+    p.cameraPpmm = value("camera-ppmm", p.cameraPpmm);
+    p.offsetX = value("offset-x", p.offsetX);
+    p.offsetY = value("offset-y", p.offsetY);
+    p.bedWidth = value("width", p.bedWidth);
+    p.bedHeight = value("height", p.bedHeight);
+    p.minStep = value("step", p.minStep);
+    p.feather = value("feather", p.feather);
+    p.maxShift = value("max-shift", p.maxShift);
+    if (query.hasQueryItem("refine"))
+        p.refine = query.queryItemValue("refine") != "0";
+    return p;
+}
+
+MosaicBuilder::MosaicBuilder(CaptureStream *captureStream, const RayReceiver *receiver, QObject *parent) :
+    QObject(parent), m_captureStream(captureStream), m_receiver(receiver), m_canvas(new MosaicCanvas),
+    m_queue(nullptr), m_running(false), m_hasLast(false), m_lastX(0), m_lastY(0),
+    m_framesPlaced(0), m_revision(0)
+{
+}
+
+MosaicBuilder::~MosaicBuilder()
+{
+    stop();
+}
+
+bool MosaicBuilder::start(const QString &directory, const QString &parameters)
+{
+    stop();
+    m_parameters = Parameters::parse(parameters);
+    cv::Size size(qCeil(m_parameters.bedWidth * m_parameters.ppmm), qCeil(m_parameters.bedHeight * m_parameters.ppmm));
+    if (!m_canvas->open(directory, size))
+        return false;
+    qDebug() << "Mosaic" << size.width << "x" << size.height << "px," << m_canvas->levels() << "levels in" << directory;
+
+    m_queue = new BoundedQueue<placed_frame_t>(1);
+    MosaicWorker *worker = new MosaicWorker(this);
+    worker->moveToThread(&m_workerThread);
+    connect(&m_workerThread, &QThread::started,
+            worker,          &MosaicWorker::doWork);
+    connect(&m_workerThread, &QThread::finished,
+            worker,          &QObject::deleteLater);
+    m_workerThread.start();
+
+    m_hasLast = false;
+    m_framesPlaced = 0;
+    m_running = true;
+    emit runningChanged();
+    return true;
+}
+
+void MosaicBuilder::stop()
+{
+    if (!m_running)
+        return;
+    m_running = false;
+    m_queue->close();
+    m_workerThread.quit();
+    m_workerThread.wait();
+    delete m_queue;
+    m_queue = nullptr;
+    m_canvas->flush();
+    m_revision++;
+    emit runningChanged();
+    emit revisionChanged();
+}
+
+void MosaicBuilder::onFrameReady()
+{
+    if (!m_running)
+        return;
+    // Cheap check first, most frames are not placed and are never copied
+    ray_payload_t position;
+    if (!m_receiver->history().positionAt(m_captureStream->frameTimestamp(), position))
+        return;
+    if (m_hasLast && qAbs(position.mcs_x - m_lastX) < m_parameters.minStep
+                  && qAbs(position.mcs_y - m_lastY) < m_parameters.minStep)
+        return;
+    // A newer frame may have been published meanwhile, position is looked up again for the copied one
+    qint64 timestamp = 0;
+    placed_frame_t item;
+    item.frame = m_captureStream->frameCopy(&timestamp);
+    if (item.frame.empty() || !m_receiver->history().positionAt(timestamp, position))
+        return;
+    item.x = position.mcs_x;
+    item.y = position.mcs_y;
+    m_queue->pushDropOldest(item);
+    m_hasLast = true;
+    m_lastX = item.x;
+    m_lastY = item.y;
+}
+
+void MosaicBuilder::placeFrames()
+{
+    placed_frame_t item;
+    int placed = 0;
+    while (m_queue->pop(item)) {
+        place(item);
+        m_framesPlaced++;
+        if (++placed % FlushEvery == 0) {
+            m_canvas->flush();
+            m_revision++;
+            // Runs on the worker thread, QML bindings on revision must be reevaluated in the GUI thread
+            QMetaObject::invokeMethod(this, "revisionChanged", Qt::QueuedConnection);
+        }
+    }
+}
+
+void MosaicBuilder::place(const placed_frame_t &item)
+{
+    cv::Mat frame;
+    double scale = m_parameters.ppmm / m_parameters.cameraPpmm;
+    cv::resize(item.frame, frame, cv::Size(), scale, scale, scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+    if (frame.channels() != 3)
+        return;
+
+    // Canvas row 0 is the far edge of the bed, so +Y is up as in the image
+    cv::Point2f center((item.x + m_parameters.offsetX) * m_parameters.ppmm,
+                       (m_parameters.bedHeight - item.y - m_parameters.offsetY) * m_parameters.ppmm);
+    cv::Point origin(qRound(center.x - frame.cols / 2.0f), qRound(center.y - frame.rows / 2.0f));
+
+    if (m_parameters.refine) {
+        cv::Mat existing = m_canvas->read(cv::Rect(origin, frame.size()));
+        std::vector<cv::Mat> planes;
+        cv::split(existing, planes);
+        if (cv::countNonZero(planes[3]) > MinCoverage * frame.total()) {
+            cv::Mat canvasGray, frameGray, window;
+            cv::cvtColor(existing, canvasGray, cv::COLOR_BGRA2GRAY);
+            cv::cvtColor(frame, frameGray, cv::COLOR_BGR2GRAY);
+            canvasGray.convertTo(canvasGray, CV_32F);
+            frameGray.convertTo(frameGray, CV_32F);
+            cv::createHanningWindow(window, frame.size(), CV_32F);
+            double response = 0;
+            cv::Point2d shift = cv::phaseCorrelate(canvasGray, frameGray, window, &response);
+            double maxShift = m_parameters.maxShift * m_parameters.ppmm;
+            if (response > MinResponse && qAbs(shift.x) < maxShift && qAbs(shift.y) < maxShift)
+                origin -= cv::Point(qRound(shift.x), qRound(shift.y));
+        }
+    }
+
+    m_canvas->blend(frame, featherWeight(frame.size()), origin);
+}
+
+const cv::Mat &MosaicBuilder::featherWeight(const cv::Size &size)
+{
+    if (m_weight.size() == size)
+        return m_weight;
+    // Weight ramps up from the frame edges, so seams between frames fade instead of showing
+    float ramp = qMax(1.0f, m_parameters.feather * qMin(size.width, size.height));
+    m_weight.create(size, CV_32FC1);
+    for (int y = 0; y < size.height; ++y) {
+        float *w = m_weight.ptr<float>(y);
+        float dy = qMin(y + 0.5f, size.height - y - 0.5f);
+        for (int x = 0; x < size.width; ++x) {
+            float d = qMin(dy, qMin(x + 0.5f, size.width - x - 0.5f));
+            w[x] = qMin(1.0f, d / ramp);
+        }
+    }
+    return m_weight;
+}
+
+bool MosaicBuilder::running() const
+{
+    return m_running;
+}
+
+int MosaicBuilder::framesPlaced() const
+{
+    return m_framesPlaced;
+}
+
+int MosaicBuilder::revision() const
+{
+    return m_revision;
+}
+
+int MosaicBuilder::tileRevision(int level, int tx, int ty) const
+{
+    return m_canvas->tileRevision(level, tx, ty);
+}
+
+int MosaicBuilder::levels() const
+{
+    return m_canvas->levels();
+}
+
+int MosaicBuilder::tileSize() const
+{
+    return MosaicCanvas::TileSize;
+}
+
+QSize MosaicBuilder::canvasSize() const
+{
+    cv::Size size = m_canvas->size();
+    return QSize(size.width, size.height);
+}
+
+QSharedPointer<MosaicCanvas> MosaicBuilder::canvas() const
+{
+    return m_canvas;
+}
@@ -0,0 +1,126 @@
+#ifndef MOSAICBUILDER_H
+#define MOSAICBUILDER_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QSize>
+#include <QThread>
+#include <atomic>
+#include <opencv2/core.hpp>
+
+#include "boundedqueue.h"
+#include "mosaiccanvas.h"
+
+class CaptureStream;
+class RayReceiver;
+
+/**
+ * @brief The MosaicBuilder class places undistorted frames of a capture stream into a MosaicCanvas of the bed,
+ * at the machine position telemetry had when each frame was grabbed. Placement can be refined by phase correlation
+ * with what is already on the canvas. Blending and tile writes run on a worker thread, frames arriving while it is
+ * busy are dropped.
+ */
+class MosaicBuilder : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int framesPlaced READ framesPlaced NOTIFY revisionChanged)
+    Q_PROPERTY(int revision READ revision NOTIFY revisionChanged)
+    Q_PROPERTY(int levels READ levels NOTIFY runningChanged)
+    Q_PROPERTY(int tileSize READ tileSize CONSTANT)
+    Q_PROPERTY(QSize canvasSize READ canvasSize NOTIFY runningChanged)
+public:
+    /**
+     * @brief The Parameters struct is parsed from "key=value&..."
+     */
+    struct Parameters {
+        Parameters();
+        static Parameters parse(const QString &description);
+
+        float ppmm;        ///< Canvas resolution, px per mm
+        float cameraPpmm;  ///< Camera resolution on the sheet, px per mm
+        float offsetX;     ///< Camera center relative to machine position, mm
+        float offsetY;
+        float bedWidth;    ///< mm
+        float bedHeight;
+        float minStep;     ///< Machine travel between placed frames, mm
+        float feather;     ///< Blending ramp at frame edges, fraction of the shorter side
+        bool refine;       ///< Phase correlate with the canvas before placing
+        float maxShift;    ///< Largest accepted refinement, mm
+    };
+
+    MosaicBuilder(CaptureStream *captureStream, const RayReceiver *receiver, QObject *parent = nullptr);
+    ~MosaicBuilder();
+
+    /**
+     * @brief start Builds into directory, keeping tiles already there. Image right is taken as +X, image up as +Y.
+     */
+    Q_INVOKABLE bool start(const QString &directory, const QString &parameters = QString());
+    Q_INVOKABLE void stop();
+
+    bool running() const;
+    int framesPlaced() const;
+    /**
+     * @brief revision Changes whenever placed frames are flushed to tiles, for reloading images
+     */
+    int revision() const;
+    /**
+     * @brief tileRevision Changes only with the tile, to reload just the tiles a revision touched
+     */
+    Q_INVOKABLE int tileRevision(int level, int tx, int ty) const;
+    int levels() const;
+    int tileSize() const;
+    QSize canvasSize() const;
+
+    QSharedPointer<MosaicCanvas> canvas() const;
+
+signals:
+    void runningChanged();
+    void revisionChanged();
+
+public slots:
+    void onFrameReady();
+
+private:
+    friend class MosaicWorker;
+    typedef struct {
+        cv::Mat frame;
+        float x; ///< Machine position when frame was grabbed, mm
+        float y;
+    } placed_frame_t;
+    void placeFrames();
+    void place(const placed_frame_t &item);
+    const cv::Mat &featherWeight(const cv::Size &size);
+
+    CaptureStream *m_captureStream;
+    const RayReceiver *m_receiver;
+    QSharedPointer<MosaicCanvas> m_canvas;
+    Parameters m_parameters;
+    BoundedQueue<placed_frame_t> *m_queue;
+    QThread m_workerThread;
+    bool m_running;
+    bool m_hasLast;
+    float m_lastX;
+    float m_lastY;
+    std::atomic<int> m_framesPlaced;
+    std::atomic<int> m_revision;
+    cv::Mat m_weight; ///< Feather weight of the last frame size, worker thread only
+};
+
+/**
+ * @brief The MosaicWorker class runs MosaicBuilder::placeFrames() on the builder's worker thread
+ */
+class MosaicWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MosaicWorker(MosaicBuilder *builder) : m_builder(builder) {}
+
+public slots:
+    void doWork() { m_builder->placeFrames(); }
+
+private:
+    MosaicBuilder *m_builder;
+};
+
+#endif // MOSAICBUILDER_H
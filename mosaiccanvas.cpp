@@ -0,0 +1,290 @@
+#include "mosaiccanvas.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+MosaicCanvas::MosaicCanvas() :
+    m_levels(0), m_useCounter(0)
+{
+}
+
+MosaicCanvas::~MosaicCanvas()
+{
+    close();
+}
+
+bool MosaicCanvas::open(const QString &directory, const cv::Size &size)
+{
+    close();
+    QMutexLocker lock(&m_mutex);
+    if (!QDir().mkpath(directory)) {
+        qWarning() << "Can't create mosaic directory" << directory;
+        return false;
+    }
+    m_directory = directory;
+    m_size = size;
+    m_levels = 1;
+    while (std::max(m_size.width, m_size.height) > (TileSize << (m_levels - 1)))
+        m_levels++;
+
+    cv::FileStorage fs(QDir(directory).filePath("mosaic.yml").toStdString(), cv::FileStorage::WRITE);
+    if (fs.isOpened()) {
+        fs << "width" << m_size.width;
+        fs << "height" << m_size.height;
+        fs << "tileSize" << static_cast<int>(TileSize);
+        fs << "levels" << m_levels;
+    }
+    return true;
+}
+
+void MosaicCanvas::close()
+{
+    flush();
+    QMutexLocker lock(&m_mutex);
+    m_cache.clear();
+    m_stale.clear();
+    m_directory.clear();
+    m_size = cv::Size();
+    m_levels = 0;
+}
+
+bool MosaicCanvas::isOpen() const
+{
+    QMutexLocker lock(&m_mutex);
+    return !m_directory.isEmpty();
+}
+
+cv::Size MosaicCanvas::size() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_size;
+}
+
+int MosaicCanvas::levels() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_levels;
+}
+
+cv::Size MosaicCanvas::tileCount(int level) const
+{
+    QMutexLocker lock(&m_mutex);
+    int span = TileSize << level;
+    return cv::Size((m_size.width + span - 1) / span, (m_size.height + span - 1) / span);
+}
+
+void MosaicCanvas::blend(const cv::Mat &image, const cv::Mat &weight, const cv::Point &origin)
+{
+    CV_Assert(image.type() == CV_8UC3 && weight.type() == CV_32FC1 && image.size() == weight.size());
+    QMutexLocker lock(&m_mutex);
+    if (m_directory.isEmpty())
+        return;
+    cv::Rect placed = cv::Rect(origin, image.size()) & cv::Rect(cv::Point(0, 0), m_size);
+    if (placed.area() == 0)
+        return;
+    for (int ty = placed.y / TileSize; ty <= (placed.br().y - 1) / TileSize; ++ty) {
+        for (int tx = placed.x / TileSize; tx <= (placed.br().x - 1) / TileSize; ++tx) {
+            cv::Rect tileRect(tx * TileSize, ty * TileSize, TileSize, TileSize);
+            cv::Rect common = placed & tileRect;
+            cv::Mat tile = cachedTile(0, tx, ty, true);
+            cv::Mat dst = tile(common - tileRect.tl());
+            cv::Mat src = image(common - origin);
+            cv::Mat w = weight(common - origin);
+            for (int y = 0; y < common.height; ++y) {
+                uchar *d = dst.ptr<uchar>(y);
+                const uchar *s = src.ptr<uchar>(y);
+                const float *wn = w.ptr<float>(y);
+                for (int x = 0; x < common.width; ++x, d += 4, s += 3) {
+                    if (wn[x] <= 0)
+                        continue;
+                    float wo = d[3] * (1.0f / 255);
+                    float sum = wo + wn[x];
+                    float k = wn[x] / sum;
+                    d[0] = cv::saturate_cast<uchar>(d[0] + (s[0] - d[0]) * k);
+                    d[1] = cv::saturate_cast<uchar>(d[1] + (s[1] - d[1]) * k);
+                    d[2] = cv::saturate_cast<uchar>(d[2] + (s[2] - d[2]) * k);
+                    d[3] = cv::saturate_cast<uchar>(sum * 255);
+                }
+            }
+            m_cache[key(0, tx, ty)].dirty = true;
+            touch(key(0, tx, ty));
+            invalidateParents(tx, ty);
+        }
+    }
+}
+
+cv::Mat MosaicCanvas::read(const cv::Rect &rect)
+{
+    QMutexLocker lock(&m_mutex);
+    cv::Mat result(rect.size(), CV_8UC4, cv::Scalar::all(0));
+    cv::Rect inside = rect & cv::Rect(cv::Point(0, 0), m_size);
+    if (inside.area() == 0 || m_directory.isEmpty())
+        return result;
+    for (int ty = inside.y / TileSize; ty <= (inside.br().y - 1) / TileSize; ++ty) {
+        for (int tx = inside.x / TileSize; tx <= (inside.br().x - 1) / TileSize; ++tx) {
+            cv::Mat tile = cachedTile(0, tx, ty, false);
+            if (tile.empty())
+                continue;
+            cv::Rect tileRect(tx * TileSize, ty * TileSize, TileSize, TileSize);
+            cv::Rect common = inside & tileRect;
+            tile(common - tileRect.tl()).copyTo(result(common - rect.tl()));
+        }
+    }
+    return result;
+}
+
+cv::Mat MosaicCanvas::tile(int level, int tx, int ty)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_directory.isEmpty() || level < 0 || level >= m_levels)
+        return cv::Mat();
+    if (level > 0 && m_stale.contains(key(level, tx, ty)))
+        rebuild(level, tx, ty);
+    return cachedTile(level, tx, ty, false).clone();
+}
+
+void MosaicCanvas::flush()
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_directory.isEmpty())
+        return;
+    // Lower levels first, each one is built from the one below
+    for (int level = 1; level < m_levels; ++level) {
+        const QList<quint64> stale = m_stale.values();
+        for (quint64 k : stale) {
+            if (static_cast<int>(k >> 48) == level)
+                rebuild(level, static_cast<int>(k & 0xffffff), static_cast<int>((k >> 24) & 0xffffff));
+        }
+    }
+    for (auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+        if (it.value().dirty) {
+            writeTile(it.key(), it.value());
+            it.value().dirty = false;
+        }
+    }
+}
+
+int MosaicCanvas::tileRevision(int level, int tx, int ty) const
+{
+    QMutexLocker lock(&m_revisionMutex);
+    return m_revisions.value(key(level, tx, ty));
+}
+
+void MosaicCanvas::touch(quint64 key)
+{
+    QMutexLocker lock(&m_revisionMutex);
+    m_revisions[key]++;
+}
+
+quint64 MosaicCanvas::key(int level, int tx, int ty)
+{
+    return (static_cast<quint64>(level) << 48) | (static_cast<quint64>(ty) << 24) | static_cast<quint64>(tx);
+}
+
+QString MosaicCanvas::tilePath(int level, int tx, int ty) const
+{
+    return QString("%1/%2/%3_%4.png").arg(m_directory).arg(level).arg(ty).arg(tx);
+}
+
+cv::Mat MosaicCanvas::cachedTile(int level, int tx, int ty, bool create)
+{
+    quint64 k = key(level, tx, ty);
+    auto it = m_cache.find(k);
+    if (it != m_cache.end()) {
+        it.value().used = ++m_useCounter;
+        return it.value().image;
+    }
+    cv::Mat image;
+    QString path = tilePath(level, tx, ty);
+    if (QFile::exists(path))
+        image = cv::imread(path.toStdString(), cv::IMREAD_UNCHANGED);
+    if (image.empty() || image.type() != CV_8UC4) {
+        if (!create)
+            return cv::Mat();
+        image = cv::Mat(TileSize, TileSize, CV_8UC4, cv::Scalar::all(0));
+    }
+    if (m_cache.size() >= CacheTiles)
+        evict();
+    CachedTile cached;
+    cached.image = image;
+    cached.dirty = false;
+    cached.used = ++m_useCounter;
+    m_cache.insert(k, cached);
+    return image;
+}
+
+void MosaicCanvas::storeTile(int level, int tx, int ty, const cv::Mat &image)
+{
+    quint64 k = key(level, tx, ty);
+    if (!m_cache.contains(k) && m_cache.size() >= CacheTiles)
+        evict();
+    CachedTile cached;
+    cached.image = image;
+    cached.dirty = true;
+    cached.used = ++m_useCounter;
+    m_cache.insert(k, cached);
+}
+
+void MosaicCanvas::evict()
+{
+    auto oldest = m_cache.end();
+    for (auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+        if (oldest == m_cache.end() || it.value().used < oldest.value().used)
+            oldest = it;
+    }
+    if (oldest == m_cache.end())
+        return;
+    if (oldest.value().dirty)
+        writeTile(oldest.key(), oldest.value());
+    m_cache.erase(oldest);
+}
+
+void MosaicCanvas::writeTile(quint64 key, const CachedTile &tile)
+{
+    int level = static_cast<int>(key >> 48);
+    int ty = static_cast<int>((key >> 24) & 0xffffff);
+    int tx = static_cast<int>(key & 0xffffff);
+    QDir().mkpath(QString("%1/%2").arg(m_directory).arg(level));
+    QString path = tilePath(level, tx, ty);
+    if (!cv::imwrite(path.toStdString(), tile.image))
+        qWarning() << "Can't write mosaic tile" << path;
+}
+
+void MosaicCanvas::invalidateParents(int tx, int ty)
+{
+    for (int level = 1; level < m_levels; ++level) {
+        tx /= 2;
+        ty /= 2;
+        m_stale.insert(key(level, tx, ty));
+        touch(key(level, tx, ty));
+    }
+}
+
+void MosaicCanvas::rebuild(int level, int tx, int ty)
+{
+    m_stale.remove(key(level, tx, ty));
+    cv::Mat children(2 * TileSize, 2 * TileSize, CV_8UC4, cv::Scalar::all(0));
+    bool any = false;
+    for (int cy = 0; cy < 2; ++cy) {
+        for (int cx = 0; cx < 2; ++cx) {
+            int childX = 2 * tx + cx;
+            int childY = 2 * ty + cy;
+            if (level > 1 && m_stale.contains(key(level - 1, childX, childY)))
+                rebuild(level - 1, childX, childY);
+            cv::Mat child = cachedTile(level - 1, childX, childY, false);
+            if (child.empty())
+                continue;
+            child.copyTo(children(cv::Rect(cx * TileSize, cy * TileSize, TileSize, TileSize)));
+            any = true;
+        }
+    }
+    if (!any)
+        return;
+    cv::Mat halved;
+    cv::resize(children, halved, cv::Size(TileSize, TileSize), 0, 0, cv::INTER_AREA);
+    storeTile(level, tx, ty, halved);
+}
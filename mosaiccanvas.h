@@ -0,0 +1,87 @@
+#ifndef MOSAICCANVAS_H
+#define MOSAICCANVAS_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <opencv2/core.hpp>
+
+/**
+ * @brief The MosaicCanvas class is a sparse image of the whole bed split into TileSize square BGRA tiles on disk.
+ * Alpha is the accumulated blending weight, 0 where nothing was placed yet. Only CacheTiles tiles are kept in memory,
+ * the least recently used one is written out when another is needed. Level n + 1 halves level n and is rebuilt from
+ * it lazily, when a tile of it is asked for. Safe to use from several threads.
+ */
+class MosaicCanvas
+{
+public:
+    enum { TileSize = 512 };
+    enum { CacheTiles = 96 }; ///< ~100 MB of tiles in memory
+
+    MosaicCanvas();
+    ~MosaicCanvas();
+
+    /**
+     * @brief open Uses directory for tiles of a size.width x size.height px canvas, tiles already there are kept
+     */
+    bool open(const QString &directory, const cv::Size &size);
+    void close();
+    bool isOpen() const;
+
+    cv::Size size() const;
+    int levels() const;
+    /**
+     * @brief tileCount Number of tiles across and down at level
+     */
+    cv::Size tileCount(int level) const;
+
+    /**
+     * @brief blend Weighted average of BGR image into the canvas at origin (level 0 px), weight is CV_32FC1 0..1
+     */
+    void blend(const cv::Mat &image, const cv::Mat &weight, const cv::Point &origin);
+    /**
+     * @brief read BGRA copy of a level 0 rectangle, transparent where nothing was placed
+     */
+    cv::Mat read(const cv::Rect &rect);
+    /**
+     * @brief tile BGRA tile, empty Mat if nothing was placed in it
+     */
+    cv::Mat tile(int level, int tx, int ty);
+    /**
+     * @brief flush Writes modified tiles and brings all pyramid levels up to date
+     */
+    void flush();
+    /**
+     * @brief tileRevision Bumped whenever blend() changes the tile or one below it, never waits for a running blend()
+     */
+    int tileRevision(int level, int tx, int ty) const;
+
+private:
+    struct CachedTile {
+        cv::Mat image;
+        bool dirty;
+        quint64 used;
+    };
+    static quint64 key(int level, int tx, int ty);
+    QString tilePath(int level, int tx, int ty) const;
+    cv::Mat *cachedTile(int level, int tx, int ty, bool create);
+    void storeTile(int level, int tx, int ty, const cv::Mat &image);
+    void evict();
+    void writeTile(quint64 key, const CachedTile &tile);
+    void invalidateParents(int tx, int ty);
+    void rebuild(int level, int tx, int ty);
+    void touch(quint64 key);
+
+    mutable QMutex m_mutex;
+    QString m_directory;
+    cv::Size m_size;
+    int m_levels;
+    QHash<quint64, CachedTile> m_cache;
+    QSet<quint64> m_stale;   ///< Tiles of levels > 0 whose children changed since they were built
+    quint64 m_useCounter;
+    mutable QMutex m_revisionMutex; ///< Taken inside m_mutex, alone by tileRevision()
+    QHash<quint64, int> m_revisions;
+};
+
+#endif // MOSAICCANVAS_H
@@ -0,0 +1,30 @@
+#include "mosaicimageprovider.h"
+
+#include <QStringList>
+
+MosaicImageProvider::MosaicImageProvider(const QSharedPointer<MosaicCanvas> &canvas) :
+    QQuickImageProvider(QQuickImageProvider::Image), m_canvas(canvas)
+{
+}
+
+QImage MosaicImageProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
+{
+    QStringList parts = id.section('?', 0, 0).split('/');
+    cv::Mat tile;
+    if (parts.size() == 3)
+        tile = m_canvas->tile(parts[0].toInt(), parts[1].toInt(), parts[2].toInt());
+
+    QImage image;
+    if (tile.empty()) {
+        image = QImage(MosaicCanvas::TileSize, MosaicCanvas::TileSize, QImage::Format_ARGB32);
+        image.fill(Qt::transparent);
+    } else {
+        // BGRA bytes are ARGB32 words on little endian
+        image = QImage(tile.data, tile.cols, tile.rows, static_cast<int>(tile.step), QImage::Format_ARGB32).copy();
+    }
+    if (size)
+        *size = image.size();
+    if (requestedSize.isValid() && requestedSize != image.size())
+        image = image.scaled(requestedSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    return image;
+}
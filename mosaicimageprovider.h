@@ -0,0 +1,24 @@
+#ifndef MOSAICIMAGEPROVIDER_H
+#define MOSAICIMAGEPROVIDER_H
+
+#include <QQuickImageProvider>
+#include <QSharedPointer>
+
+#include "mosaiccanvas.h"
+
+/**
+ * @brief The MosaicImageProvider class serves mosaic tiles to QML as image://mosaic/<level>/<x>/<y>,
+ * anything after a '?' is ignored and can be used to force a reload.
+ */
+class MosaicImageProvider : public QQuickImageProvider
+{
+public:
+    explicit MosaicImageProvider(const QSharedPointer<MosaicCanvas> &canvas);
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) override;
+
+private:
+    QSharedPointer<MosaicCanvas> m_canvas;
+};
+
+#endif // MOSAICIMAGEPROVIDER_H
@@ -0,0 +1,126 @@
+#include "raycommandsender.h"
+#include "monotonicclock.h"
+
+#include <QUdpSocket>
+#include <QHostInfo>
+#include <QDebug>
+
+#include <string.h>
+
+RayCommandSender::RayCommandSender(QObject *parent) : QObject(parent),
+    m_peerAddress("192.168.88.99"), m_peerPort(9999), m_encoding(Text), m_sequence(0),
+    m_ackTimeout(50), m_maxRetries(10), m_lost(0)
+{
+    memset(m_slots, 0, sizeof(m_slots));
+    m_udp = new QUdpSocket(this);
+    m_udp->bind(QHostAddress::AnyIPv4, 0);
+    connect(m_udp, &QUdpSocket::readyRead,
+            this,  &RayCommandSender::onReadyRead);
+    m_retryTimer.setInterval(m_ackTimeout / 2);
+    connect(&m_retryTimer, &QTimer::timeout,
+            this,          &RayCommandSender::onRetryTimeout);
+}
+
+void RayCommandSender::setPeer(const QString &host, quint16 port)
+{
+    QHostAddress address(host);
+    if (address.isNull()) {
+        QHostInfo info = QHostInfo::fromName(host);
+        if (info.addresses().isEmpty()) {
+            qWarning() << "Can't resolve ray board address" << host << info.errorString();
+            return;
+        }
+        address = info.addresses().first();
+    }
+    m_peerAddress = address;
+    m_peerPort = port;
+}
+
+void RayCommandSender::setEncoding(Encoding encoding)
+{
+    m_encoding = encoding;
+}
+
+RayCommandSender::Encoding RayCommandSender::encoding() const
+{
+    return m_encoding;
+}
+
+quint32 RayCommandSender::lostCount() const
+{
+    return m_lost;
+}
+
+void RayCommandSender::send(ray_command_id_t command, qint32 value)
+{
+    if (command >= CommandsCount)
+        return;
+    if (m_encoding == Text) {
+        char letter = command == RAY_CMD_LASER_POWER ? 'l' : (command == RAY_CMD_TOP_EXHAUST ? 't' : 'b');
+        int length = qsnprintf(m_textBuffer, sizeof(m_textBuffer), "%c(%d)", letter, value);
+        m_udp->writeDatagram(m_textBuffer, length, m_peerAddress, m_peerPort);
+        return;
+    }
+    pending_t &slot = m_slots[command];
+    slot.packet.magic = RAY_COMMAND_MAGIC;
+    slot.packet.command = command;
+    slot.packet.reserved = 0;
+    slot.packet.sequence = ++m_sequence;
+    slot.packet.value = value;
+    slot.pending = true;
+    slot.retries = 0;
+    write(slot);
+    if (!m_retryTimer.isActive())
+        m_retryTimer.start();
+}
+
+void RayCommandSender::write(pending_t &slot)
+{
+    slot.sentAt = monotonicNs();
+    m_udp->writeDatagram(reinterpret_cast<const char *>(&slot.packet), sizeof(ray_command_t),
+                         m_peerAddress, m_peerPort);
+}
+
+void RayCommandSender::onReadyRead()
+{
+    ray_ack_t ack;
+    while (m_udp->hasPendingDatagrams()) {
+        if (m_udp->pendingDatagramSize() != sizeof(ray_ack_t)) {
+            m_udp->readDatagram(nullptr, 0);
+            continue;
+        }
+        m_udp->readDatagram(reinterpret_cast<char *>(&ack), sizeof(ack));
+        if (ack.magic != RAY_COMMAND_MAGIC || ack.command != RAY_CMD_ACK || ack.acked >= CommandsCount)
+            continue;
+        pending_t &slot = m_slots[ack.acked];
+        // Acks of superseded commands are ignored, the newer one is still waiting
+        if (slot.pending && slot.packet.sequence == ack.sequence)
+            slot.pending = false;
+    }
+}
+
+void RayCommandSender::onRetryTimeout()
+{
+    qint64 now = monotonicNs();
+    bool anyPending = false;
+    for (int i = 0; i < CommandsCount; ++i) {
+        pending_t &slot = m_slots[i];
+        if (!slot.pending)
+            continue;
+        if (now - slot.sentAt < qint64(m_ackTimeout) * 1000000) {
+            anyPending = true;
+            continue;
+        }
+        if (slot.retries >= m_maxRetries) {
+            qWarning() << "Ray command" << slot.packet.command << "=" << slot.packet.value << "was not acknowledged";
+            slot.pending = false;
+            m_lost++;
+            continue;
+        }
+        slot.retries++;
+        write(slot);
+        anyPending = true;
+    }
+    if (!anyPending)
+        m_retryTimer.stop();
+}
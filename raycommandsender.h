@@ -0,0 +1,64 @@
+#ifndef RAYCOMMANDSENDER_H
+#define RAYCOMMANDSENDER_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QTimer>
+
+#include "raypayload.h"
+
+class QUdpSocket;
+
+/**
+ * @brief The RayCommandSender class sends laser power and exhaust commands to the ray board.
+ * Peer address is resolved once and packets are built in preallocated buffers, so sending doesn't allocate.
+ * In Binary encoding every command carries a sequence number, unacknowledged commands are retried.
+ * Only the latest value of each command is kept, an older pending power update is superseded by a newer one.
+ */
+class RayCommandSender : public QObject
+{
+    Q_OBJECT
+public:
+    enum Encoding {
+        Text,   ///< l(%d), t(%d), b(%d), no delivery confirmation
+        Binary  ///< ray_command_t with acks
+    };
+
+    explicit RayCommandSender(QObject *parent = nullptr);
+
+    void setPeer(const QString &host, quint16 port);
+    void setEncoding(Encoding encoding);
+    Encoding encoding() const;
+
+    void send(ray_command_id_t command, qint32 value);
+
+    quint32 lostCount() const;
+
+private slots:
+    void onReadyRead();
+    void onRetryTimeout();
+
+private:
+    enum { CommandsCount = 4 };
+    struct pending_t {
+        ray_command_t packet;
+        bool pending;
+        qint64 sentAt;
+        int retries;
+    };
+    void write(pending_t &slot);
+
+    QUdpSocket *m_udp;
+    QHostAddress m_peerAddress;
+    quint16 m_peerPort;
+    Encoding m_encoding;
+    quint32 m_sequence;
+    pending_t m_slots[CommandsCount];
+    char m_textBuffer[16];
+    QTimer m_retryTimer;
+    int m_ackTimeout;  ///< [ms]
+    int m_maxRetries;
+    quint32 m_lost;
+};
+
+#endif // RAYCOMMANDSENDER_H
@@ -0,0 +1,46 @@
+#ifndef RAYPAYLOAD_H
+#define RAYPAYLOAD_H
+
+#include <stdint.h>
+
+/**
+ * @brief Telemetry datagram sent by the motion controller (ray board) over UDP
+ */
+typedef struct {
+    float mcs_x;
+    float mcs_y;
+    float mcs_z;
+    float mcs_b;
+    uint32_t state;
+    uint32_t played;
+    int32_t total;
+} ray_payload_t;
+
+#define RAY_COMMAND_MAGIC 0x5259
+
+enum ray_command_id_t {
+    RAY_CMD_LASER_POWER    = 0x01, ///< value is 0..4095
+    RAY_CMD_TOP_EXHAUST    = 0x02, ///< value is 0 or 1, same polarity as text t(%d)
+    RAY_CMD_BOTTOM_EXHAUST = 0x03,
+    RAY_CMD_ACK            = 0x80
+};
+
+/**
+ * @brief Binary command, the ray board answers with ray_ack_t carrying the same sequence
+ */
+typedef struct {
+    uint16_t magic;
+    uint8_t command;
+    uint8_t reserved;
+    uint32_t sequence;
+    int32_t value;
+} ray_command_t;
+
+typedef struct {
+    uint16_t magic;
+    uint8_t command; ///< RAY_CMD_ACK
+    uint8_t acked;   ///< ray_command_id_t of acknowledged command
+    uint32_t sequence;
+} ray_ack_t;
+
+#endif // RAYPAYLOAD_H
@@ -1,17 +1,97 @@
 #include "rayreceiver.h"
+#include "monotonicclock.h"
+#include "sessionrecorder.h"
 #include <QDebug>
 
-RayReceiver::RayReceiver(QObject *parent) : QObject(parent)
+RayReceiverWorker::RayReceiverWorker(RayReceiver *receiver, QObject *parent) : QObject(parent),
+    m_receiver(receiver), m_udp(nullptr),
+    m_lastState(RayReceiver::NotPlaying)
+{
+    memset(&m_snapshot, 0, sizeof(m_snapshot));
+}
+
+void RayReceiverWorker::bind(quint16 port)
+{
+    if (!m_udp) {
+        m_udp = new QUdpSocket(this);
+        connect(m_udp, &QUdpSocket::readyRead,
+                this,  &RayReceiverWorker::onReadyRead);
+    }
+    m_udp->close();
+    if (!m_udp->bind(QHostAddress::Any, port))
+        qWarning() << "Can't bind telemetry port" << port << m_udp->errorString();
+}
+
+void RayReceiverWorker::unbind()
+{
+    if (m_udp)
+        m_udp->close();
+}
+
+void RayReceiverWorker::onReadyRead()
+{
+    // Drain everything that is queued, only the latest coordinates are published
+    bool updated = false;
+    char buffer[sizeof(ray_payload_t)];
+    while (m_udp->hasPendingDatagrams()) {
+        if (m_udp->pendingDatagramSize() != sizeof(ray_payload_t)) {
+            m_udp->readDatagram(nullptr, 0);
+            continue;
+        }
+        m_udp->readDatagram(buffer, sizeof(buffer));
+        m_snapshot.timestamp = monotonicNs();
+        memcpy(&m_snapshot.payload, buffer, sizeof(ray_payload_t));
+        m_snapshot.received++;
+        m_receiver->m_history.append(m_snapshot.timestamp, m_snapshot.payload);
+        SessionRecorder *recorder = m_receiver->m_recorder.load(std::memory_order_acquire);
+        if (recorder)
+            recorder->record(SESSION_RAY_PAYLOAD, &m_snapshot.payload, sizeof(ray_payload_t), m_snapshot.timestamp);
+        updated = true;
+        if (m_snapshot.payload.state != m_lastState) {
+            m_lastState = m_snapshot.payload.state;
+            emit stateTransition(m_lastState);
+        }
+    }
+    if (!updated)
+        return;
+    m_receiver->m_snapshot.store(m_snapshot);
+    // At most one notification is queued to the GUI thread, it reads the freshest snapshot anyway
+    if (!m_receiver->m_notifyPending.exchange(true))
+        emit payloadUpdated();
+}
+
+RayReceiver::RayReceiver(QObject *parent) : QObject(parent),
+    m_notifyPending(false), m_recorder(nullptr)
 {
-    m_udp = new QUdpSocket(this);
-    m_udp->bind(QHostAddress::Any, 45454);
-    connect(m_udp, &QUdpSocket::readyRead,
-            this,  &RayReceiver::onReadyRead);
     m_connected = false;
+    m_replay = false;
+    m_listenPort = 45454;
+    m_replayState = NotPlaying;
     m_timer.setInterval(500);
     m_timer.setSingleShot(false);
     connect(&m_timer, &QTimer::timeout,
             this,     &RayReceiver::onTimerTimeout);
+
+    m_commandSender = new RayCommandSender(this);
+
+    m_worker = new RayReceiverWorker(this);
+    m_worker->moveToThread(&m_networkThread);
+    // Sockets of the worker live in the network thread and are deleted there
+    connect(&m_networkThread, &QThread::finished,
+            m_worker,         &QObject::deleteLater);
+    connect(m_worker, &RayReceiverWorker::payloadUpdated,
+            this,     &RayReceiver::onPayloadUpdated);
+    connect(m_worker, &RayReceiverWorker::stateTransition,
+            this,     &RayReceiver::onStateTransition);
+    m_networkThread.setObjectName("RayReceiver");
+    m_networkThread.start();
+    setListenPort(m_listenPort);
+}
+
+RayReceiver::~RayReceiver()
+{
+    m_networkThread.quit();
+    m_networkThread.wait();
 }
 
 bool RayReceiver::connected() const
@@ -19,64 +99,123 @@ bool RayReceiver::connected() const
     return m_connected;
 }
 
-void RayReceiver::setLaserPower(float pwr)
+void RayReceiver::setListenPort(quint16 port)
 {
-    if (pwr < 0)
-        pwr = 0;
-    else if (pwr > 1.0)
-        pwr = 1.0;
-    QString l = QString("l(%1)").arg((int)(pwr * 4095));
-    m_udp->writeDatagram(l.toLocal8Bit(), QHostAddress("192.168.88.99"), 9999);
+    m_listenPort = port;
+    if (m_replay)
+        return;
+    QMetaObject::invokeMethod(m_worker, "bind", Qt::QueuedConnection, Q_ARG(quint16, port));
 }
 
-void RayReceiver::setTopExhaust(bool enabled)
+void RayReceiver::setPeer(const QString &host, quint16 port)
 {
-    QString l = QString("t(%1)").arg(enabled ? '0' : '1');
-    qDebug() << l;
-    m_udp->writeDatagram(l.toLocal8Bit(), QHostAddress("192.168.88.99"), 9999);
+    m_commandSender->setPeer(host, port);
 }
 
-void RayReceiver::setBottomExhaust(bool enabled)
+void RayReceiver::setCommandEncoding(RayCommandSender::Encoding encoding)
 {
-    QString l = QString("b(%1)").arg(enabled ? '0' : '1');
-    m_udp->writeDatagram(l.toLocal8Bit(), QHostAddress("192.168.88.99"), 9999);
+    m_commandSender->setEncoding(encoding);
 }
 
-void RayReceiver::onReadyRead()
+ray_snapshot_t RayReceiver::snapshot() const
 {
-    while (m_udp->hasPendingDatagrams()) {
-        QNetworkDatagram datagram = m_udp->receiveDatagram();
-        processPayload(datagram);
-    }
+    return m_snapshot.load();
 }
 
-void RayReceiver::onTimerTimeout()
+const TelemetryHistory &RayReceiver::history() const
 {
-    emit connectionStateChanged(false);
-    m_connected = false;
+    return m_history;
+}
+
+bool RayReceiver::positionAt(qint64 timestamp, ray_payload_t &payload) const
+{
+    return m_history.positionAt(timestamp, payload);
 }
 
-void RayReceiver::processPayload(QNetworkDatagram datagram)
+void RayReceiver::setSessionRecorder(SessionRecorder *recorder)
 {
-    QByteArray data = datagram.data();
-    if (data.size() != sizeof(ray_payload_t))
+    m_recorder.store(recorder, std::memory_order_release);
+}
+
+void RayReceiver::setReplayMode(bool replay)
+{
+    if (replay == m_replay)
         return;
-    quint8 *p = (quint8 *)data.data();
-    memcpy((void *)&m_payload, p, sizeof(ray_payload_t));
-    //qDebug() << "x:" << m_payload.mcs_x << "\ty:" << m_payload.mcs_y << "\tz:" << m_payload.mcs_z << "\tb:" << m_payload.mcs_b;
-    //qDebug() << "state: " << m_payload.state << "\tplayed:" << m_payload.played << "\ttotal:" << m_payload.total;
-    if (m_lastState != (State)m_payload.state) {
-        m_lastState = (State)m_payload.state;
-        emit stateChanged(m_lastState);
+    m_replay = replay;
+    m_replayState = NotPlaying;
+    if (replay)
+        QMetaObject::invokeMethod(m_worker, "unbind", Qt::QueuedConnection);
+    else
+        setListenPort(m_listenPort);
+}
+
+void RayReceiver::injectPayload(const ray_payload_t &payload, qint64 timestamp)
+{
+    ray_snapshot_t s = m_snapshot.load();
+    s.payload = payload;
+    s.timestamp = timestamp;
+    s.received++;
+    m_history.append(timestamp, payload);
+    m_snapshot.store(s);
+    SessionRecorder *recorder = m_recorder.load(std::memory_order_acquire);
+    if (recorder)
+        recorder->record(SESSION_RAY_PAYLOAD, &payload, sizeof(ray_payload_t), timestamp);
+    if (payload.state != m_replayState) {
+        m_replayState = payload.state;
+        onStateTransition(m_replayState);
     }
+    onPayloadUpdated();
+}
+
+void RayReceiver::setLaserPower(float pwr)
+{
+    if (pwr < 0)
+        pwr = 0;
+    else if (pwr > 1.0)
+        pwr = 1.0;
+    if (m_replay)
+        return;
+    m_commandSender->send(RAY_CMD_LASER_POWER, (int)(pwr * 4095));
+}
+
+void RayReceiver::setTopExhaust(bool enabled)
+{
+    if (m_replay)
+        return;
+    m_commandSender->send(RAY_CMD_TOP_EXHAUST, enabled ? 0 : 1);
+}
 
-    emit coordsChanged(m_payload.mcs_x,
-                       m_payload.mcs_y,
-                       m_payload.mcs_z,
-                       m_payload.mcs_b);
+void RayReceiver::setBottomExhaust(bool enabled)
+{
+    if (m_replay)
+        return;
+    m_commandSender->send(RAY_CMD_BOTTOM_EXHAUST, enabled ? 0 : 1);
+}
+
+void RayReceiver::onPayloadUpdated()
+{
+    m_notifyPending = false;
+    ray_snapshot_t s = m_snapshot.load();
+    //qDebug() << "x:" << s.payload.mcs_x << "\ty:" << s.payload.mcs_y << "\tz:" << s.payload.mcs_z << "\tb:" << s.payload.mcs_b;
+    //qDebug() << "state: " << s.payload.state << "\tplayed:" << s.payload.played << "\ttotal:" << s.payload.total;
+    emit coordsChanged(s.payload.mcs_x,
+                       s.payload.mcs_y,
+                       s.payload.mcs_z,
+                       s.payload.mcs_b);
     if (m_connected == false) {
         m_connected = true;
         emit connectionStateChanged(true);
     }
     m_timer.start();
 }
+
+void RayReceiver::onStateTransition(quint32 state)
+{
+    emit stateChanged(static_cast<State>(state));
+}
+
+void RayReceiver::onTimerTimeout()
+{
+    emit connectionStateChanged(false);
+    m_connected = false;
+}
@@ -3,18 +3,49 @@
 
 #include <QObject>
 #include <QUdpSocket>
-#include <QNetworkDatagram>
+#include <QThread>
 #include <QTimer>
+#include <atomic>
+#include "raypayload.h"
+#include "seqlock.h"
+#include "telemetryhistory.h"
+#include "raycommandsender.h"
 
+class SessionRecorder;
+
+/**
+ * @brief The ray_snapshot_t struct is the latest telemetry with its reception time
+ */
 typedef struct {
-    float mcs_x;
-    float mcs_y;
-    float mcs_z;
-    float mcs_b;
-    uint32_t state;
-    uint32_t played;
-    int32_t total;
-} ray_payload_t;
+    ray_payload_t payload;
+    qint64 timestamp; ///< monotonicNs() when the datagram was read
+    quint32 received; ///< Valid datagrams received so far
+} ray_snapshot_t;
+
+class RayReceiver;
+class RayReceiverWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RayReceiverWorker(RayReceiver *receiver, QObject *parent = nullptr);
+
+signals:
+    void payloadUpdated();
+    void stateTransition(quint32 state);
+
+public slots:
+    void bind(quint16 port);
+    void unbind();
+
+private slots:
+    void onReadyRead();
+
+private:
+    RayReceiver *m_receiver;
+    QUdpSocket *m_udp;
+    ray_snapshot_t m_snapshot;
+    quint32 m_lastState;
+};
 
 class RayReceiver : public QObject
 {
@@ -22,6 +53,7 @@ class RayReceiver : public QObject
     Q_PROPERTY(bool connected READ connected NOTIFY connectionStateChanged)
 public:
     explicit RayReceiver(QObject *parent = nullptr);
+    ~RayReceiver();
 
     enum State {
         NotPlaying = 2,
@@ -31,6 +63,44 @@ public:
 
     bool connected() const;
 
+    /**
+     * @brief setListenPort Rebinds telemetry socket to another UDP port (45454 by default)
+     */
+    void setListenPort(quint16 port);
+    /**
+     * @brief setPeer Sets address of the ray board that receives laser power and exhaust commands
+     */
+    void setPeer(const QString &host, quint16 port);
+    /**
+     * @brief setCommandEncoding Selects legacy text commands or binary commands with acks and retries
+     */
+    void setCommandEncoding(RayCommandSender::Encoding encoding);
+
+    /**
+     * @brief snapshot Freshest telemetry, safe to call from any thread without going through the event loop
+     */
+    ray_snapshot_t snapshot() const;
+    /**
+     * @brief history Last TelemetryHistory::Capacity samples, safe to query from any thread
+     */
+    const TelemetryHistory &history() const;
+    /**
+     * @brief positionAt Interpolated machine position at monotonicNs() timestamp, e.g. of a camera frame
+     */
+    bool positionAt(qint64 timestamp, ray_payload_t &payload) const;
+    /**
+     * @brief setSessionRecorder Every received payload is also written to recorder, nullptr disables recording
+     */
+    void setSessionRecorder(SessionRecorder *recorder);
+    /**
+     * @brief setReplayMode Stops listening for live telemetry and sending ray commands, payloads come from injectPayload()
+     */
+    void setReplayMode(bool replay);
+    /**
+     * @brief injectPayload Processes a replayed payload as if it was received at timestamp
+     */
+    void injectPayload(const ray_payload_t &payload, qint64 timestamp);
+
 signals:
     void stateChanged(State s);
     void coordsChanged(float x, float y, float z, float b);
@@ -42,17 +112,25 @@ public slots:
     void setBottomExhaust(bool enabled);
 
 private slots:
-    void onReadyRead();
+    void onPayloadUpdated();
+    void onStateTransition(quint32 state);
     void onTimerTimeout();
 
 private:
-    void processPayload(QNetworkDatagram datagram);
+    friend class RayReceiverWorker;
 
-    QUdpSocket *m_udp;
-    ray_payload_t m_payload;
+    RayReceiverWorker *m_worker;
+    RayCommandSender *m_commandSender;
+    QThread m_networkThread;
+    SeqLock<ray_snapshot_t> m_snapshot;
+    TelemetryHistory m_history;
+    std::atomic<bool> m_notifyPending;
+    std::atomic<SessionRecorder *> m_recorder;
     QTimer m_timer;
     bool m_connected;
-    State m_lastState;
+    bool m_replay;
+    quint16 m_listenPort;
+    quint32 m_replayState;
 };
 
 #endif // RAYRECEIVER_H
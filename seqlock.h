@@ -0,0 +1,65 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <string.h>
+
+/**
+ * @brief The SeqLock class publishes a small POD value from a single writer thread to any number of readers.
+ * Readers never block the writer, they retry if the value was overwritten while being copied.
+ */
+template <typename T>
+class SeqLock
+{
+public:
+    SeqLock() : m_sequence(0)
+    {
+        for (int i = 0; i < Words; ++i)
+            m_data[i].store(0, std::memory_order_relaxed);
+    }
+
+    void store(const T &value)
+    {
+        quint32 words[Words] = {};
+        memcpy(words, &value, sizeof(T));
+        quint32 sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < Words; ++i)
+            m_data[i].store(words[i], std::memory_order_relaxed);
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    T load() const
+    {
+        quint32 words[Words];
+        quint32 before;
+        quint32 after;
+        do {
+            before = m_sequence.load(std::memory_order_acquire);
+            for (int i = 0; i < Words; ++i)
+                words[i] = m_data[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        T value;
+        memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    /**
+     * @brief sequence Incremented by 2 on every store()
+     */
+    quint32 sequence() const
+    {
+        return m_sequence.load(std::memory_order_acquire);
+    }
+
+private:
+    enum { Words = (sizeof(T) + sizeof(quint32) - 1) / sizeof(quint32) };
+    std::atomic<quint32> m_sequence;
+    std::atomic<quint32> m_data[Words];
+};
+
+#endif // SEQLOCK_H
@@ -0,0 +1,74 @@
+#include "sessionlog.h"
+
+#include <QDebug>
+#include <string.h>
+
+SessionLogReader::SessionLogReader() :
+    m_data(nullptr), m_size(0), m_offset(0)
+{
+}
+
+SessionLogReader::~SessionLogReader()
+{
+    close();
+}
+
+bool SessionLogReader::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Can't open" << fileName << m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(session_log_header_t))) {
+        qWarning() << fileName << "is not a session log";
+        close();
+        return false;
+    }
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        qWarning() << "Can't map" << fileName << m_file.errorString();
+        close();
+        return false;
+    }
+    const session_log_header_t *header = reinterpret_cast<const session_log_header_t *>(m_data);
+    if (memcmp(header->magic, SESSION_LOG_MAGIC, sizeof(header->magic)) != 0 || header->version != SESSION_LOG_VERSION) {
+        qWarning() << fileName << "is not a session log or has unsupported version";
+        close();
+        return false;
+    }
+    rewind();
+    return true;
+}
+
+void SessionLogReader::close()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+    m_data = nullptr;
+    m_size = 0;
+    m_offset = 0;
+    m_file.close();
+}
+
+bool SessionLogReader::next(const session_record_header_t *&header, const uchar *&payload)
+{
+    if (!m_data || m_offset + qint64(sizeof(session_record_header_t)) > m_size)
+        return false;
+    const session_record_header_t *h = reinterpret_cast<const session_record_header_t *>(m_data + m_offset);
+    qint64 span = sessionRecordSpan(h->size);
+    // Last record may be truncated if the application was killed while writing
+    if (m_offset + span > m_size)
+        return false;
+    header = h;
+    payload = m_data + m_offset + sizeof(session_record_header_t);
+    m_offset += span;
+    return true;
+}
+
+void SessionLogReader::rewind()
+{
+    m_offset = sizeof(session_log_header_t);
+}
@@ -0,0 +1,69 @@
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include <QFile>
+#include <stdint.h>
+
+/**
+ * Session log is an append-only sequence of 8-byte aligned records after a file header,
+ * so a mapped file can be walked in place without parsing or copying.
+ */
+
+#define SESSION_LOG_MAGIC "CNCVLOG1"
+#define SESSION_LOG_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} session_log_header_t;
+
+enum session_record_type_t {
+    SESSION_RAY_PAYLOAD       = 1, ///< ray_payload_t
+    SESSION_DZ                = 2, ///< float
+    SESSION_DETECTOR_STATE    = 3, ///< int32_t LineDetector::State
+    SESSION_MC_LINE_SENT      = 4, ///< command bytes without line ending
+    SESSION_MC_RESPONSE       = 5, ///< response bytes without line ending
+    SESSION_AUTOMATOR_COMMAND = 6, ///< command bytes
+    SESSION_AUTOMATOR_POWER   = 7, ///< float, normalized 0..1
+    SESSION_FRAME_CAPTURED    = 8  ///< uint32_t frame index since capture start
+};
+
+typedef struct {
+    uint16_t type;      ///< session_record_type_t
+    uint16_t reserved;
+    uint32_t size;      ///< Payload size without alignment padding
+    int64_t timestamp;  ///< sessionNs()
+} session_record_header_t;
+
+inline uint32_t sessionRecordSpan(uint32_t payloadSize)
+{
+    return sizeof(session_record_header_t) + ((payloadSize + 7) & ~7u);
+}
+
+/**
+ * @brief The SessionLogReader class maps a session log and walks its records in place
+ */
+class SessionLogReader
+{
+public:
+    SessionLogReader();
+    ~SessionLogReader();
+
+    bool open(const QString &fileName);
+    void close();
+
+    /**
+     * @brief next Returns next record or false at the end of log, payload points into the mapped file
+     */
+    bool next(const session_record_header_t *&header, const uchar *&payload);
+    void rewind();
+
+private:
+    QFile m_file;
+    uchar *m_data;
+    qint64 m_size;
+    qint64 m_offset;
+};
+
+#endif // SESSIONLOG_H
@@ -0,0 +1,161 @@
+#include "sessionrecorder.h"
+#include "monotonicclock.h"
+
+#include <QDebug>
+#include <string.h>
+
+SessionLogWriter::SessionLogWriter(SessionRecorder *recorder, QObject *parent) : QObject(parent),
+    m_recorder(recorder)
+{
+}
+
+void SessionLogWriter::doWork()
+{
+    SessionRecorder *r = m_recorder;
+    forever {
+        r->m_mutex.lock();
+        while (r->m_front.isEmpty() && !r->m_stopping)
+            r->m_dataAvailable.wait(&r->m_mutex, 100);
+        bool stopping = r->m_stopping;
+        r->m_front.swap(r->m_back);
+        r->m_mutex.unlock();
+
+        if (!r->m_back.isEmpty()) {
+            if (r->m_file.write(r->m_back) != r->m_back.size())
+                qWarning() << "Session log write failed" << r->m_file.errorString();
+            r->m_back.resize(0);
+        }
+        if (stopping)
+            break;
+    }
+    r->m_file.flush();
+    emit workDone();
+}
+
+SessionRecorder::SessionRecorder(QObject *parent) : QObject(parent),
+    m_writer(nullptr), m_recording(false), m_stopping(false), m_dropped(0)
+{
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    stop();
+}
+
+bool SessionRecorder::recording() const
+{
+    return m_recording;
+}
+
+quint32 SessionRecorder::dropped() const
+{
+    return m_dropped;
+}
+
+void SessionRecorder::start(const QString &fileName)
+{
+    if (m_recording)
+        stop();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Can't open" << fileName << m_file.errorString();
+        return;
+    }
+    session_log_header_t header;
+    memcpy(header.magic, SESSION_LOG_MAGIC, sizeof(header.magic));
+    header.version = SESSION_LOG_VERSION;
+    header.reserved = 0;
+    m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    // Nothing of a previous session may end up after the new header
+    m_mutex.lock();
+    m_front.resize(0);
+    m_back.resize(0);
+    m_front.reserve(BufferCapacity);
+    m_back.reserve(BufferCapacity);
+    m_stopping = false;
+    m_mutex.unlock();
+    m_dropped = 0;
+
+    m_writer = new SessionLogWriter(this);
+    m_writer->moveToThread(&m_writerThread);
+    connect(&m_writerThread, &QThread::started, m_writer, &SessionLogWriter::doWork);
+    m_writerThread.start();
+    m_recording = true;
+    qDebug() << "Recording session to" << fileName;
+    emit recordingChanged();
+}
+
+void SessionRecorder::stop()
+{
+    if (!m_recording)
+        return;
+    m_recording = false;
+    m_mutex.lock();
+    m_stopping = true;
+    m_dataAvailable.wakeOne();
+    m_mutex.unlock();
+    m_writerThread.quit();
+    m_writerThread.wait();
+    delete m_writer;
+    m_writer = nullptr;
+    m_file.close();
+    if (m_dropped > 0)
+        qWarning() << "Session recorder dropped" << m_dropped << "records";
+    emit recordingChanged();
+}
+
+void SessionRecorder::record(session_record_type_t type, const void *data, quint32 size, qint64 timestamp)
+{
+    if (!m_recording)
+        return;
+    session_record_header_t header;
+    header.type = static_cast<uint16_t>(type);
+    header.reserved = 0;
+    header.size = size;
+    header.timestamp = timestamp;
+    static const char padding[8] = {};
+    int paddingSize = static_cast<int>(sessionRecordSpan(size) - sizeof(header) - size);
+
+    QMutexLocker lock(&m_mutex);
+    // stop() may have run since the check above, the writer has then taken its last buffer
+    if (m_stopping)
+        return;
+    if (m_front.size() + static_cast<int>(sessionRecordSpan(size)) > BufferCapacity) {
+        m_dropped++;
+        return;
+    }
+    bool wasEmpty = m_front.isEmpty();
+    m_front.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_front.append(static_cast<const char *>(data), static_cast<int>(size));
+    m_front.append(padding, paddingSize);
+    if (wasEmpty)
+        m_dataAvailable.wakeOne();
+}
+
+void SessionRecorder::record(session_record_type_t type, const void *data, quint32 size)
+{
+    record(type, data, size, sessionNs());
+}
+
+void SessionRecorder::recordDz(float dz)
+{
+    record(SESSION_DZ, &dz, sizeof(dz));
+}
+
+void SessionRecorder::recordDetectorState(int state)
+{
+    qint32 s = state;
+    record(SESSION_DETECTOR_STATE, &s, sizeof(s));
+}
+
+void SessionRecorder::recordAutomatorCommand(const QString &command)
+{
+    QByteArray bytes = command.toLocal8Bit();
+    record(SESSION_AUTOMATOR_COMMAND, bytes.constData(), static_cast<quint32>(bytes.size()));
+}
+
+void SessionRecorder::recordAutomatorPower(float power)
+{
+    record(SESSION_AUTOMATOR_POWER, &power, sizeof(power));
+}
@@ -0,0 +1,77 @@
+#ifndef SESSIONRECORDER_H
+#define SESSIONRECORDER_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <atomic>
+
+#include "sessionlog.h"
+
+class SessionRecorder;
+class SessionLogWriter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SessionLogWriter(SessionRecorder *recorder, QObject *parent = nullptr);
+
+signals:
+    void workDone();
+
+public slots:
+    void doWork();
+
+private:
+    SessionRecorder *m_recorder;
+};
+
+/**
+ * @brief The SessionRecorder class appends timestamped records to a session log.
+ * record() is thread-safe and only copies into a bounded in-memory buffer, a background thread writes it to disk.
+ * When the buffer is full records are dropped and counted instead of blocking the caller.
+ */
+class SessionRecorder : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool recording READ recording NOTIFY recordingChanged)
+    Q_PROPERTY(quint32 dropped READ dropped NOTIFY recordingChanged)
+public:
+    explicit SessionRecorder(QObject *parent = nullptr);
+    ~SessionRecorder();
+
+    bool recording() const;
+    quint32 dropped() const;
+
+    void record(session_record_type_t type, const void *data, quint32 size, qint64 timestamp);
+    void record(session_record_type_t type, const void *data, quint32 size);
+
+signals:
+    void recordingChanged();
+
+public slots:
+    void start(const QString &fileName);
+    void stop();
+    void recordDz(float dz);
+    void recordDetectorState(int state);
+    void recordAutomatorCommand(const QString &command);
+    void recordAutomatorPower(float power);
+
+private:
+    friend class SessionLogWriter;
+    enum { BufferCapacity = 4 * 1024 * 1024 };
+
+    SessionLogWriter *m_writer;
+    QThread m_writerThread;
+    QFile m_file;
+    QMutex m_mutex;
+    QWaitCondition m_dataAvailable;
+    QByteArray m_front; ///< Filled by producers under m_mutex
+    QByteArray m_back;  ///< Written to disk by the writer thread
+    std::atomic<bool> m_recording;
+    bool m_stopping;    ///< Under m_mutex, set before the writer takes its last buffer, record() drops from then on
+    std::atomic<quint32> m_dropped;
+};
+
+#endif // SESSIONRECORDER_H
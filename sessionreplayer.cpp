@@ -0,0 +1,186 @@
+#include "sessionreplayer.h"
+#include "capturestream.hpp"
+#include "rayreceiver.h"
+#include "gcodeplayer.h"
+#include "monotonicclock.h"
+
+#include <QDebug>
+#include <string.h>
+
+SessionReplayer::SessionReplayer(CaptureStream *captureStream, RayReceiver *receiver, GcodePlayer *player,
+                                 QObject *parent) : QObject(parent),
+    m_captureStream(captureStream), m_receiver(receiver), m_player(player),
+    m_mode(RealTime), m_running(false), m_framesAvailable(false), m_captureStarted(false), m_savedPacing(0),
+    m_waitingFrame(false), m_hasRecord(false), m_header(nullptr), m_payload(nullptr),
+    m_sessionStart(0), m_wallStart(0), m_dispatched(0)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout,
+            this,     &SessionReplayer::step);
+    // Connected after LineDetector, so the frame is already processed when onFrameReady() is called
+    connect(m_captureStream, &CaptureStream::frameReady,
+            this,            &SessionReplayer::onFrameReady);
+    connect(m_captureStream, &CaptureStream::statusChanged,
+            this,            &SessionReplayer::onCaptureStatusChanged);
+}
+
+SessionReplayer::~SessionReplayer()
+{
+    stop();
+}
+
+bool SessionReplayer::open(const QString &logFileName, const QString &videoFileName)
+{
+    stop();
+    m_videoFileName = videoFileName;
+    return m_reader.open(logFileName);
+}
+
+SessionReplayer::Mode SessionReplayer::mode() const
+{
+    return m_mode;
+}
+
+void SessionReplayer::setMode(SessionReplayer::Mode mode)
+{
+    m_mode = mode;
+}
+
+bool SessionReplayer::running() const
+{
+    return m_running;
+}
+
+void SessionReplayer::start()
+{
+    if (m_running)
+        stop();
+    m_reader.rewind();
+    m_hasRecord = m_reader.next(m_header, m_payload);
+    if (!m_hasRecord) {
+        qWarning() << "Session log is empty";
+        return;
+    }
+    m_sessionStart = m_header->timestamp;
+    m_dispatched = 0;
+    m_waitingFrame = false;
+    m_receiver->setReplayMode(true);
+    m_player->setReplayMode(true);
+    m_framesAvailable = !m_videoFileName.isEmpty();
+    m_captureStarted = m_framesAvailable;
+    if (m_framesAvailable) {
+        m_savedPacing = static_cast<int>(m_captureStream->framePacing());
+        m_captureStream->setFramePacing(CaptureStream::FramePacing::External);
+        m_captureStream->start(m_videoFileName);
+    }
+    m_running = true;
+    emit runningChanged();
+    m_wallStart = monotonicNs();
+    m_timer.start(0);
+}
+
+void SessionReplayer::stop()
+{
+    if (!m_running)
+        return;
+    m_timer.stop();
+    m_running = false;
+    m_waitingFrame = false;
+    if (m_captureStarted) {
+        m_captureStream->stop();
+        m_captureStream->setFramePacing(static_cast<CaptureStream::FramePacing>(m_savedPacing));
+        m_captureStarted = false;
+    }
+    m_framesAvailable = false;
+    // Hand time, telemetry and MC back to live sources
+    setVirtualClockNs(-1);
+    m_receiver->setReplayMode(false);
+    m_player->setReplayMode(false);
+    emit runningChanged();
+}
+
+void SessionReplayer::step()
+{
+    int dispatched = 0;
+    while (m_running && m_hasRecord && !m_waitingFrame) {
+        qint64 timestamp = m_header->timestamp;
+        if (m_mode == RealTime) {
+            qint64 wait = m_wallStart + (timestamp - m_sessionStart) - monotonicNs();
+            if (wait > 0) {
+                m_timer.start(static_cast<int>(qMax<qint64>(1, wait / 1000000)));
+                return;
+            }
+        } else if (++dispatched > BatchSize) {
+            // Let queued signals and the GUI run between batches
+            m_timer.start(0);
+            return;
+        }
+        setVirtualClockNs(timestamp);
+        dispatch(m_header, m_payload);
+        m_dispatched++;
+        m_hasRecord = m_reader.next(m_header, m_payload);
+    }
+    if (m_running && !m_hasRecord && !m_waitingFrame)
+        finish();
+}
+
+void SessionReplayer::dispatch(const session_record_header_t *header, const uchar *payload)
+{
+    switch (header->type) {
+    case SESSION_RAY_PAYLOAD:
+        if (header->size == sizeof(ray_payload_t)) {
+            ray_payload_t p;
+            memcpy(&p, payload, sizeof(p));
+            m_receiver->injectPayload(p, header->timestamp);
+        }
+        break;
+    case SESSION_MC_RESPONSE:
+        m_player->injectResponse(QString::fromLocal8Bit(reinterpret_cast<const char *>(payload), header->size));
+        break;
+    case SESSION_FRAME_CAPTURED:
+        if (m_framesAvailable && header->size == sizeof(quint32)) {
+            quint32 frameIndex;
+            memcpy(&frameIndex, payload, sizeof(frameIndex));
+            m_waitingFrame = true;
+            m_captureStream->requestFrame(header->timestamp, frameIndex);
+        }
+        break;
+    default:
+        // Detector and automator outputs are produced again by the components under test
+        break;
+    }
+}
+
+void SessionReplayer::onFrameReady()
+{
+    if (!m_waitingFrame)
+        return;
+    m_waitingFrame = false;
+    if (m_running)
+        m_timer.start(0);
+}
+
+void SessionReplayer::onCaptureStatusChanged()
+{
+    if (!m_running || !m_framesAvailable)
+        return;
+    CaptureStream::Status status = m_captureStream->status();
+    if (status == CaptureStream::Status::Starting || status == CaptureStream::Status::Started)
+        return;
+    qWarning() << "Replay video is not available anymore, continuing without frames";
+    m_framesAvailable = false;
+    if (m_waitingFrame) {
+        m_waitingFrame = false;
+        m_timer.start(0);
+    }
+}
+
+void SessionReplayer::finish()
+{
+    double sessionDuration = (sessionNs() - m_sessionStart) / 1e9;
+    double wallDuration = (monotonicNs() - m_wallStart) / 1e9;
+    qDebug() << "Replay finished," << m_dispatched << "records," << sessionDuration << "s of session in"
+             << wallDuration << "s, x" << (wallDuration > 0 ? sessionDuration / wallDuration : 0);
+    stop();
+    emit finished();
+}
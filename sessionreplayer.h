@@ -0,0 +1,83 @@
+#ifndef SESSIONREPLAYER_H
+#define SESSIONREPLAYER_H
+
+#include <QObject>
+#include <QTimer>
+
+#include "sessionlog.h"
+
+class CaptureStream;
+class RayReceiver;
+class GcodePlayer;
+
+/**
+ * @brief The SessionReplayer class drives capture, telemetry and MC responses from a recorded session.
+ * Records are dispatched in log order on a virtual clock (sessionNs()), each frame is fully processed
+ * before the next record, so a replay makes the same decisions at real time and as fast as possible.
+ */
+class SessionReplayer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+public:
+    explicit SessionReplayer(CaptureStream *captureStream, RayReceiver *receiver, GcodePlayer *player,
+                             QObject *parent = nullptr);
+    ~SessionReplayer();
+
+    enum Mode {
+        RealTime,
+        AsFastAsPossible
+    };
+    Q_ENUM(Mode)
+
+    /**
+     * @brief open Opens session log and optionally a video file recorded along with it
+     */
+    bool open(const QString &logFileName, const QString &videoFileName = QString());
+    Mode mode() const;
+    void setMode(Mode mode);
+    bool running() const;
+
+signals:
+    void runningChanged();
+    void finished();
+
+public slots:
+    void start();
+    /**
+     * @brief stop Restores the live clock, RayReceiver and GcodePlayer replay mode and capture pacing, also at the end of the log
+     */
+    void stop();
+
+private slots:
+    void step();
+    void onFrameReady();
+    void onCaptureStatusChanged();
+
+private:
+    void dispatch(const session_record_header_t *header, const uchar *payload);
+    void finish();
+
+    enum { BatchSize = 256 }; ///< Records dispatched between event loop iterations in AsFastAsPossible mode
+
+    CaptureStream *m_captureStream;
+    RayReceiver *m_receiver;
+    GcodePlayer *m_player;
+    SessionLogReader m_reader;
+    QString m_videoFileName;
+    Mode m_mode;
+    QTimer m_timer;
+    bool m_running;
+    bool m_framesAvailable;
+    bool m_captureStarted;  ///< Capture stream was taken over by start() and is given back by stop()
+    int m_savedPacing;      ///< CaptureStream::FramePacing before replay
+    bool m_waitingFrame;
+    bool m_hasRecord;
+    const session_record_header_t *m_header;
+    const uchar *m_payload;
+    qint64 m_sessionStart; ///< Timestamp of the first record
+    qint64 m_wallStart;    ///< monotonicNs() when replay was started
+    quint64 m_dispatched;
+};
+
+#endif // SESSIONREPLAYER_H
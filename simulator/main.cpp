@@ -0,0 +1,57 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "mcsimulator.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("cnc-vision-sim");
+
+    McSimulator::Config config = McSimulator::defaultConfig();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulated motion controller and ray board for cnc-vision");
+    parser.addHelpOption();
+    QCommandLineOption listenOption("listen", "Address to accept G-code and commands on.", "host", config.listenAddress.toString());
+    QCommandLineOption gcodePortOption("gcode-port", "G-code TCP port.", "port", QString::number(config.gcodePort));
+    QCommandLineOption commandPortOption("command-port", "Ray command UDP port.", "port", QString::number(config.commandPort));
+    QCommandLineOption telemetryHostOption("telemetry-host", "Telemetry destination address.", "host", config.telemetryAddress.toString());
+    QCommandLineOption telemetryPortOption("telemetry-port", "Telemetry destination UDP port.", "port", QString::number(config.telemetryPort));
+    QCommandLineOption telemetryRateOption("telemetry-rate", "Telemetry datagrams per second.", "hz", QString::number(config.telemetryRate));
+    QCommandLineOption ackLatencyOption("ack-latency", "Delay before each line is acknowledged.", "ms", QString::number(config.ackLatency));
+    QCommandLineOption bufferSizeOption("buffer-size", "Planner queue length in lines.", "lines", QString::number(config.bufferSize));
+    QCommandLineOption rapidFeedOption("rapid-feed", "G0 feed rate.", "mm/min", QString::number(config.rapidFeed));
+    QCommandLineOption timeScaleOption("time-scale", "Motion speed multiplier.", "factor", QString::number(config.timeScale));
+    QCommandLineOption dropRateOption("command-drop-rate", "Fraction of binary ray commands to ignore.", "fraction", QString::number(config.commandDropRate));
+    parser.addOption(listenOption);
+    parser.addOption(gcodePortOption);
+    parser.addOption(commandPortOption);
+    parser.addOption(telemetryHostOption);
+    parser.addOption(telemetryPortOption);
+    parser.addOption(telemetryRateOption);
+    parser.addOption(ackLatencyOption);
+    parser.addOption(bufferSizeOption);
+    parser.addOption(rapidFeedOption);
+    parser.addOption(timeScaleOption);
+    parser.addOption(dropRateOption);
+    parser.process(app);
+
+    config.listenAddress = QHostAddress(parser.value(listenOption));
+    config.gcodePort = parser.value(gcodePortOption).toUShort();
+    config.commandPort = parser.value(commandPortOption).toUShort();
+    config.telemetryAddress = QHostAddress(parser.value(telemetryHostOption));
+    config.telemetryPort = parser.value(telemetryPortOption).toUShort();
+    config.telemetryRate = parser.value(telemetryRateOption).toInt();
+    config.ackLatency = parser.value(ackLatencyOption).toInt();
+    config.bufferSize = qMax(1, parser.value(bufferSizeOption).toInt());
+    config.rapidFeed = parser.value(rapidFeedOption).toFloat();
+    config.timeScale = parser.value(timeScaleOption).toFloat();
+    config.commandDropRate = parser.value(dropRateOption).toFloat();
+
+    McSimulator simulator(config);
+    if (!simulator.start())
+        return 1;
+
+    return app.exec();
+}
@@ -0,0 +1,365 @@
+#include "mcsimulator.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+#include <QDebug>
+
+#include <math.h>
+#include <string.h>
+
+McSimulator::Config McSimulator::defaultConfig()
+{
+    Config c;
+    c.listenAddress = QHostAddress::LocalHost;
+    c.gcodePort = 2323;
+    c.commandPort = 9999;
+    c.telemetryAddress = QHostAddress::LocalHost;
+    c.telemetryPort = 45454;
+    c.telemetryRate = 100;
+    c.ackLatency = 2;
+    c.bufferSize = 16;
+    c.rapidFeed = 12000;
+    c.defaultFeed = 1000;
+    c.timeScale = 1.0f;
+    c.commandDropRate = 0;
+    return c;
+}
+
+McSimulator::McSimulator(const Config &config, QObject *parent) : QObject(parent),
+    m_config(config), m_client(nullptr),
+    m_feed(config.defaultFeed), m_rapid(false), m_absolute(true), m_unitScale(1.0f),
+    m_paused(false), m_executing(false),
+    m_played(0), m_received(0), m_acked(0), m_ackedReported(0)
+{
+    for (int i = 0; i < 4; ++i)
+        m_position[i] = 0;
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection,
+            this,     &McSimulator::onNewConnection);
+    m_telemetry = new QUdpSocket(this);
+    m_commands = new QUdpSocket(this);
+    connect(m_commands, &QUdpSocket::readyRead,
+            this,       &McSimulator::onCommandReadyRead);
+
+    m_motionTimer.setTimerType(Qt::PreciseTimer);
+    m_motionTimer.setInterval(2);
+    connect(&m_motionTimer, &QTimer::timeout,
+            this,           &McSimulator::onMotionTick);
+    m_telemetryTimer.setTimerType(Qt::PreciseTimer);
+    m_telemetryTimer.setInterval(1000 / qMax(1, config.telemetryRate));
+    connect(&m_telemetryTimer, &QTimer::timeout,
+            this,              &McSimulator::onTelemetryTick);
+    m_statisticsTimer.setInterval(1000);
+    connect(&m_statisticsTimer, &QTimer::timeout,
+            this,               &McSimulator::onStatisticsTick);
+}
+
+bool McSimulator::start()
+{
+    if (!m_server->listen(m_config.listenAddress, m_config.gcodePort)) {
+        qWarning() << "Can't listen on" << m_config.listenAddress << m_config.gcodePort << m_server->errorString();
+        return false;
+    }
+    if (!m_commands->bind(m_config.listenAddress, m_config.commandPort)) {
+        qWarning() << "Can't bind command port" << m_config.commandPort << m_commands->errorString();
+        return false;
+    }
+    qInfo() << "G-code on" << m_config.listenAddress.toString() << m_config.gcodePort
+            << "commands on" << m_config.commandPort
+            << "telemetry to" << m_config.telemetryAddress.toString() << m_config.telemetryPort;
+    m_motionClock.start();
+    m_motionTimer.start();
+    m_telemetryTimer.start();
+    m_statisticsTimer.start();
+    return true;
+}
+
+void McSimulator::onNewConnection()
+{
+    QTcpSocket *socket = m_server->nextPendingConnection();
+    if (m_client) {
+        qWarning() << "Only one client is supported, dropping" << socket->peerAddress();
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+    qInfo() << "Client connected" << socket->peerAddress().toString();
+    m_client = socket;
+    m_client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(m_client, &QIODevice::readyRead,
+            this,     &McSimulator::onGcodeReadyRead);
+    connect(m_client, &QAbstractSocket::disconnected, this, [=]() {
+        qInfo() << "Client disconnected";
+        m_client->deleteLater();
+        m_client = nullptr;
+        m_rxQueue.clear();
+        m_rxLine.clear();
+    });
+}
+
+void McSimulator::onGcodeReadyRead()
+{
+    QByteArray bytes = m_client->readAll();
+    for (int i = 0; i < bytes.length(); ++i) {
+        char c = bytes[i];
+        if (c == '\r')
+            continue;
+        if (c == '\n') {
+            receiveLine(m_rxLine);
+            m_rxLine.clear();
+            continue;
+        }
+        m_rxLine.append(c);
+    }
+}
+
+void McSimulator::receiveLine(const QByteArray &line)
+{
+    m_received++;
+    m_rxQueue.enqueue(line);
+    fillPlanner();
+}
+
+void McSimulator::fillPlanner()
+{
+    while (!m_rxQueue.isEmpty() && m_planner.size() < m_config.bufferSize) {
+        block_t block = parseBlock(m_rxQueue.dequeue());
+        if (block.resume) {
+            m_paused = false;
+        } else if (m_paused && block.motion) {
+            // Commands sent during pause are executed immediately, like jogging
+            for (int i = 0; i < 4; ++i) {
+                if (!isnan(block.target[i]))
+                    m_position[i] = block.target[i];
+            }
+        } else {
+            m_planner.enqueue(block);
+        }
+        QTimer::singleShot(m_config.ackLatency, Qt::PreciseTimer, this, &McSimulator::sendAck);
+    }
+}
+
+void McSimulator::sendAck()
+{
+    if (m_client) {
+        m_client->write("ok\n");
+        m_acked++;
+    }
+    fillPlanner();
+}
+
+McSimulator::block_t McSimulator::parseBlock(const QByteArray &line)
+{
+    block_t block;
+    block.motion = false;
+    block.pause = false;
+    block.resume = false;
+    for (int i = 0; i < 4; ++i)
+        block.target[i] = NAN;
+    block.feed = m_feed;
+
+    QByteArray code = line.toUpper();
+    int comment = code.indexOf(';');
+    if (comment >= 0)
+        code.truncate(comment);
+
+    float words[4] = {NAN, NAN, NAN, NAN};
+    int i = 0;
+    while (i < code.length()) {
+        char letter = code[i];
+        if (letter == '(') {
+            int end = code.indexOf(')', i);
+            i = end < 0 ? code.length() : end + 1;
+            continue;
+        }
+        if (letter < 'A' || letter > 'Z') {
+            i++;
+            continue;
+        }
+        int start = ++i;
+        while (i < code.length() && (isdigit(code[i]) || code[i] == '.' || code[i] == '-' || code[i] == '+' || code[i] == ' '))
+            i++;
+        bool ok = false;
+        float value = code.mid(start, i - start).replace(' ', "").toFloat(&ok);
+        if (!ok)
+            continue;
+        int number = static_cast<int>(value);
+        switch (letter) {
+        case 'G':
+            if (number == 0 || number == 1) {
+                block.motion = true;
+                m_rapid = number == 0;
+            } else if (number == 90) {
+                m_absolute = true;
+            } else if (number == 91) {
+                m_absolute = false;
+            } else if (number == 20) {
+                m_unitScale = 25.4f;
+            } else if (number == 21) {
+                m_unitScale = 1.0f;
+            }
+            break;
+        case 'M':
+            if (number == 0 || number == 1 || number == 25)
+                block.pause = true;
+            else if (number == 24)
+                block.resume = true;
+            break;
+        case 'F': m_feed = value * m_unitScale; break;
+        case 'X': words[0] = value * m_unitScale; break;
+        case 'Y': words[1] = value * m_unitScale; break;
+        case 'Z': words[2] = value * m_unitScale; break;
+        case 'B': words[3] = value; break;
+        default: break;
+        }
+    }
+    for (int a = 0; a < 4; ++a) {
+        if (!isnan(words[a]))
+            block.motion = true;
+    }
+    block.feed = m_rapid ? m_config.rapidFeed : m_feed;
+    if (!block.motion)
+        return block;
+    if (m_absolute) {
+        for (int a = 0; a < 4; ++a)
+            block.target[a] = words[a];
+        return block;
+    }
+    // Relative moves are resolved against the last planned target
+    float base[4];
+    for (int a = 0; a < 4; ++a)
+        base[a] = m_position[a];
+    if (m_executing) {
+        for (int a = 0; a < 4; ++a) {
+            if (!isnan(m_current.target[a]))
+                base[a] = m_current.target[a];
+        }
+    }
+    foreach (const block_t &b, m_planner) {
+        for (int a = 0; a < 4; ++a) {
+            if (!isnan(b.target[a]))
+                base[a] = b.target[a];
+        }
+    }
+    for (int a = 0; a < 4; ++a) {
+        if (!isnan(words[a]))
+            block.target[a] = base[a] + words[a];
+    }
+    return block;
+}
+
+bool McSimulator::isBusy() const
+{
+    return m_executing || !m_planner.isEmpty();
+}
+
+void McSimulator::onMotionTick()
+{
+    float dt = m_motionClock.nsecsElapsed() / 1e9f * m_config.timeScale;
+    m_motionClock.restart();
+    while (dt > 0 && !m_paused) {
+        if (!m_executing) {
+            if (m_planner.isEmpty())
+                break;
+            m_current = m_planner.dequeue();
+            m_executing = true;
+            fillPlanner();
+        }
+        if (m_current.pause) {
+            m_paused = true;
+            m_executing = false;
+            m_played++;
+            break;
+        }
+        float delta[4];
+        float length = 0;
+        for (int i = 0; i < 4; ++i) {
+            delta[i] = isnan(m_current.target[i]) ? 0 : m_current.target[i] - m_position[i];
+            if (i < 3)
+                length += delta[i] * delta[i];
+        }
+        length = sqrtf(length);
+        if (length == 0)
+            length = fabsf(delta[3]);
+        float speed = m_current.feed / 60.0f; // [mm/s]
+        float step = speed * dt;
+        if (length <= step || length == 0) {
+            for (int i = 0; i < 4; ++i)
+                m_position[i] += delta[i];
+            dt -= speed > 0 ? length / speed : dt;
+            m_executing = false;
+            m_played++;
+        } else {
+            float k = step / length;
+            for (int i = 0; i < 4; ++i)
+                m_position[i] += delta[i] * k;
+            dt = 0;
+        }
+    }
+}
+
+void McSimulator::onTelemetryTick()
+{
+    ray_payload_t payload;
+    payload.mcs_x = m_position[0];
+    payload.mcs_y = m_position[1];
+    payload.mcs_z = m_position[2];
+    payload.mcs_b = m_position[3];
+    if (m_paused)
+        payload.state = 0; // RayReceiver::Paused
+    else if (isBusy())
+        payload.state = 3; // RayReceiver::Playing
+    else
+        payload.state = 2; // RayReceiver::NotPlaying
+    payload.played = m_played;
+    payload.total = m_received;
+    m_telemetry->writeDatagram(reinterpret_cast<const char *>(&payload), sizeof(payload),
+                               m_config.telemetryAddress, m_config.telemetryPort);
+}
+
+void McSimulator::onStatisticsTick()
+{
+    quint32 acked = m_acked - m_ackedReported;
+    m_ackedReported = m_acked;
+    qInfo().noquote() << QString("%1 lines/s, planner %2/%3, played %4, pos %5 %6 %7 %8%9")
+                         .arg(acked)
+                         .arg(m_planner.size())
+                         .arg(m_config.bufferSize)
+                         .arg(m_played)
+                         .arg(m_position[0], 0, 'f', 3)
+                         .arg(m_position[1], 0, 'f', 3)
+                         .arg(m_position[2], 0, 'f', 3)
+                         .arg(m_position[3], 0, 'f', 3)
+                         .arg(m_paused ? " PAUSED" : "");
+}
+
+void McSimulator::onCommandReadyRead()
+{
+    while (m_commands->hasPendingDatagrams()) {
+        QNetworkDatagram datagram = m_commands->receiveDatagram();
+        QByteArray data = datagram.data();
+        if (data.size() != sizeof(ray_command_t)) {
+            qInfo() << "ray command:" << data;
+            continue;
+        }
+        ray_command_t command;
+        memcpy(&command, data.constData(), sizeof(command));
+        if (command.magic != RAY_COMMAND_MAGIC)
+            continue;
+        if (QRandomGenerator::global()->generateDouble() < m_config.commandDropRate) {
+            qInfo() << "ray command dropped, seq" << command.sequence;
+            continue;
+        }
+        qInfo() << "ray command" << command.command << "=" << command.value << "seq" << command.sequence;
+        ray_ack_t ack;
+        ack.magic = RAY_COMMAND_MAGIC;
+        ack.command = RAY_CMD_ACK;
+        ack.acked = command.command;
+        ack.sequence = command.sequence;
+        m_commands->writeDatagram(reinterpret_cast<const char *>(&ack), sizeof(ack),
+                                  datagram.senderAddress(), static_cast<quint16>(datagram.senderPort()));
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef MCSIMULATOR_H
+#define MCSIMULATOR_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QQueue>
+
+#include "raypayload.h"
+
+class QTcpServer;
+class QTcpSocket;
+class QUdpSocket;
+
+/**
+ * @brief The McSimulator class imitates motion controller and ray board on loopback.
+ * Accepts G-code lines over TCP and acknowledges them with "ok" after configurable latency,
+ * keeps at most bufferSize lines in a planner queue and executes them with constant feed.
+ * Simulated machine coordinates are sent as ray_payload_t telemetry datagrams,
+ * binary ray commands are acknowledged with ray_ack_t.
+ */
+class McSimulator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Config {
+        QHostAddress listenAddress;
+        quint16 gcodePort;
+        quint16 commandPort;
+        QHostAddress telemetryAddress;
+        quint16 telemetryPort;
+        int telemetryRate;    ///< datagrams per second
+        int ackLatency;       ///< [ms] between line reception (or buffer slot freeing) and "ok"
+        int bufferSize;       ///< planner queue length [lines]
+        float rapidFeed;      ///< [mm/min] used for G0
+        float defaultFeed;    ///< [mm/min] used for G1 until F word is received
+        float timeScale;      ///< motion speed multiplier
+        float commandDropRate;///< fraction of binary ray commands ignored, to exercise retries
+    };
+    static Config defaultConfig();
+
+    explicit McSimulator(const Config &config, QObject *parent = nullptr);
+
+    bool start();
+
+private slots:
+    void onNewConnection();
+    void onGcodeReadyRead();
+    void onCommandReadyRead();
+    void onMotionTick();
+    void onTelemetryTick();
+    void onStatisticsTick();
+
+private:
+    struct block_t {
+        bool motion;
+        bool pause;
+        bool resume;
+        float target[4]; // x, y, z, b
+        float feed;      // [mm/min]
+    };
+
+    void receiveLine(const QByteArray &line);
+    void fillPlanner();
+    void sendAck();
+    block_t parseBlock(const QByteArray &line);
+    bool isBusy() const;
+
+    Config m_config;
+    QTcpServer *m_server;
+    QTcpSocket *m_client;
+    QUdpSocket *m_telemetry;
+    QUdpSocket *m_commands;
+    QTimer m_motionTimer;
+    QTimer m_telemetryTimer;
+    QTimer m_statisticsTimer;
+    QElapsedTimer m_motionClock;
+    QByteArray m_rxLine;
+    QQueue<QByteArray> m_rxQueue;
+    QQueue<block_t> m_planner;
+
+    float m_position[4];
+    float m_feed;
+    bool m_rapid;
+    bool m_absolute;
+    float m_unitScale;
+    bool m_paused;
+    bool m_executing;
+    block_t m_current;
+
+    quint32 m_played;
+    qint32 m_received;
+    quint32 m_acked;
+    quint32 m_ackedReported;
+};
+
+#endif // MCSIMULATOR_H
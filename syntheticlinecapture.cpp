@@ -0,0 +1,168 @@
+#include "syntheticlinecapture.h"
+
+#include <QUrlQuery>
+#include <QtMath>
+#include <opencv2/imgproc.hpp>
+
+SyntheticLineCapture::Parameters::Parameters() :
+    rotation(0), thickness(3), blur(1.5f), noise(4), texture(30), intensity(220),
+    dz(0), dzAmplitude(0), dzPeriod(100), frames(0), seed(1)
+{
+}
+
+SyntheticLineCapture::Parameters SyntheticLineCapture::Parameters::parse(const QString &description)
+{
+    Parameters p;
+    QUrlQuery query(description);
+    auto value = [&query](const char *key, float fallback) {
+        return query.hasQueryItem(key) ? query.queryItemValue(key).toFloat() : fallback;
+    };
+    p.rotation = value("rotation", p.rotation);
+    p.thickness = value("thickness", p.thickness);
+    p.blur = value("blur", p.blur);
+    p.noise = value("noise", p.noise);
+    p.texture = value("texture", p.texture);
+    p.intensity = value("intensity", p.intensity);
+    p.dz = value("dz", p.dz);
+    p.dzAmplitude = value("dzamp", p.dzAmplitude);
+    p.dzPeriod = value("dzperiod", p.dzPeriod);
+    if (query.hasQueryItem("frames"))
+        p.frames = query.queryItemValue("frames").toInt();
+    if (query.hasQueryItem("seed"))
+        p.seed = query.queryItemValue("seed").toULongLong();
+    return p;
+}
+
+float SyntheticLineCapture::Parameters::dzAt(quint32 frameIndex) const
+{
+    if (dzAmplitude == 0 || dzPeriod <= 0)
+        return dz;
+    return dz + dzAmplitude * qSin(2 * M_PI * frameIndex / dzPeriod);
+}
+
+SyntheticLineCapture::SyntheticLineCapture(const Parameters &parameters, int width, int height, double fps) :
+    m_parameters(parameters),
+    m_size(width > 0 ? width : 640, height > 0 ? height : 480),
+    m_fps(fps > 0 ? fps : 30), m_position(-1), m_opened(true)
+{
+    // Smooth random blotches, like an out of focus workpiece surface
+    cv::RNG rng(m_parameters.seed);
+    cv::Mat blotches(qMax(2, m_size.height / 32), qMax(2, m_size.width / 32), CV_32FC1);
+    rng.fill(blotches, cv::RNG::UNIFORM, -0.5, 0.5);
+    cv::Mat gray;
+    cv::resize(blotches, gray, m_size, 0, 0, cv::INTER_CUBIC);
+    gray = gray * m_parameters.texture + 40;
+    cv::Mat planes[] = {gray, gray, gray};
+    cv::merge(planes, 3, m_background);
+}
+
+bool SyntheticLineCapture::isOpened() const
+{
+    return m_opened;
+}
+
+void SyntheticLineCapture::release()
+{
+    m_opened = false;
+    m_position = -1;
+}
+
+bool SyntheticLineCapture::grab()
+{
+    if (!m_opened || (m_parameters.frames > 0 && m_position + 1 >= m_parameters.frames))
+        return false;
+    m_position++;
+    return true;
+}
+
+bool SyntheticLineCapture::retrieve(cv::OutputArray image, int flag)
+{
+    Q_UNUSED(flag);
+    if (!m_opened || m_position < 0) {
+        image.release();
+        return false;
+    }
+    const Parameters &p = m_parameters;
+    float offset = p.geometry.offsetFromDz(p.dzAt(static_cast<quint32>(m_position)));
+
+    // Line is horizontal in LineDetector's rotated frame and moves up with dz, map it back to the camera frame
+    cv::Mat rm = cv::getRotationMatrix2D(cv::Point(m_size.width / 2, m_size.height / 2), p.rotation + 90, 1.0);
+    cv::Mat inverse;
+    cv::invertAffineTransform(rm, inverse);
+    float row = m_size.height / 2 - offset;
+    std::vector<cv::Point2f> ends;
+    ends.push_back(cv::Point2f(-m_size.width, row));
+    ends.push_back(cv::Point2f(2 * m_size.width, row));
+    std::vector<cv::Point2f> cameraEnds;
+    cv::transform(ends, cameraEnds, inverse);
+
+    // Anti-aliased drawing works on 8 bit images only, sub-pixel position is kept with fixed point coordinates
+    const int shift = 8;
+    const float scale = 1 << shift;
+    m_line.create(m_size, CV_8UC1);
+    m_line.setTo(cv::Scalar(0));
+    cv::line(m_line,
+             cv::Point(cvRound(cameraEnds[0].x * scale), cvRound(cameraEnds[0].y * scale)),
+             cv::Point(cvRound(cameraEnds[1].x * scale), cvRound(cameraEnds[1].y * scale)),
+             cv::Scalar(255), qMax(1, cvRound(p.thickness)), cv::LINE_AA, shift);
+    cv::Mat profile;
+    m_line.convertTo(profile, CV_32FC1, p.intensity / 255.0);
+    if (p.blur > 0)
+        cv::GaussianBlur(profile, profile, cv::Size(0, 0), p.blur);
+
+    std::vector<cv::Mat> planes;
+    cv::split(m_background, planes);
+    planes[2] += profile;
+    if (p.noise > 0) {
+        // Seeded by frame index, so a frame looks the same whichever order frames are grabbed in
+        cv::RNG rng(p.seed * 6364136223846793005ULL + static_cast<quint64>(m_position) + 1);
+        m_noise.create(m_size, CV_32FC1);
+        for (cv::Mat &plane : planes) {
+            rng.fill(m_noise, cv::RNG::NORMAL, 0, p.noise);
+            plane += m_noise;
+        }
+    }
+    cv::merge(planes, m_canvas);
+    m_canvas.convertTo(image, CV_8UC3);
+    return true;
+}
+
+bool SyntheticLineCapture::read(cv::OutputArray image)
+{
+    if (!grab()) {
+        image.release();
+        return false;
+    }
+    return retrieve(image);
+}
+
+bool SyntheticLineCapture::set(int propId, double value)
+{
+    if (propId == cv::CAP_PROP_FPS && value > 0) {
+        m_fps = value;
+        return true;
+    }
+    if (propId == cv::CAP_PROP_POS_FRAMES) {
+        m_position = static_cast<int>(value) - 1;
+        return true;
+    }
+    return false;
+}
+
+double SyntheticLineCapture::get(int propId) const
+{
+    switch (propId) {
+    case cv::CAP_PROP_FRAME_COUNT:
+        return m_parameters.frames;
+    case cv::CAP_PROP_FPS:
+        return m_fps;
+    case cv::CAP_PROP_POS_FRAMES:
+        return m_position + 1;
+    case cv::CAP_PROP_FRAME_WIDTH:
+        return m_size.width;
+    case cv::CAP_PROP_FRAME_HEIGHT:
+        return m_size.height;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef SYNTHETICLINECAPTURE_H
+#define SYNTHETICLINECAPTURE_H
+
+#include <QString>
+#include <opencv2/videoio.hpp>
+
+#include "lasergeometry.h"
+
+/**
+ * @brief The SyntheticLineCapture class renders a red laser line at a known dz through the cv::VideoCapture interface.
+ * Frames depend only on parameters and frame index, so detector accuracy can be checked against ground truth.
+ */
+class SyntheticLineCapture : public cv::VideoCapture
+{
+public:
+    /**
+     * @brief The Parameters struct is parsed from "key=value&..." of a synth: capture source
+     */
+    struct Parameters {
+        Parameters();
+        static Parameters parse(const QString &description);
+
+        /**
+         * @brief dzAt Ground truth dz in mm of frame frameIndex
+         */
+        float dzAt(quint32 frameIndex) const;
+
+        float rotation;  ///< Same angle as LineDetector::rotation(), degrees
+        float thickness; ///< Line core thickness, px
+        float blur;      ///< Gaussian sigma of line profile, px
+        float noise;     ///< Sensor noise sigma, gray levels
+        float texture;   ///< Background texture contrast, gray levels
+        float intensity; ///< Line brightness in red channel
+        float dz;        ///< Constant dz, mm
+        float dzAmplitude; ///< dz sine amplitude, mm
+        float dzPeriod;  ///< dz sine period, frames
+        int frames;      ///< Frame count, 0 for endless
+        quint64 seed;
+        LaserGeometry geometry;
+    };
+
+    SyntheticLineCapture(const Parameters &parameters, int width, int height, double fps);
+
+    bool isOpened() const override;
+    void release() override;
+    bool grab() override;
+    bool retrieve(cv::OutputArray image, int flag = 0) override;
+    bool read(cv::OutputArray image) override;
+    bool set(int propId, double value) override;
+    double get(int propId) const override;
+
+private:
+    Parameters m_parameters;
+    cv::Size m_size;
+    double m_fps;
+    int m_position; ///< Index of the grabbed frame, -1 before first grab()
+    bool m_opened;
+    cv::Mat m_background; ///< CV_32FC3, rendered once
+    cv::Mat m_line;       ///< CV_32FC3 scratch buffers reused between frames
+    cv::Mat m_canvas;
+    cv::Mat m_noise;
+};
+
+#endif // SYNTHETICLINECAPTURE_H
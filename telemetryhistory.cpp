@@ -0,0 +1,91 @@
+#include "telemetryhistory.h"
+
+namespace {
+
+// Slots closest to the writer are skipped by readers, so a search rarely races with an overwrite
+const quint32 guardSlots = 16;
+
+} // namespace
+
+TelemetryHistory::TelemetryHistory() :
+    m_count(0)
+{
+}
+
+void TelemetryHistory::append(qint64 timestamp, const ray_payload_t &payload)
+{
+    quint32 index = m_count.load(std::memory_order_relaxed);
+    ray_sample_t sample;
+    sample.timestamp = timestamp;
+    sample.index = index;
+    sample.payload = payload;
+    m_slots[index & (Capacity - 1)].store(sample);
+    m_count.store(index + 1, std::memory_order_release);
+}
+
+bool TelemetryHistory::read(quint32 index, ray_sample_t &sample) const
+{
+    sample = m_slots[index & (Capacity - 1)].load();
+    return sample.index == index;
+}
+
+quint32 TelemetryHistory::count() const
+{
+    return m_count.load(std::memory_order_acquire);
+}
+
+bool TelemetryHistory::latest(ray_sample_t &sample) const
+{
+    quint32 n = count();
+    if (n == 0)
+        return false;
+    return read(n - 1, sample);
+}
+
+bool TelemetryHistory::positionAt(qint64 timestamp, ray_payload_t &payload) const
+{
+    quint32 n = count();
+    if (n == 0)
+        return false;
+    quint32 first = n > Capacity - guardSlots ? n - (Capacity - guardSlots) : 0;
+
+    ray_sample_t newest;
+    if (!read(n - 1, newest))
+        return false;
+    if (timestamp >= newest.timestamp) {
+        payload = newest.payload;
+        return true;
+    }
+    ray_sample_t oldest;
+    if (!read(first, oldest) || timestamp < oldest.timestamp)
+        return false;
+
+    // Last sample with sample.timestamp <= timestamp
+    quint32 lo = first;
+    quint32 hi = n - 1;
+    ray_sample_t sample;
+    while (hi - lo > 1) {
+        quint32 mid = lo + (hi - lo) / 2;
+        if (!read(mid, sample))
+            return false;
+        if (sample.timestamp <= timestamp)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    ray_sample_t before;
+    ray_sample_t after;
+    if (!read(lo, before) || !read(hi, after))
+        return false;
+
+    payload = before.payload;
+    qint64 span = after.timestamp - before.timestamp;
+    if (span <= 0)
+        return true;
+    float k = static_cast<float>(timestamp - before.timestamp) / static_cast<float>(span);
+    payload.mcs_x += (after.payload.mcs_x - before.payload.mcs_x) * k;
+    payload.mcs_y += (after.payload.mcs_y - before.payload.mcs_y) * k;
+    payload.mcs_z += (after.payload.mcs_z - before.payload.mcs_z) * k;
+    payload.mcs_b += (after.payload.mcs_b - before.payload.mcs_b) * k;
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef TELEMETRYHISTORY_H
+#define TELEMETRYHISTORY_H
+
+#include <QtGlobal>
+#include <atomic>
+
+#include "raypayload.h"
+#include "seqlock.h"
+
+typedef struct {
+    qint64 timestamp; ///< monotonicNs() of reception
+    quint32 index;    ///< Sequential number of the sample, used to detect overwritten slots
+    ray_payload_t payload;
+} ray_sample_t;
+
+/**
+ * @brief The TelemetryHistory class is a fixed-size ring of timestamped telemetry samples.
+ * Single writer (network thread), any number of lock-free readers. Time queries are a binary search.
+ */
+class TelemetryHistory
+{
+public:
+    enum { Capacity = 4096 }; ///< Power of two, ~40 s at 100 Hz
+
+    TelemetryHistory();
+
+    /**
+     * @brief append Adds a sample, timestamps must be non-decreasing. Writer thread only.
+     */
+    void append(qint64 timestamp, const ray_payload_t &payload);
+
+    /**
+     * @brief positionAt Machine state at timestamp, coordinates are linearly interpolated between neighbour samples,
+     * the rest of the fields are taken from the earlier one. Timestamps after the newest sample return the newest one.
+     * @return false if history is empty or timestamp is older than the oldest sample still in the ring
+     */
+    bool positionAt(qint64 timestamp, ray_payload_t &payload) const;
+
+    bool latest(ray_sample_t &sample) const;
+    quint32 count() const;
+
+private:
+    bool read(quint32 index, ray_sample_t &sample) const;
+
+    SeqLock<ray_sample_t> m_slots[Capacity];
+    std::atomic<quint32> m_count;
+};
+
+#endif // TELEMETRYHISTORY_H
@@ -0,0 +1,384 @@
+#include "v4l2capture.h"
+#include "monotonicclock.h"
+
+#include <QThread>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+#endif
+
+V4l2Capture::V4l2Capture() :
+    m_fd(-1), m_fake(false), m_bytesPerLine(0),
+    m_fakeData(nullptr), m_fakeSize(0), m_fakeNext(0), m_fakeDue(0)
+{
+    m_format.width = 0;
+    m_format.height = 0;
+    m_format.pixelFormat = YUYV;
+    m_format.fps = 0;
+}
+
+V4l2Capture::~V4l2Capture()
+{
+    close();
+}
+
+bool V4l2Capture::isOpened() const
+{
+    return m_fd >= 0;
+}
+
+bool V4l2Capture::isFake() const
+{
+    return m_fake;
+}
+
+const V4l2Capture::format_t &V4l2Capture::format() const
+{
+    return m_format;
+}
+
+int V4l2Capture::bytesPerLine() const
+{
+    return m_bytesPerLine;
+}
+
+QString V4l2Capture::errorString() const
+{
+    return m_errorString;
+}
+
+#ifdef Q_OS_LINUX
+
+bool V4l2Capture::open(const QString &path, const format_t &requested)
+{
+    close();
+    struct stat st;
+    if (stat(path.toLocal8Bit().constData(), &st) != 0) {
+        m_errorString = QString("%1: %2").arg(path).arg(strerror(errno));
+        return false;
+    }
+    bool ok = S_ISCHR(st.st_mode) ? openDevice(path, requested) : openFake(path, requested);
+    if (!ok)
+        close();
+    return ok;
+}
+
+void V4l2Capture::close()
+{
+    if (m_fd < 0)
+        return;
+    if (m_fake) {
+        if (m_fakeData)
+            munmap(m_fakeData, static_cast<size_t>(m_fakeSize));
+        m_fakeData = nullptr;
+        m_fakeOffsets.clear();
+    } else {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        ioctl(m_fd, VIDIOC_STREAMOFF, &type);
+        for (int i = 0; i < m_buffers.size(); ++i)
+            munmap(m_buffers[i].start, m_buffers[i].length);
+        m_buffers.clear();
+    }
+    ::close(m_fd);
+    m_fd = -1;
+    m_fake = false;
+}
+
+bool V4l2Capture::xioctl(unsigned long request, void *arg, const char *what)
+{
+    int r;
+    do {
+        r = ioctl(m_fd, request, arg);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) {
+        m_errorString = QString("%1 failed: %2").arg(what).arg(strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool V4l2Capture::openDevice(const QString &path, const format_t &requested)
+{
+    m_fd = ::open(path.toLocal8Bit().constData(), O_RDWR | O_NONBLOCK);
+    if (m_fd < 0) {
+        m_errorString = QString("%1: %2").arg(path).arg(strerror(errno));
+        return false;
+    }
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (!xioctl(VIDIOC_QUERYCAP, &cap, "VIDIOC_QUERYCAP"))
+        return false;
+    if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        m_errorString = path + " is not a streaming capture device";
+        return false;
+    }
+
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = static_cast<__u32>(requested.width);
+    fmt.fmt.pix.height = static_cast<__u32>(requested.height);
+    fmt.fmt.pix.pixelformat = requested.pixelFormat == MJPEG ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (!xioctl(VIDIOC_S_FMT, &fmt, "VIDIOC_S_FMT"))
+        return false;
+    if (fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_YUYV) {
+        m_format.pixelFormat = YUYV;
+    } else if (fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_MJPEG) {
+        m_format.pixelFormat = MJPEG;
+    } else {
+        m_errorString = path + " supports neither YUYV nor MJPEG";
+        return false;
+    }
+    m_format.width = static_cast<int>(fmt.fmt.pix.width);
+    m_format.height = static_cast<int>(fmt.fmt.pix.height);
+    m_bytesPerLine = static_cast<int>(fmt.fmt.pix.bytesperline);
+    if (m_bytesPerLine == 0)
+        m_bytesPerLine = m_format.width * 2;
+
+    m_format.fps = 0;
+    if (requested.fps > 0) {
+        v4l2_streamparm parm;
+        memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = static_cast<__u32>(requested.fps);
+        if (xioctl(VIDIOC_S_PARM, &parm, "VIDIOC_S_PARM") && parm.parm.capture.timeperframe.numerator)
+            m_format.fps = static_cast<int>(parm.parm.capture.timeperframe.denominator /
+                                            parm.parm.capture.timeperframe.numerator);
+        else
+            qWarning() << "Can't set frame rate" << m_errorString;
+    }
+
+    // Few buffers keep latency low: the worker holds one, the driver fills the rest
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = 4;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (!xioctl(VIDIOC_REQBUFS, &req, "VIDIOC_REQBUFS"))
+        return false;
+    if (req.count < 2) {
+        m_errorString = "Not enough buffer memory on " + path;
+        return false;
+    }
+    for (__u32 i = 0; i < req.count; ++i) {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (!xioctl(VIDIOC_QUERYBUF, &buf, "VIDIOC_QUERYBUF"))
+            return false;
+        buffer_t buffer;
+        buffer.length = buf.length;
+        buffer.start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, buf.m.offset);
+        if (buffer.start == MAP_FAILED) {
+            m_errorString = QString("mmap failed: %1").arg(strerror(errno));
+            return false;
+        }
+        m_buffers.append(buffer);
+        if (!xioctl(VIDIOC_QBUF, &buf, "VIDIOC_QBUF"))
+            return false;
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (!xioctl(VIDIOC_STREAMON, &type, "VIDIOC_STREAMON"))
+        return false;
+    qDebug() << "V4L2" << path << m_format.width << "x" << m_format.height
+             << (m_format.pixelFormat == MJPEG ? "MJPEG" : "YUYV") << m_format.fps << "fps," << m_buffers.size() << "buffers";
+    return true;
+}
+
+bool V4l2Capture::openFake(const QString &path, const format_t &requested)
+{
+    m_fd = ::open(path.toLocal8Bit().constData(), O_RDONLY);
+    if (m_fd < 0) {
+        m_errorString = QString("%1: %2").arg(path).arg(strerror(errno));
+        return false;
+    }
+    m_fake = true;
+    struct stat st;
+    fstat(m_fd, &st);
+    m_fakeSize = st.st_size;
+    if (m_fakeSize == 0) {
+        m_errorString = path + " is empty";
+        return false;
+    }
+    void *data = mmap(nullptr, static_cast<size_t>(m_fakeSize), PROT_READ, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        m_errorString = QString("mmap failed: %1").arg(strerror(errno));
+        return false;
+    }
+    m_fakeData = static_cast<uchar *>(data);
+    m_format = requested;
+    if (m_format.fps <= 0)
+        m_format.fps = 30;
+    m_bytesPerLine = m_format.width * 2;
+    m_fakeOffsets.clear();
+    if (m_format.pixelFormat == YUYV) {
+        qint64 frameSize = qint64(m_bytesPerLine) * m_format.height;
+        if (frameSize <= 0) {
+            m_errorString = "Fake YUYV device needs width and height";
+            return false;
+        }
+        for (qint64 offset = 0; offset + frameSize <= m_fakeSize; offset += frameSize)
+            m_fakeOffsets.append(offset);
+        if (!m_fakeOffsets.isEmpty())
+            m_fakeOffsets.append(m_fakeOffsets.last() + frameSize);
+    } else {
+        // Concatenated JPEGs, split on start of image markers
+        for (qint64 i = 0; i + 2 < m_fakeSize; ++i) {
+            if (m_fakeData[i] == 0xff && m_fakeData[i + 1] == 0xd8 && m_fakeData[i + 2] == 0xff)
+                m_fakeOffsets.append(i);
+        }
+        if (!m_fakeOffsets.isEmpty())
+            m_fakeOffsets.append(m_fakeSize);
+    }
+    if (m_fakeOffsets.size() < 2) {
+        m_errorString = path + " does not contain a single frame";
+        return false;
+    }
+    m_fakeNext = 0;
+    m_fakeDue = monotonicNs();
+    qDebug() << "Fake V4L2 device" << path << m_fakeOffsets.size() - 1 << "frames";
+    return true;
+}
+
+bool V4l2Capture::dequeue(frame_t &frame, int timeoutMs)
+{
+    // Errors of open() and setControl() that were only warned about must not turn a timeout into a failure
+    m_errorString.clear();
+    if (m_fd < 0) {
+        m_errorString = "Device is not open";
+        return false;
+    }
+    if (m_fake)
+        return dequeueFake(frame, timeoutMs);
+    pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int r = poll(&pfd, 1, timeoutMs);
+    if (r < 0 && errno != EINTR) {
+        m_errorString = QString("poll failed: %1").arg(strerror(errno));
+        return false;
+    }
+    if (r <= 0)
+        return false;
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (!xioctl(VIDIOC_DQBUF, &buf, "VIDIOC_DQBUF"))
+        return false;
+    frame.index = static_cast<int>(buf.index);
+    frame.data = static_cast<const uchar *>(m_buffers[frame.index].start);
+    frame.bytesUsed = buf.bytesused;
+    // CLOCK_MONOTONIC is the steady_clock behind monotonicNs(), so driver timestamps can be used as is
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        frame.timestamp = qint64(buf.timestamp.tv_sec) * 1000000000 + qint64(buf.timestamp.tv_usec) * 1000;
+    else
+        frame.timestamp = monotonicNs();
+    return true;
+}
+
+bool V4l2Capture::dequeueFake(frame_t &frame, int timeoutMs)
+{
+    qint64 wait = m_fakeDue - monotonicNs();
+    if (wait > qint64(timeoutMs) * 1000000) {
+        QThread::usleep(static_cast<unsigned long>(timeoutMs) * 1000);
+        return false;
+    }
+    if (wait > 0)
+        QThread::usleep(static_cast<unsigned long>(wait / 1000));
+    m_fakeDue += 1000000000LL / m_format.fps;
+    int count = m_fakeOffsets.size() - 1;
+    int i = m_fakeNext;
+    m_fakeNext = (m_fakeNext + 1) % count;
+    frame.index = i;
+    frame.data = m_fakeData + m_fakeOffsets[i];
+    frame.bytesUsed = static_cast<quint32>(m_fakeOffsets[i + 1] - m_fakeOffsets[i]);
+    frame.timestamp = monotonicNs();
+    return true;
+}
+
+void V4l2Capture::requeue(int index)
+{
+    if (m_fd < 0 || m_fake)
+        return;
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = static_cast<__u32>(index);
+    if (!xioctl(VIDIOC_QBUF, &buf, "VIDIOC_QBUF"))
+        qWarning() << m_errorString;
+}
+
+bool V4l2Capture::setControl(Control control, int value)
+{
+    if (m_fd < 0)
+        return false;
+    if (m_fake)
+        return true;
+    v4l2_control ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    if (control == Exposure) {
+        ctrl.id = V4L2_CID_EXPOSURE_AUTO;
+        ctrl.value = value < 0 ? V4L2_EXPOSURE_APERTURE_PRIORITY : V4L2_EXPOSURE_MANUAL;
+        // Not every driver has auto exposure, absolute exposure may still work
+        xioctl(VIDIOC_S_CTRL, &ctrl, "V4L2_CID_EXPOSURE_AUTO");
+        if (value < 0)
+            return true;
+        ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+    } else {
+        ctrl.id = V4L2_CID_GAIN;
+    }
+    ctrl.value = value;
+    return xioctl(VIDIOC_S_CTRL, &ctrl, control == Exposure ? "V4L2_CID_EXPOSURE_ABSOLUTE" : "V4L2_CID_GAIN");
+}
+
+#else
+
+bool V4l2Capture::open(const QString &path, const format_t &requested)
+{
+    Q_UNUSED(path);
+    Q_UNUSED(requested);
+    m_errorString = "V4L2 is only available on Linux";
+    return false;
+}
+
+void V4l2Capture::close()
+{
+}
+
+bool V4l2Capture::dequeue(frame_t &frame, int timeoutMs)
+{
+    Q_UNUSED(frame);
+    Q_UNUSED(timeoutMs);
+    m_errorString = "V4L2 is only available on Linux";
+    return false;
+}
+
+void V4l2Capture::requeue(int index)
+{
+    Q_UNUSED(index);
+}
+
+bool V4l2Capture::setControl(Control control, int value)
+{
+    Q_UNUSED(control);
+    Q_UNUSED(value);
+    return false;
+}
+
+#endif
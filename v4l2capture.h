@@ -0,0 +1,91 @@
+#ifndef V4L2CAPTURE_H
+#define V4L2CAPTURE_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+/**
+ * @brief The V4l2Capture class streams frames from a V4L2 device using the driver's mmap buffers.
+ * Frames are handed out in the device native format (YUYV or MJPEG) and must be requeued after use.
+ * A regular file can be opened instead of a device: raw YUYV frames or concatenated JPEGs are then played
+ * in a loop at the requested fps, which is enough to exercise the backend without a camera or v4l2loopback.
+ */
+class V4l2Capture
+{
+public:
+    V4l2Capture();
+    ~V4l2Capture();
+
+    enum PixelFormat {
+        YUYV,
+        MJPEG
+    };
+
+    typedef struct {
+        int width;
+        int height;
+        PixelFormat pixelFormat;
+        int fps;
+    } format_t;
+
+    typedef struct {
+        int index;          ///< Buffer index to requeue()
+        const uchar *data;
+        quint32 bytesUsed;
+        qint64 timestamp;   ///< Driver timestamp when it is monotonic, monotonicNs() at dequeue otherwise
+    } frame_t;
+
+    enum Control {
+        Exposure,           ///< Manual exposure in 100 us units, negative value enables auto exposure
+        Gain
+    };
+
+    /**
+     * @brief open Negotiates format closest to requested and starts streaming, format() returns what driver accepted
+     */
+    bool open(const QString &path, const format_t &requested);
+    void close();
+    bool isOpened() const;
+    bool isFake() const;
+
+    const format_t &format() const;
+    int bytesPerLine() const;
+
+    /**
+     * @brief dequeue Waits up to timeoutMs for the next frame, false on timeout or error.
+     * errorString() is cleared on entry, so it is empty after a false return only if it was a timeout.
+     */
+    bool dequeue(frame_t &frame, int timeoutMs);
+    void requeue(int index);
+
+    bool setControl(Control control, int value);
+    QString errorString() const;
+
+private:
+    bool openDevice(const QString &path, const format_t &requested);
+    bool openFake(const QString &path, const format_t &requested);
+    bool dequeueFake(frame_t &frame, int timeoutMs);
+    bool xioctl(unsigned long request, void *arg, const char *what);
+
+    typedef struct {
+        void *start;
+        size_t length;
+    } buffer_t;
+
+    int m_fd;
+    bool m_fake;
+    format_t m_format;
+    int m_bytesPerLine;
+    QVector<buffer_t> m_buffers;
+    QString m_errorString;
+
+    // File-backed fake device
+    uchar *m_fakeData;
+    qint64 m_fakeSize;
+    QVector<qint64> m_fakeOffsets; ///< Frame start offsets, last entry is end of the last frame
+    int m_fakeNext;
+    qint64 m_fakeDue;
+};
+
+#endif // V4L2CAPTURE_H